@@ -11,6 +11,8 @@ static void m0804c_close(struct m0804c_handler *const self);
 static void wapi_process_success_cb(struct m0804c_handler *const self, wapi_process_type_t process_type);
 static void wapi_process_err_cb(struct m0804c_handler *const self, wapi_process_type_t process_type);
 
+static void wapi_rx_notify_cb(struct m0804c_handler *const self, uint8_t socket, uint16_t available);
+
 static wapi_info_t *m0804c_get_wapi_info(struct m0804c_handler *const self);
 static cert_file_t *m0804c_get_cert_file(struct m0804c_handler *const self);
 
@@ -22,6 +24,18 @@ extern uart_ops_t g_wapi_uart_ops;
 
 m0804c_handler_t g_wapi_handler_inst = {0};
 
+#if (UART_PROTO_CAPTURE)
+/* Session trace for tools/uart_replay, dump g_wapi_capture_buf[0..g_wapi_uart_capture.fill) */
+uint8_t g_wapi_capture_buf[WAPI_COMMU_CAPTURE_BUF_SIZE];
+uart_capture_t g_wapi_uart_capture;
+#endif
+
+#if (UART_PROTO_STATIC_ALLOC)
+/* Storage of the whole WAPI stack, placed by the linker (no heap at boot) */
+static uint8_t g_wapi_stack_storage[M0804C_STORAGE_SIZE(WAPI_COMMU_RX_BUF_SIZE)];
+static mem_arena_t g_wapi_stack_arena;
+#endif
+
 uart_rx_os_interface_t g_uart_os_interface = 
 {
     .pf_os_thread_create  = osal_task_create,
@@ -37,6 +51,7 @@ uart_rx_os_interface_t g_uart_os_interface =
 at_os_interface_t g_at_os_interface = 
 {
     .pf_sema_binary_create    = osal_sema_binary_create,
+    .pf_sema_counting_create  = osal_sema_counting_create,
     .pf_sema_delete           = osal_sema_delete,
     .pf_sema_give             = osal_sema_give,
     .pf_sema_take             = osal_sema_take,
@@ -44,8 +59,13 @@ at_os_interface_t g_at_os_interface =
     .pf_timer_start           = osal_timer_start,
     .pf_timer_stop            = osal_timer_stop,
     .pf_timer_delete          = osal_timer_delete,
+    .pf_get_tick_ms           = HAL_GetTick,    /* Latency statistics time base */
 };
 
+/* One wheel for all AT response timeouts, ticked by a single auto-reload OS timer */
+static timer_wheel_t g_wapi_timer_wheel;
+static void *g_wapi_wheel_tick_timer;
+
 static m0804c_os_interface_t g_wapi_os_interface = {
     .pf_os_delay_ms = osal_task_delay_ms,
 };
@@ -70,14 +90,18 @@ static uart_proto_input_arg_t wapi_uart_proto_input_arg =
     .frame_parse_att = &wapi_frame_parse_att,  
     .uart_ops = &g_wapi_uart_ops,        
     .os_interface = &g_uart_os_interface,    
-    .thread_att = &wapi_rx_thread_att
+    .thread_att = &wapi_rx_thread_att,
+#if (UART_PROTO_CAPTURE)
+    .capture = &g_wapi_uart_capture,
+#endif
 };
 
 static at_input_arg_t  wapi_at_input_arg = 
 {
     .uart_proto_input_arg = &wapi_uart_proto_input_arg, 
     .at_cmd_set_table = NULL,     /* Use built-in AT command table */
-    .at_os_interface = &g_at_os_interface       
+    .at_os_interface = &g_at_os_interface,
+    .timer_wheel = &g_wapi_timer_wheel,
 };
 
 static m0804c_pwr_ops_t wapi_pwr_ops = 
@@ -96,6 +120,7 @@ static wapi_callback_t wapi_callbacks =
 {
     .pf_process_success_cb = wapi_process_success_cb,
     .pf_process_err_cb = wapi_process_err_cb,
+    .pf_rx_notify_cb = wapi_rx_notify_cb,
 };
 
 static wapi_m0804c_input_arg_t wapi_input_arg = 
@@ -104,7 +129,10 @@ static wapi_m0804c_input_arg_t wapi_input_arg =
     .os_interface = &g_wapi_os_interface, 
     .pwr_ops = &wapi_pwr_ops,     
     .data_provider = &wapi_data_provider,
-    .callbacks = &wapi_callbacks     
+    .callbacks = &wapi_callbacks,
+#if (UART_PROTO_STATIC_ALLOC)
+    .arena = &g_wapi_stack_arena,
+#endif
 };
 
 static at_status_t wapi_at_recv_parse(uint8_t *buf, uint16_t len, void *arg, void *holder)
@@ -115,6 +143,18 @@ static at_status_t wapi_at_recv_parse(uint8_t *buf, uint16_t len, void *arg, voi
     return AT_OK;
 }
 
+/* Downstream data of the server, drained as soon as it arrives */
+static void wapi_rx_notify_cb(struct m0804c_handler *const self, uint8_t socket, uint16_t available)
+{
+    uint8_t buf[64];
+    uint16_t len = 0;
+    while (WAPI_OK == m0804c_recv(self, socket, buf, sizeof(buf), &len) && len)
+    {
+        WAPI_COMMU_DEBUG_OUT("WAPI RX socket %u: %u bytes\r\n", socket, len);
+        WAPI_COMMU_DEBUG_STRING(buf, len);
+    }
+}
+
 static void wapi_commu_task(void *argument)
 {
     uint8_t buf[32] = {0xDE, 0xAD, 0xBE, 0xEF};
@@ -122,16 +162,53 @@ static void wapi_commu_task(void *argument)
     {
         buf[i] = i;
     }
+#if AT_LATENCY_STATS
+    uint32_t send_cnt = 0;
+#endif
     while (1)
     {
-        m0804c_send(&g_wapi_handler_inst, buf, sizeof(buf), wapi_at_recv_parse);
+        m0804c_send(&g_wapi_handler_inst, WAPI_DEFAULT_SOCKET, buf, sizeof(buf), wapi_at_recv_parse);
+#if AT_LATENCY_STATS
+        if (0 == (++send_cnt % WAPI_COMMU_LAT_REPORT_PERIOD))
+            m0804c_lat_report(&g_wapi_handler_inst);
+#endif
         osal_task_delay_ms(5000);
     }
 }
 
+static void wapi_wheel_tick_cb(void *timer_handle, void *arg)
+{
+    (void)timer_handle;
+    timer_wheel_tick((timer_wheel_t *)arg);
+}
+
+/* The tick timer runs only while a timeout is armed on the wheel */
+static void wapi_wheel_tick_ctrl(bool is_run, void *arg)
+{
+    if (is_run)
+        osal_timer_start(arg, 0);
+    else
+        osal_timer_stop(arg, 0);
+}
+
 void wapi_commu_init(void)
 {
     wapi_status_t ret = WAPI_OK;
+#if (UART_PROTO_CAPTURE)
+    uart_capture_init(&g_wapi_uart_capture, g_wapi_capture_buf, sizeof(g_wapi_capture_buf), HAL_GetTick, 1000);
+    uart_capture_start(&g_wapi_uart_capture);
+#endif
+#if (UART_PROTO_STATIC_ALLOC)
+    mem_arena_init(&g_wapi_stack_arena, g_wapi_stack_storage, sizeof(g_wapi_stack_storage));
+#endif
+    timer_wheel_init(&g_wapi_timer_wheel, TIMER_WHEEL_TICK_MS, osal_enter_critical, osal_exit_critical);
+    if (0 != osal_timer_create(&g_wapi_wheel_tick_timer, "wheel_tick", TIMER_WHEEL_TICK_MS, 1,
+                               wapi_wheel_tick_cb, &g_wapi_timer_wheel))
+    {
+        WAPI_COMMU_DEBUG_ERR("WAPI timer wheel tick create failed\r\n");
+        return;
+    }
+    timer_wheel_set_tick_ctrl(&g_wapi_timer_wheel, wapi_wheel_tick_ctrl, g_wapi_wheel_tick_timer);
     ret = m0804c_inst(&g_wapi_handler_inst, &wapi_input_arg); 
 
     if (WAPI_OK != ret)
@@ -164,14 +241,13 @@ static void m0804c_open(struct m0804c_handler *const self)
 {
     HAL_GPIO_WritePin(GPIOB, WAPI_WAKE_Pin, GPIO_PIN_RESET);
     HAL_GPIO_WritePin(GPIOA, WAPI_PWR_Pin, GPIO_PIN_RESET);    
-    osal_task_delay_ms(2000);   
     WAPI_COMMU_DEBUG_OUT("WAPI M0804C opened\r\n");
 }
 static void m0804c_close(struct m0804c_handler *const self)
 {
     HAL_GPIO_WritePin(GPIOB, WAPI_WAKE_Pin, GPIO_PIN_SET);
     HAL_GPIO_WritePin(GPIOA, WAPI_PWR_Pin, GPIO_PIN_SET);  
-    osal_task_delay_ms(2000);
+    osal_task_delay_ms(WAPI_COMMU_PWR_OFF_MS);
     WAPI_COMMU_DEBUG_OUT("WAPI M0804C closed\r\n");
 }
 
@@ -190,8 +266,12 @@ static void wapi_process_success_cb(struct m0804c_handler *const self, wapi_proc
     switch (process_type)
     {
         case PROCESS_INIT:
-            WAPI_COMMU_DEBUG_OUT("WAPI PROCESS INIT SUCCESS\r\n");
+        {
+            uint32_t boot_ms = 0;
+            m0804c_get_boot_ms(self, &boot_ms);
+            WAPI_COMMU_DEBUG_OUT("WAPI PROCESS INIT SUCCESS, module booted in %u ms\r\n", (unsigned)boot_ms);
             break;
+        }
         case PROCESS_CERT_AUTH:
             WAPI_COMMU_DEBUG_OUT("WAPI PROCESS CERT AUTH SUCCESS\r\n");
             break;
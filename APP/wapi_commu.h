@@ -22,6 +22,10 @@ extern int SEGGER_RTT_printf(unsigned BufferIndex, const char *sFormat, ...);
 
 #define WAPI_COMMU_PARSE_THREAD_STACK_DEPTH        2048
 #define WAPI_COMMU_PARSE_THREAD_PRIORITY           24 /* WAPI_COMMU_PARSE_THREAD_PRIORITY must higher than UPP_COMMU_PARSE_THREAD_PRIORITY */
+#define WAPI_COMMU_RX_BUF_SIZE                     256  /* DMA ring of Core/usart.c (WAPI_RECV_BUF_SIZE), sizes the static arena */
+#define WAPI_COMMU_CAPTURE_BUF_SIZE                8192 /* RAM trace size when UART_PROTO_CAPTURE is enabled */
+#define WAPI_COMMU_LAT_REPORT_PERIOD               12   /* Print AT latency statistics every N data sends (AT_LATENCY_STATS) */
+#define WAPI_COMMU_PWR_OFF_MS                      100  /* Off time of a power cycle, the init process waits for the boot itself */
     
 void wapi_commu_init(void);   
 
@@ -20,7 +20,9 @@
 #define __AT_HANDLER_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "uart_proto.h"
+#include "timer_wheel.h"
 
 #include "SEGGER_RTT.h"
 extern int SEGGER_RTT_printf(unsigned BufferIndex, const char *sFormat, ...);
@@ -35,11 +37,47 @@ extern int SEGGER_RTT_printf(unsigned BufferIndex, const char *sFormat, ...);
 
 
 #define AT_SEND_LEN_MAX                 128
+#define AT_SEND_BUF_NUM                 2   /* Send buffers in rotation (ping-pong), must <= 8 */
 #define IS_ENABLE_SEND_BUF_PROTECTED    1/* always use in DMA Transmit */
+#define AT_TRANS_SEG_MAX                4   /* Max segments of one scatter-gather transparent send */
 
 #define AT_TIMEOUT_TICK                 500
 #define TRANSPARANT_TIMEOUT_TICK        2000
 #define MAX_RECV_CNT_OF_TRANS_SEND      2
+#define AT_RSP_SKIP_MAX                 4   /* Chunks in a row a transaction may reject with AT_ERR_RECV_NOT_MATCH */
+
+/**
+ * Send channel scheduling: senders queue on a priority lane instead of being rejected
+ * while another transaction holds the channel. Control lane is served first, but at most
+ * AT_LANE_STARVATION_MAX times in a row while data is waiting.
+ */
+#define AT_CHAN_WAIT_TICK               (2 * TRANSPARANT_TIMEOUT_TICK) /* Max queueing time of a sender */
+#define AT_LANE_STARVATION_MAX          4
+#define AT_TXN_NUM                      4   /* Transaction table entries, power of 2 (keeps late lookups off newer entries) */
+
+/**
+ * Response reassembly: IDLE chunks are accumulated and only complete "\r\n" terminated
+ * lines are handed to the response parsers, a partial line is kept until its terminator
+ * arrives in a later DMA burst. Set to 0 to deliver raw IDLE chunks.
+ */
+#define AT_LINE_REASSEMBLY              1
+#define AT_LINE_BUF_LEN                 544 /* Max partial line kept across chunks, >= the longest URC line */
+
+/**
+ * Latency statistics: a log2 bucketed histogram per at_func and per transparent send type
+ * of send->TX complete, TX complete->first response and send->final completion, plus
+ * timeout/retry counters. Needs pf_get_tick_ms in at_os_interface_t (NULL disables).
+ */
+#define AT_LATENCY_STATS                1
+#define AT_LAT_BUCKET_NUM               16  /* Bucket 0: 0 ms, bucket n: [2^(n-1), 2^n) ms, last one open ended */
+#define AT_LAT_TRANS_TYPE_NUM           4   /* Transparent send types (at_trans_callback_t.trans_type) */
+
+/**
+ * Response collector: a command with rsp_mode AT_RSP_COLLECT accumulates its response lines
+ * and completes on the first line starting with one of the table's final result codes,
+ * pf_at_recv_parse[0] then parses the whole response in one call.
+ */
+#define AT_COLLECT_BUF_LEN              256 /* Response kept for the parser, older lines dropped on overflow */
 
 /**
  * @def AT_CMD_END_MARKER
@@ -67,12 +105,40 @@ typedef enum
     AT_ERR_HANDLER_NOT_READY, /* AT handler not initialized (UART/command table unready) */
     AT_ERR_NOT_CONSUMED,
     AT_ERR_CMD_NOT_FOUND,     /* Specified AT function ID not found in command table */
-    AT_ERR_RECV_NOT_MATCH,
+    AT_ERR_RECV_NOT_MATCH,    /* Parse callback: chunk is not the awaited response (e.g. module debug output),
+                                 the transaction keeps waiting with its timer running */
+    AT_RECV_PARTIAL,          /* Parse callback: chunk carries part of the awaited response, the transaction
+                                 keeps its slot and restarts its timer, earlier skips are forgiven */
     AT_ERR_OTHERS             /* Unspecified error (e.g., UART transmission failure) */
 } at_status_t;
 
+/**
+ * Response parser of a transaction slot. A command slot that hits AT_RSP_SKIP_MAX is called once
+ * more with buf NULL and len 0: the awaited answer is lost, the return value is ignored.
+ */
 typedef at_status_t (*pf_at_recv_parse_t)(uint8_t *buf, uint16_t len, void *arg, void *holder);
 
+/**
+ * @enum at_rsp_mode_t
+ * @brief How the response of an AT command is delimited
+ */
+typedef enum
+{
+    AT_RSP_COUNT = 0,         /* receive_count responses, one parse callback each */
+    AT_RSP_COLLECT            /* Lines collected up to a final result code, one parse callback */
+} at_rsp_mode_t;
+
+/**
+ * @enum at_lane_t
+ * @brief Send priority lane, AT commands always use AT_LANE_CTRL
+ */
+typedef enum
+{
+    AT_LANE_DATA = 0,         /* Bulk/application data (default of transparent sends) */
+    AT_LANE_CTRL,             /* Time-critical control traffic */
+    AT_LANE_NUM
+} at_lane_t;
+
 /**
  * @struct at_trans_callback_t
  * @brief Encapsulates transparent send callback parameters
@@ -86,14 +152,51 @@ typedef struct
     void *arg;                            /* User-defined argument passed to callback */
     void *holder;                         /* Holder context for callback */
     uint8_t receive_count;                /* Number of response callbacks expected (0 = default 1) */
+    uint16_t rx_block_len;                /* First response is a raw block of this length (0 = line mode) */
+    at_lane_t lane;                       /* Priority lane (0 = AT_LANE_DATA) */
+    uint8_t trans_type;                   /* Latency statistics slot, < AT_LAT_TRANS_TYPE_NUM */
 } at_trans_callback_t;
 
+/**
+ * @enum at_seg_owner_t
+ * @brief Ownership of one segment in a scatter-gather transparent send
+ */
+typedef enum
+{
+    AT_SEG_COPY = 0,          /* Copied into the protected send buffer, caller may reuse it on return */
+    AT_SEG_BORROWED           /* Sent by DMA straight from caller memory, must stay valid until released */
+} at_seg_owner_t;
+
+/**
+ * @struct at_trans_seg_t
+ * @brief One segment of a scatter-gather transparent send (iovec style)
+ *
+ * Segments are transmitted back to back in array order. Adjacent AT_SEG_COPY segments
+ * are packed into the send buffer and go out in a single DMA transfer, each AT_SEG_BORROWED
+ * segment is its own DMA transfer. pf_release of a borrowed segment is called from the
+ * TX complete ISR once the last segment has left, immutable data (e.g. certificate in
+ * flash) can leave it NULL.
+ */
+typedef struct
+{
+    const uint8_t   *data;                /* Segment data */
+    uint16_t        len;                  /* Segment length in bytes */
+    at_seg_owner_t  owner;                /* Copy-required or borrowed-until-complete */
+    void (*pf_release)(const uint8_t *data, void *release_arg); /* Borrowed only, ISR context, may be NULL */
+    void            *release_arg;         /* User argument passed to pf_release */
+} at_trans_seg_t;
+
 /* ---------------- OSAL interface for AT handler (semaphore + timer) ---------------- */
 typedef struct
 {
     int32_t (*pf_sema_binary_create)(void **p_sema_handle);
+    /**
+     * Optional for the AT handler: with it a sender waits up to AT_CHAN_WAIT_TICK for a free send
+     * buffer, without it fails at once with AT_ERR_NOT_CONSUMED. WAPI_M0804C requires it.
+     */
+    int32_t (*pf_sema_counting_create)(void **p_sema_handle, uint32_t max_count, uint32_t init_count);
     void    (*pf_sema_delete)(void *sema_handle);
-    int32_t (*pf_sema_give)(void *sema_handle);
+    int32_t (*pf_sema_give)(void *sema_handle);     /* Also from ISR (buffer release at TX complete) */
     int32_t (*pf_sema_take)(void *sema_handle, uint32_t timeout);
 
     int32_t (*pf_timer_create)(void **p_timer_handle, const char *timer_name, uint32_t timer_period,
@@ -102,7 +205,47 @@ typedef struct
     int32_t (*pf_timer_stop)(void *timer_handle, uint32_t ticks_to_wait);
     int32_t (*pf_timer_delete)(void *timer_handle, uint32_t ticks_to_wait);
 
+    uint32_t (*pf_get_tick_ms)(void);     /* Optional, ISR safe, latency statistics are off when NULL,
+                                             also bounds a send channel wait woken spuriously */
 } at_os_interface_t;
+
+#if AT_LATENCY_STATS
+/**
+ * @enum at_lat_interval_t
+ * @brief Measured intervals of one transaction
+ */
+typedef enum
+{
+    AT_LAT_TX_DONE = 0,       /* Send call -> last TX complete */
+    AT_LAT_FIRST_RSP,         /* Last TX complete -> first response dispatched */
+    AT_LAT_COMPLETE,          /* Send call -> final response (or TX complete without response) */
+    AT_LAT_INTERVAL_NUM
+} at_lat_interval_t;
+
+/**
+ * @struct at_lat_hist_t
+ * @brief Log2 bucketed latency histogram in ms, bucket counters saturate at 0xFFFF
+ */
+typedef struct
+{
+    uint16_t bucket[AT_LAT_BUCKET_NUM];
+    uint32_t sum_ms;          /* Sum of samples, mean = sum_ms / samples */
+    uint32_t max_ms;
+} at_lat_hist_t;
+
+/**
+ * @struct at_lat_stats_t
+ * @brief Statistics of one at_func or transparent send type
+ */
+typedef struct
+{
+    uint32_t send_cnt;        /* Transactions put on the wire */
+    uint32_t done_cnt;        /* Transactions completed (all responses received) */
+    uint32_t timeout_cnt;     /* Transactions expired waiting for a response */
+    uint32_t retry_cnt;       /* Sends following a timeout of the same at_func/type */
+    at_lat_hist_t hist[AT_LAT_INTERVAL_NUM];
+} at_lat_stats_t;
+#endif
 /**
  * @struct at_cmd_set_t
  * @brief AT command table entry structure
@@ -114,11 +257,30 @@ typedef struct
 {
     uint8_t     at_func;      /* Unique ID for the AT command function (e.g., TEST=0, WAPI_CONN=2) */
     char        *send;        /* AT command string template (supports %s placeholders for variables) */    
-    uint8_t     receive_count;       /* must <= MAX_RECV_CNT_OF_CMD_SEND */
+    uint8_t     receive_count;       /* must <= MAX_RECV_CNT_OF_CMD_SEND, 1 for AT_RSP_COLLECT */
     pf_at_recv_parse_t pf_at_recv_parse[MAX_RECV_CNT_OF_CMD_SEND];
     void        *arg;         /* User context passed to parse algo callbacks */
+    at_rsp_mode_t rsp_mode;   /* Response delimiting (0 = AT_RSP_COUNT) */
 }at_cmd_set_t;
 
+/* URC callback, buf is one line (terminator included when received) valid during the call */
+typedef void (*pf_at_urc_t)(uint8_t *buf, uint16_t len, void *holder);
+
+/**
+ * @struct at_urc_t
+ * @brief Unsolicited result code table entry
+ *
+ * A line starting with a prefix of the table's urc_table goes to its callback on the parse
+ * thread and never reaches a waiting transaction. The line is passed where it lies (DMA ring
+ * or line buffer). Length-delimited blocks are not scanned. A URC line spread over several
+ * chunks and longer than AT_LINE_BUF_LEN is dropped whole, none of it reaches a transaction.
+ */
+typedef struct
+{
+    const char  *prefix;      /* Line start identifying the URC, NULL ends the table */
+    pf_at_urc_t pf_urc;
+}at_urc_t;
+
 /**
  * @struct at_cmd_set_table_t
  * @brief AT Command Table Container Structure
@@ -138,6 +300,8 @@ typedef struct
                                      defining a unique AT command function, template, and expected response) */
     uint8_t             table_len; 
     void                *holder;                                
+    const char * const  *final_codes; /* NULL terminated final result code prefixes, required by AT_RSP_COLLECT entries */
+    const at_urc_t      *urc_table;   /* NULL prefix terminated, NULL: no unsolicited result codes */
 } at_cmd_set_table_t;
 
 /**
@@ -153,6 +317,10 @@ typedef struct
     uart_proto_input_arg_t  *uart_proto_input_arg; /* UART protocol layer input arguments */
     at_cmd_set_table_t      *at_cmd_set_table;   /* Pointer to AT command table container */    
     at_os_interface_t       *at_os_interface;    /* OSAL for semaphore/timer */
+    timer_wheel_t           *timer_wheel;        /* Optional shared wheel for the response timeout, NULL: OS timer */
+#if (UART_PROTO_STATIC_ALLOC)
+    mem_arena_t             *arena;              /* Instance storage, at least AT_STORAGE_SIZE() free, shared with uart_proto */
+#endif
 } at_input_arg_t;
 
 /**
@@ -190,6 +358,36 @@ typedef struct at_handler
     // at_status_t (*pf_at_cmd_send)(at_handler_t *const self, uint8_t at_func, ...);
 } at_handler_t;
 
+#if (UART_PROTO_STATIC_ALLOC)
+/**
+ * Arena bytes of one AT handler for a command table of cmd_num entries, UART protocol
+ * instance included. AT_PRIV_SIZE is an upper bound checked against the private type
+ * when AT_handler.c is compiled, each term bounds the private fields named.
+ */
+/* send_buf[][], line_buf, collect_buf */
+#define AT_PRIV_BUF_SIZE    (AT_SEND_BUF_NUM * AT_SEND_LEN_MAX + AT_LINE_BUF_LEN + AT_COLLECT_BUF_LEN)
+/* txn[]: tag, send type and callback, receive/skip counters, padding */
+#define AT_PRIV_TXN_SIZE    (AT_TXN_NUM * (sizeof(at_trans_callback_t) + 4 * sizeof(void *)))
+/* tx_seg[] */
+#define AT_PRIV_SEG_SIZE    (AT_TRANS_SEG_MAX * sizeof(at_trans_seg_t))
+/* uart_proto_handle, timeout_timer, lat_slot_tab, send_buf_free_sema, lane_sema_handle[], timeout_wheel_timer */
+#define AT_PRIV_HANDLE_SIZE ((4 + AT_LANE_NUM) * sizeof(void *) + sizeof(wheel_timer_t))
+/* Flags, sequence IDs, lane_waiting[], segment/buffer indexes, line/collect counters, latency ticks */
+#define AT_PRIV_STATE_SIZE  (64 + AT_LANE_NUM)
+#define AT_PRIV_SIZE        (AT_PRIV_BUF_SIZE + AT_PRIV_TXN_SIZE + AT_PRIV_SEG_SIZE + \
+                             AT_PRIV_HANDLE_SIZE + AT_PRIV_STATE_SIZE)
+#if AT_LATENCY_STATS
+#define AT_LAT_SLOT_SIZE                (sizeof(at_lat_stats_t) + 4)
+#define AT_LAT_STORAGE_SIZE(cmd_num)    MEM_ARENA_ALIGN_UP(((cmd_num) + AT_LAT_TRANS_TYPE_NUM) * AT_LAT_SLOT_SIZE)
+#else
+#define AT_LAT_STORAGE_SIZE(cmd_num)    0
+#endif
+#define AT_STORAGE_SIZE(cmd_num, rx_buf_size) \
+    (MEM_ARENA_ALIGN_UP(AT_PRIV_SIZE) + MEM_ARENA_ALIGN_UP(sizeof(parse_algo_t)) + \
+     MEM_ARENA_ALIGN_UP(sizeof(uart_proto_t)) + AT_LAT_STORAGE_SIZE(cmd_num) + \
+     UART_PROTO_STORAGE_SIZE(rx_buf_size, 0))
+#endif
+
 /**
  * @brief AT handler initialization function
  * 
@@ -219,9 +417,32 @@ at_status_t at_cmd_send_impl(at_handler_t *const self, uint32_t at_func, ...);
 #define AT_CMD_SEND(self, at_func, ...)  \
     at_cmd_send_impl((self), (at_func), ##__VA_ARGS__, AT_CMD_END_MARKER)   
     
+/**
+ * @brief Encode an AT command straight into a send buffer (no vsnprintf)
+ *
+ * at_cmd_prepare looks up at_func and hands out a free send buffer in frame, the caller
+ * writes the encoded command into frame->buf (at most frame->cap bytes) and sends it with
+ * at_cmd_commit, or gives the buffer back with at_cmd_abort. at_cmd_commit consumes the
+ * frame in every case. Used by the typed encoders of AT_handler.hpp.
+ */
+typedef struct
+{
+    uint8_t *buf;                   /* Send buffer to encode into, NULL once committed/aborted */
+    uint16_t cap;                   /* Bytes available in buf */
+    uint8_t buf_idx;
+    const at_cmd_set_t *cmd_entry;  /* Matched command table entry */
+} at_cmd_frame_t;
+
+at_status_t at_cmd_prepare(at_handler_t *const self, uint32_t at_func, at_cmd_frame_t *const frame);
+at_status_t at_cmd_commit(at_handler_t *const self, at_cmd_frame_t *const frame, uint16_t len);
+void at_cmd_abort(at_handler_t *const self, at_cmd_frame_t *const frame);
+
 /* transparant send with receive callback, callback = NULL means send without respond */
 at_status_t at_trans_send(at_handler_t *const self, uint8_t *const data, uint16_t len, 
                           const at_trans_callback_t *callback); 
+/* scatter-gather transparent send, segments are sent in order as one transaction */
+at_status_t at_trans_sendv(at_handler_t *const self, const at_trans_seg_t *segs, uint8_t seg_num,
+                           const at_trans_callback_t *callback);
 
 /* call in IDLE ISR */
 void at_notify_recv_isr_cb(at_handler_t *const self);
@@ -229,6 +450,19 @@ void at_notify_recv_isr_cb(at_handler_t *const self);
 void at_send_complete_isr_cb(at_handler_t *const self);
 /* call in UART/DMA error ISR */
 void at_error_recv_isr_cb(at_handler_t *const self);
+/* drop the current transaction, a transfer still on the wire frees its buffers and the channel on TX complete */
 void at_reset_send_state(at_handler_t *const self);
 
+#if AT_LATENCY_STATS
+/**
+ * @brief Copy the statistics of one at_func (is_trans false) or transparent send type
+ * @return AT_OK, AT_ERR_CMD_NOT_FOUND if id is not tracked, AT_ERR_HANDLER_NOT_READY
+ */
+at_status_t at_lat_snapshot(at_handler_t *const self, bool is_trans, uint8_t id, at_lat_stats_t *out);
+/* clear all statistics */
+void at_lat_reset(at_handler_t *const self);
+/* upper bound in ms of the bucket holding the given percentile (0..100, capped at max_ms), 0 if empty */
+uint32_t at_lat_percentile(const at_lat_hist_t *hist, uint8_t percent);
+#endif
+
 #endif //__AT_HANDLER_H__
@@ -0,0 +1,278 @@
+/**
+ * @file AT_handler.hpp
+ * @brief Optional header-only C++17 layer over the AT handler
+ *
+ * A command is a type carrying its at_func and template (AT_CPP_CMD). The template is
+ * parsed at compile time: argument count and kinds are checked with static_assert (%d takes
+ * an integer or enum, %s a string), and at::send() encodes the command straight into the
+ * send buffer handed out by at_cmd_prepare(). Literal runs become fixed-size copies and %d
+ * is written as decimal digits, there is no vsnprintf and no format string at runtime.
+ *
+ * Data and responses are passed as span views of the caller and parse buffers, nothing is
+ * copied on top of what the C handler does. std::span is used when the library has it, a
+ * minimal stand-in otherwise.
+ */
+
+#ifndef __AT_HANDLER_HPP__
+#define __AT_HANDLER_HPP__
+
+#if !defined(__cplusplus) || (__cplusplus < 201703L)
+#error "AT_handler.hpp needs C++17"
+#endif
+
+extern "C" {
+#include "AT_handler.h"
+}
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#if __has_include(<version>)
+#include <version>
+#endif
+#if defined(__cpp_lib_span)
+#include <span>
+#endif
+
+/* Declare a command type, e.g. AT_CPP_CMD(set_echo, M0804C_AT_SET_ECHO, M0804C_AT_TMPL_SET_ECHO) */
+#define AT_CPP_CMD(name, at_func, tmpl_str) \
+    struct name \
+    { \
+        static constexpr uint32_t func = (at_func); \
+        static constexpr char tmpl[] = tmpl_str; \
+    }
+
+namespace at
+{
+
+#if defined(__cpp_lib_span)
+template <typename T>
+using span = std::span<T>;
+#else
+template <typename T>
+class span
+{
+public:
+    constexpr span() noexcept = default;
+    constexpr span(T *data, std::size_t size) noexcept : m_data(data), m_size(size) {}
+    template <std::size_t N>
+    constexpr span(T (&arr)[N]) noexcept : m_data(arr), m_size(N) {}
+    /* span<T> -> span<const T> */
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U (*)[], T (*)[]>>>
+    constexpr span(const span<U> &other) noexcept : m_data(other.data()), m_size(other.size()) {}
+
+    constexpr T *data() const noexcept { return m_data; }
+    constexpr std::size_t size() const noexcept { return m_size; }
+    constexpr bool empty() const noexcept { return 0 == m_size; }
+    constexpr T &operator[](std::size_t idx) const noexcept { return m_data[idx]; }
+    constexpr T *begin() const noexcept { return m_data; }
+    constexpr T *end() const noexcept { return m_data + m_size; }
+    constexpr span subspan(std::size_t offset, std::size_t count) const noexcept
+    {
+        return span(m_data + offset, count);
+    }
+
+private:
+    T *m_data = nullptr;
+    std::size_t m_size = 0;
+};
+#endif
+
+/* Response bytes seen by a parse callback, a view into the receive buffer valid during the call */
+using rsp_view = span<const uint8_t>;
+
+namespace detail
+{
+
+/* Same placeholder rule as count_placeholder() in AT_handler.c */
+constexpr bool is_placeholder(const char *tmpl, std::size_t idx)
+{
+    return '%' == tmpl[idx] && ('s' == tmpl[idx + 1] || 'd' == tmpl[idx + 1]);
+}
+
+constexpr std::size_t placeholder_count(const char *tmpl)
+{
+    std::size_t cnt = 0;
+    for (std::size_t i = 0; '\0' != tmpl[i]; i++)
+    {
+        if (is_placeholder(tmpl, i))
+        {
+            cnt++;
+            i++;
+        }
+    }
+    return cnt;
+}
+
+/* Offset of placeholder n, template length for n == placeholder_count (end of the last literal run) */
+constexpr std::size_t placeholder_pos(const char *tmpl, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; '\0' != tmpl[i]; i++)
+    {
+        if (is_placeholder(tmpl, i))
+        {
+            if (0 == n--)
+                return i;
+            i++;
+        }
+    }
+    return i;
+}
+
+constexpr char placeholder_kind(const char *tmpl, std::size_t n)
+{
+    return tmpl[placeholder_pos(tmpl, n) + 1];
+}
+
+/* Start of the literal run in front of placeholder n */
+constexpr std::size_t literal_begin(const char *tmpl, std::size_t n)
+{
+    return n ? placeholder_pos(tmpl, n - 1) + 2 : 0;
+}
+
+template <typename T>
+constexpr bool is_dec_arg_v = std::is_integral_v<T> || std::is_enum_v<T>;
+
+template <typename T>
+constexpr bool is_str_arg_v = std::is_convertible_v<const T &, std::string_view>;
+
+struct encoder
+{
+    uint8_t *pos;
+    uint8_t *end;
+    bool is_overflow;
+
+    void put(const char *src, std::size_t len)
+    {
+        if (len > static_cast<std::size_t>(end - pos))
+        {
+            is_overflow = true;
+            return;
+        }
+        std::memcpy(pos, src, len);
+        pos += len;
+    }
+
+    template <typename T>
+    void put_dec(T value)
+    {
+        char digit[24];
+        std::size_t idx = sizeof(digit);
+        bool is_negative = false;
+        unsigned long long mag;
+        if constexpr (std::is_signed_v<T>)
+        {
+            is_negative = value < 0;
+            mag = is_negative ? 0ULL - static_cast<unsigned long long>(value) : static_cast<unsigned long long>(value);
+        }
+        else
+            mag = static_cast<unsigned long long>(value);
+        do
+        {
+            digit[--idx] = static_cast<char>('0' + mag % 10);
+            mag /= 10;
+        } while (mag);
+        if (is_negative)
+            digit[--idx] = '-';
+        put(digit + idx, sizeof(digit) - idx);
+    }
+};
+
+template <typename Cmd, std::size_t N>
+inline void put_literal(encoder &enc)
+{
+    constexpr std::size_t begin = literal_begin(Cmd::tmpl, N);
+    constexpr std::size_t len = placeholder_pos(Cmd::tmpl, N) - begin;
+    if constexpr (0 != len)
+        enc.put(Cmd::tmpl + begin, len);
+}
+
+template <typename Cmd, std::size_t N, typename T>
+inline void put_arg(encoder &enc, const T &arg)
+{
+    using arg_t = std::remove_cv_t<T>;
+    constexpr char kind = placeholder_kind(Cmd::tmpl, N);
+    static_assert('d' != kind || is_dec_arg_v<arg_t>, "%d placeholder needs an integer or enum argument");
+    static_assert('s' != kind || is_str_arg_v<arg_t>, "%s placeholder needs a string argument");
+    if constexpr ('d' == kind)
+    {
+        if constexpr (std::is_enum_v<arg_t>)
+            enc.put_dec(static_cast<std::underlying_type_t<arg_t>>(arg));
+        else
+            enc.put_dec(arg);
+    }
+    else
+    {
+        std::string_view str(arg);
+        enc.put(str.data(), str.size());
+    }
+}
+
+template <typename Cmd, std::size_t... N, typename... Args>
+inline void encode_args(encoder &enc, std::index_sequence<N...>, const Args &... args)
+{
+    ((put_literal<Cmd, N>(enc), put_arg<Cmd, N>(enc, args)), ...);
+    put_literal<Cmd, sizeof...(N)>(enc);
+}
+
+template <at_status_t (*Parse)(rsp_view rsp, void *arg, void *holder)>
+at_status_t recv_parse_thunk(uint8_t *buf, uint16_t len, void *arg, void *holder)
+{
+    return Parse(rsp_view(buf, len), arg, holder);
+}
+
+} // namespace detail
+
+/**
+ * @brief Encode and send command Cmd, same transaction semantics as AT_CMD_SEND
+ * @return AT_ERR_OTHERS if the encoded command does not fit the send buffer,
+ *         others as at_cmd_prepare()/at_cmd_commit()
+ */
+template <typename Cmd, typename... Args>
+at_status_t send(at_handler_t *const self, const Args &... args)
+{
+    static_assert(detail::placeholder_count(Cmd::tmpl) == sizeof...(Args),
+                  "argument count does not match the AT command template");
+    at_cmd_frame_t frame;
+    at_status_t status = at_cmd_prepare(self, Cmd::func, &frame);
+    if (AT_OK != status)
+        return status;
+
+    detail::encoder enc{frame.buf, frame.buf + frame.cap, false};
+    detail::encode_args<Cmd>(enc, std::index_sequence_for<Args...>{}, args...);
+    if (enc.is_overflow)
+    {
+        at_cmd_abort(self, &frame);
+        return AT_ERR_OTHERS;
+    }
+    return at_cmd_commit(self, &frame, static_cast<uint16_t>(enc.pos - frame.buf));
+}
+
+/* Parse callback taking a response view, e.g. at::recv_parse<my_parse> in at_trans_callback_t */
+template <at_status_t (*Parse)(rsp_view rsp, void *arg, void *holder)>
+constexpr pf_at_recv_parse_t recv_parse = detail::recv_parse_thunk<Parse>;
+
+/* Transparent send of a data view, the bytes are copied or sent in place as by at_trans_send */
+inline at_status_t trans_send(at_handler_t *const self, span<const uint8_t> data,
+                              const at_trans_callback_t *callback)
+{
+    if (data.size() > UINT16_MAX)
+        return AT_ERR_PARAM_INVALID;
+    return at_trans_send(self, const_cast<uint8_t *>(data.data()), static_cast<uint16_t>(data.size()), callback);
+}
+
+inline at_status_t trans_sendv(at_handler_t *const self, span<const at_trans_seg_t> segs,
+                               const at_trans_callback_t *callback)
+{
+    if (segs.size() > AT_TRANS_SEG_MAX)
+        return AT_ERR_PARAM_INVALID;
+    return at_trans_sendv(self, segs.data(), static_cast<uint8_t>(segs.size()), callback);
+}
+
+} // namespace at
+
+#endif /* __AT_HANDLER_HPP__ */
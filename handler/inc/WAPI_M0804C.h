@@ -35,6 +35,107 @@
 #define WAPI_THREAD_PRIORITY            24
 #define WAPI_THREAD_STACK_SIZE          2048//1024
 
+/**
+ * Processes: init, authentication, connect and the blocking cert upload and disconnect all run
+ * on the one wapi_sm task, an event-driven state machine woken by process requests, step
+ * answers from the parse thread and its own step deadlines. Requested processes start in that
+ * order once the running one ended; an API call waits for the result of its own process.
+ * Step deadlines, intervals and retry backoffs are timers on the wheel of the AT input
+ * argument (at_input_arg->timer_wheel), which m0804c_inst requires.
+ */
+#define WAPI_SM_QUEUE_LEN               8   /* Events waiting for the wapi_sm task */
+
+/**
+ * Power on: pf_m0804c_open only switches the module on, the init process then polls its first
+ * command every AT response timeout until the module answers, so init starts once the module
+ * has booted instead of after a fixed delay. m0804c_get_boot_ms reports the boot time measured
+ * (needs pf_get_tick_ms of the AT OSAL).
+ */
+#define WAPI_READY_TIMEOUT_MS           10000   /* Longest boot before the init process fails */
+
+/**
+ * Deferred work: callbacks running on the UART parse thread only classify a response and
+ * post the follow-up (user response callback, reconnect to the wapi_sm task) to another
+ * thread, so receive dispatch never waits on application or reconnect logic. Process
+ * reports run on the wapi_work thread as well, free to call the blocking APIs.
+ */
+#define WAPI_WORK_QUEUE_LEN             4
+#define WAPI_WORK_DATA_LEN              64  /* Response bytes copied for a deferred user callback */
+
+/**
+ * Data send: a message longer than one NSEND is split into WAPI_NSEND_CHUNK_MAX byte chunks,
+ * each hex encoded straight into one of the send buffers while the previous chunk is still
+ * on the wire. A multi-chunk m0804c_send blocks until its last chunk is handed to the UART.
+ *
+ * A socket switched to WAPI_SEND_MODE_BINARY sends the payload as is behind a length prefix
+ * ("AT+NSEND,<socket>,0,<len>,<bytes>\r\n"), half the UART bytes of hex. Its first send probes
+ * the module with an empty binary NSEND and falls back to hex if the module rejects it.
+ */
+#define WAPI_SEND_BUF_SIZE              128 /* One "AT+NSEND,<socket>,1,<hex>\r\n" command */
+#define WAPI_SEND_BUF_NUM               2
+#define WAPI_NSEND_CHUNK_MAX            ((WAPI_SEND_BUF_SIZE - 16 - 2) / 2) /* 16: command prefix, 2: "\r\n" */
+#define WAPI_NSEND_BIN_CHUNK_MAX        (WAPI_SEND_BUF_SIZE - 20 - 2)       /* 20: "AT+NSEND,<socket>,0,<len>," */
+#define WAPI_SOCKET_NUM                 4   /* Socket ids 0..3 of the module */
+
+/**
+ * Data receive: "+NRECV" data pushed by the module (enabled by AT+NRECV,<socket>,1,1) is taken
+ * off the RX path as an unsolicited result code and hex decoded straight into the ring of its
+ * socket, read with m0804c_recv. pf_rx_notify_cb runs on the wapi_work thread once a socket
+ * holds at least its watermark. A push that does not fit the free space is dropped whole.
+ * A push spread over several DMA bursts is reassembled in the AT line buffer, which must hold
+ * M0804C_URC_RECV_LINE_MAX characters, the line of a push filling a whole ring.
+ */
+#define WAPI_RX_RING_SIZE               256 /* Bytes per socket, power of 2 */
+
+/**
+ * Sockets: once the link layer is up the connect process opens every socket added with
+ * m0804c_socket_config, in id order. WAPI_DEFAULT_SOCKET is always opened and goes to the
+ * server of wapi_info unless configured otherwise. Messages of one socket are sent one after
+ * another; chunks of different sockets take turns on the AT channel, so a bulk upload holds
+ * another socket up by one chunk at most. Sockets on AT_LANE_CTRL go ahead of the data lane.
+ */
+#define WAPI_DEFAULT_SOCKET             1
+
+/**
+ * Reconnect: a stream socket answered "[ERR] Socket not in use!" is recovered in tiers, each
+ * one tried once before the next: reopen the socket if the link layer still reports
+ * "WAPI STATUS IS 1" (other sockets keep sending meanwhile), authenticate again, restart the
+ * module with the init process. m0804c_get_reconn_stats reports how long recoveries took,
+ * from the error to the connect process success (needs pf_get_tick_ms of the AT OSAL).
+ */
+#define WAPI_SOCKET_TX_WAIT_TICK        (2 * AT_CHAN_WAIT_TICK) /* Max wait for the previous message of the socket */
+
+/**
+ * Datagram sockets (WAPI_SOCKET_UDP) open without waiting for a TCP session and take whole
+ * datagrams with m0804c_sendto, one NSEND each, never split or reconnected on "[ERR]".
+ * Consecutive datagrams are packed into one send buffer and go out as one AT transaction,
+ * up to WAPI_UDP_BATCH_MAX of them; their answers are counted, also several in one burst.
+ * Set it to 1 for firmware that loses a command arriving before the previous one is answered.
+ */
+#define WAPI_UDP_BATCH_MAX              4   /* Datagrams per AT round trip */
+
+/**
+ * Windowed send: m0804c_send_window writes up to WAPI_SEND_WINDOW messages of one chunk each
+ * back to back, one NSEND per message, before the first answer is back, spread over the free
+ * send buffers. The answers are matched to the messages in order and each message reports
+ * "+OK", "[ERR]" or no answer through its own callback, on the calling thread once its window
+ * is answered. Throughput then grows with the window rather than one message per round trip.
+ */
+#define WAPI_SEND_WINDOW                4   /* Messages in flight per socket, <= 8 */
+
+/**
+ * Coalesced send: m0804c_send_async copies a small message into the TX queue of its stream
+ * socket and returns at once. The wapi_tx thread merges queued messages into full NSEND chunks:
+ * a full chunk goes out right away, a partial one once it has waited WAPI_TX_DELAY_MS
+ * (m0804c_set_tx_delay) or on m0804c_send_flush. Message boundaries and
+ * per-message answers are not kept, nor the order against m0804c_send on the same socket.
+ * Queued bytes are lost when their socket closes before they are sent or their send fails;
+ * m0804c_get_tx_dropped counts them per socket.
+ */
+#define WAPI_TX_COALESCE                1
+#define WAPI_TX_QUEUE_SIZE              256 /* Bytes per socket, power of 2 */
+#define WAPI_TX_DELAY_MS                20  /* Default max wait of a partial chunk, 0: no wait */
+
 #include "SEGGER_RTT.h"
 extern int SEGGER_RTT_printf(unsigned BufferIndex, const char *sFormat, ...);
 #define WAPI_DEBUG_OUT(fmt, ...)      SEGGER_RTT_printf(0, fmt "\r\n", ##__VA_ARGS__)  /* Output log to RTT buffer 0 */
@@ -55,6 +156,7 @@ typedef enum
     WAPI_ERR_MISS_CERT,
     WAPI_ERR_CMD_NOT_FOUND,     /* Specified AT function ID not found in command table */
     WAPI_ERR_RECV_NOT_MATCH,
+    WAPI_ERR_QUEUE_FULL,        /* Not enough free space in the TX queue, nothing queued */
     WAPI_ERR_OTHERS             /* Unspecified error (e.g., UART transmission failure) */
 } wapi_status_t;
 
@@ -63,9 +165,149 @@ typedef enum
     PROCESS_INIT = 0,
     PROCESS_CERT_AUTH,
     PROCESS_PWD_AUTH,
-    PROCESS_CONNECT
+    PROCESS_CONNECT,
+    PROCESS_TYPE_NUM
 }wapi_process_type_t;
 
+/* Transparent send types, latency statistics slots of the AT handler (must be <= AT_LAT_TRANS_TYPE_NUM) */
+typedef enum
+{
+    WAPI_TRANS_NSEND = 0,       /* AT+NSEND data */
+    WAPI_TRANS_CERT,            /* Certificate file segments */
+    WAPI_TRANS_NRECV,           /* AT+NRECV polling */
+    WAPI_TRANS_TYPE_NUM
+}wapi_trans_type_t;
+
+/* Payload encoding of AT+NSEND, per socket */
+typedef enum
+{
+    WAPI_SEND_MODE_HEX = 0,     /* Hex characters, every module firmware (default) */
+    WAPI_SEND_MODE_BINARY       /* Length-prefixed raw bytes, hex if the module rejects it */
+}wapi_send_mode_t;
+
+typedef enum
+{
+    WAPI_SOCKET_TCP = 0,        /* Byte stream, m0804c_send (default) */
+    WAPI_SOCKET_UDP             /* Datagrams, m0804c_sendto */
+}wapi_socket_proto_t;
+
+/* Endpoint and send lane of a socket, see m0804c_socket_config */
+typedef struct
+{
+    wapi_socket_proto_t proto;
+    uint8_t remote_ip[4];
+    uint16_t remote_port;
+    uint16_t local_port;
+    at_lane_t lane;             /* AT_LANE_CTRL for control sessions next to bulk data */
+}wapi_socket_param_t;
+
+/* Reconnect tiers, cheapest first */
+typedef enum
+{
+    WAPI_RECONN_NONE = 0,
+    WAPI_RECONN_SOCKET,         /* TCP_UDP_CONN again on the link that is still up */
+    WAPI_RECONN_AUTH,           /* WAPI authentication and connect process */
+    WAPI_RECONN_INIT,           /* Power cycle, init, authentication and connect process */
+    WAPI_RECONN_TIER_NUM
+}wapi_reconn_tier_t;
+
+typedef struct
+{
+    uint32_t recover_num[WAPI_RECONN_TIER_NUM]; /* Recoveries by the tier that completed them */
+    uint32_t last_recover_ms;   /* Socket error to connected again, 0 without a tick source */
+    uint32_t max_recover_ms;
+    wapi_reconn_tier_t last_tier;
+}wapi_reconn_stats_t;
+
+/**
+ * Retry policy of one process (init, authentication, connect), see m0804c_set_backoff. A failed
+ * step, a failed run of the table and a failed process wait min(cap_ms, base_ms * multiplier^n)
+ * for the n-th failure in a row, less up to jitter_pct percent of it at random so devices that
+ * lost the AP together come back spread out. A step with an interval in its table starts from
+ * that interval. Once breaker_fail_max processes failed in a row the circuit breaker opens:
+ * pf_process_err_cb reports each failure and one trial run follows per breaker_open_ms.
+ */
+typedef struct
+{
+    uint32_t base_ms;           /* Wait after the first failed run, 0: runs again at once */
+    uint32_t cap_ms;            /* Bound of every wait */
+    uint8_t multiplier;         /* Growth per failure, 1: constant */
+    uint8_t jitter_pct;         /* 0..100 */
+    uint8_t breaker_fail_max;   /* Failed processes in a row that open the breaker, 0: never opens */
+    uint32_t breaker_open_ms;   /* Open breaker to trial run, 0: until the application starts it again */
+}wapi_backoff_t;
+
+/* One datagram of m0804c_sendto_batch */
+typedef struct
+{
+    const uint8_t *data;
+    uint16_t len;               /* 1..WAPI_NSEND_CHUNK_MAX, WAPI_NSEND_BIN_CHUNK_MAX in binary mode */
+}wapi_dgram_t;
+
+typedef struct m0804c_handler m0804c_handler_t;
+
+/* Completion of one message of m0804c_send_window: WAPI_OK answered "+OK", WAPI_ERR_SEND_NOT_READY
+ * rejected with "[ERR]" or not sent, WAPI_ERR_OTHERS no answer */
+typedef void (*pf_m0804c_sent_t)(m0804c_handler_t *const self, uint8_t socket, void *arg, wapi_status_t status);
+
+/* One message of m0804c_send_window */
+typedef struct
+{
+    const uint8_t *data;
+    uint16_t len;               /* 1..WAPI_NSEND_CHUNK_MAX, WAPI_NSEND_BIN_CHUNK_MAX in binary mode */
+    pf_m0804c_sent_t pf_sent_cb;/* Optional */
+    void *arg;
+}wapi_msg_t;
+
+/* Built-in AT commands (at_func of the command table) */
+typedef enum
+{
+    M0804C_AT_TEST = 0,
+    M0804C_AT_GET_VERSION,
+    M0804C_AT_SET_ECHO,
+    M0804C_AT_SET_BAND,
+    M0804C_AT_REBOOT,
+    M0804C_AT_SET_TX_PWR,
+    M0804C_AT_SET_LOW_PWR,
+    M0804C_AT_DISCONN_TRANS,
+    M0804C_AT_SET_IP,
+    M0804C_AT_CONN_WAPI_BY_CERT,
+    M0804C_AT_CONN_WAPI_BY_PWD,
+    M0804C_AT_CHECK_LINK_LAYER,
+    M0804C_AT_TCP_UDP_CONN,
+    M0804C_AT_RECV_DATA,
+    M0804C_AT_SEND_DATA,
+    M0804C_AT_UPLOAD_CERT_START,
+    M0804C_AT_CHECK_CERT,
+    M0804C_AT_DISCONN_SOCKET,
+}m0804c_at_func_t;
+
+/* Command templates, shared by the command table and the typed encoders of WAPI_M0804C.hpp */
+#define M0804C_AT_TMPL_TEST                 "AT\r\n"
+#define M0804C_AT_TMPL_GET_VERSION          "ATI\r\n"
+#define M0804C_AT_TMPL_SET_ECHO             "AT+ECHO=%d\r\n"
+#define M0804C_AT_TMPL_SET_BAND             "AT+BAND=%d\r\n"
+#define M0804C_AT_TMPL_REBOOT               "AT+REBOOT\r\n"
+#define M0804C_AT_TMPL_SET_TX_PWR           "AT+TXPWR=0,22\r\n"
+#define M0804C_AT_TMPL_SET_LOW_PWR          "AT+SETDP=%d\r\n"
+#define M0804C_AT_TMPL_DISCONN_TRANS        "AT+WSDISCNCT\r\n"
+#define M0804C_AT_TMPL_SET_IP               "AT+WFIXIP=%d,%d.%d.%d.%d,%d.%d.%d.%d,%d.%d.%d.%d\r\n"
+#define M0804C_AT_TMPL_CONN_WAPI_BY_CERT    "AT+WAPICT,%d,%s\r\n"
+#define M0804C_AT_TMPL_CONN_WAPI_BY_PWD     "AT+WAPICT,%d,%s,%s\r\n"
+#define M0804C_AT_TMPL_CHECK_LINK_LAYER     "AT+WAPICT=?\r\n"
+#define M0804C_AT_TMPL_TCP_UDP_CONN         "AT+NCRECLNT=%s,%d.%d.%d.%d,%d,%d,%d,%d,%d,%d,%d\r\n"
+#define M0804C_AT_TMPL_RECV_DATA            "AT+NRECV,%d,%d,%d\r\n"
+#define M0804C_AT_TMPL_SEND_DATA            "AT+NSEND,%d,%d,"
+#define M0804C_AT_TMPL_SEND_DATA_BIN        "AT+NSEND,%d,0,%d,"
+#define M0804C_AT_TMPL_UPLOAD_CERT_START    "AT+UPCERT=%s\r\n"
+#define M0804C_AT_TMPL_CHECK_CERT           "AT+UPCERT=?\r\n"
+#define M0804C_AT_TMPL_DISCONN_SOCKET       "AT+NSTOP,%d\r\n"
+
+/* Unsolicited result codes, "+NRECV,<socket>,<len>,<hex>\r\n" */
+#define M0804C_URC_RECV_DATA                "+NRECV,"
+/* Longest push kept: "+NRECV,", "<socket>,", "<len>,", hex of WAPI_RX_RING_SIZE bytes, "\r\n" */
+#define M0804C_URC_RECV_LINE_MAX            (7 + 2 + 6 + 2 * WAPI_RX_RING_SIZE + 2)
+
 /* ---------------- OSAL interface for M0804C handler ---------------- */
 typedef struct
 {
@@ -104,7 +346,12 @@ typedef struct
     file_att_t asue_file;
 }cert_file_t;
 
-typedef struct m0804c_handler m0804c_handler_t;
+/**
+ * Pull-style payload source of m0804c_send_stream: write the len bytes at offset of the
+ * message to dst, return the bytes written (anything but len aborts the message)
+ */
+typedef uint16_t (*pf_m0804c_produce_t)(struct m0804c_handler *const self, uint32_t offset,
+                                        uint8_t *dst, uint16_t len, void *arg);
 
 typedef struct
 {
@@ -120,18 +367,25 @@ typedef struct
 
 typedef struct
 {
+    /* wapi_work thread */
     void (*pf_process_success_cb)(struct m0804c_handler *const self, wapi_process_type_t process_type);
     void (*pf_process_err_cb)(struct m0804c_handler *const self, wapi_process_type_t process_type);    
+    /* optional, available bytes of socket reached its watermark (wapi_work thread) */
+    void (*pf_rx_notify_cb)(struct m0804c_handler *const self, uint8_t socket, uint16_t available);
 } wapi_callback_t;
 
 typedef struct
 {
-    /* at_cmd_set_table & parse_algo already built-in , so inject NULL */
+    /* at_cmd_set_table & parse_algo already built-in , so inject NULL,
+       timer_wheel and at_os_interface->pf_sema_counting_create are required */
     at_input_arg_t          *at_input_arg;  /* Pointer to AT handler input arguments */
     m0804c_os_interface_t   *os_interface;  /* OSAL interface for M0804C handler */
     m0804c_pwr_ops_t        *pwr_ops;       /* Power control operations */       
     wapi_data_provider_t    *data_provider; /* Data providers (info/cert) */
     wapi_callback_t         *callbacks;     /* Event callbacks */
+#if (UART_PROTO_STATIC_ALLOC)
+    mem_arena_t             *arena;         /* Storage of the whole stack, at least M0804C_STORAGE_SIZE() bytes */
+#endif
 }wapi_m0804c_input_arg_t;
 
 typedef struct m0804c_priv_data m0804c_priv_data_t;
@@ -142,6 +396,37 @@ typedef struct m0804c_handler
     m0804c_priv_data_t       *priv_data;
 }m0804c_handler_t;
 
+#if (UART_PROTO_STATIC_ALLOC)
+/**
+ * Arena bytes of one M0804C instance with its AT handler and UART protocol layer,
+ * rx_buf_size is the DMA ring size. Checked against the private types at compile time.
+ */
+#define M0804C_AT_CMD_NUM               18  /* Entries of the built-in AT command table */
+/* Terms of M0804C_PRIV_SIZE, each bounds the private fields named, padding included */
+/* at_handler, sm and work queues, send_buf_free/probe_lock/api_lock/api_done semaphores */
+#define M0804C_PRIV_HANDLE_SIZE         (7 * sizeof(void *))
+/* Flags, send_buf_socket[], conn mode, reconnect/boot/jitter words, reconn_stats, backoff[] */
+#define M0804C_PRIV_STATE_SIZE          (40 + WAPI_SEND_BUF_NUM + sizeof(wapi_reconn_stats_t) + \
+                                         PROCESS_TYPE_NUM * sizeof(wapi_backoff_t))
+/* wapi_sm_t: table, cert_file and flags, step counters, fail_cnt[], statuses, deadline_timer and retry_timer[] */
+#define M0804C_SM_SIZE                  (3 * sizeof(void *) + 16 + PROCESS_TYPE_NUM + 2 * sizeof(wapi_status_t) + \
+                                         (1 + PROCESS_TYPE_NUM) * (sizeof(wheel_timer_t) + 2 * sizeof(void *)))
+/* wapi_socket_t: param, flags, datagram/window counters, rx_ring indexes, three semaphores, rx_ring */
+#define M0804C_SOCKET_SIZE              (sizeof(wapi_socket_param_t) + 24 + 3 * sizeof(void *) + WAPI_RX_RING_SIZE)
+#if WAPI_TX_COALESCE
+/* tx_kick_sema, tx_delay_ms and flags, tx_queue (indexes, drop_len, bytes) of each socket */
+#define M0804C_TX_PRIV_SIZE             (sizeof(void *) + 8 + WAPI_SOCKET_NUM * (8 + WAPI_TX_QUEUE_SIZE))
+#else
+#define M0804C_TX_PRIV_SIZE             0
+#endif
+#define M0804C_PRIV_SIZE                (M0804C_PRIV_HANDLE_SIZE + M0804C_PRIV_STATE_SIZE + M0804C_SM_SIZE + \
+                                         sizeof(at_cmd_set_table_t) + WAPI_SEND_BUF_NUM * WAPI_SEND_BUF_SIZE + \
+                                         WAPI_SOCKET_NUM * M0804C_SOCKET_SIZE + M0804C_TX_PRIV_SIZE)
+#define M0804C_STORAGE_SIZE(rx_buf_size) \
+    (MEM_ARENA_ALIGN_UP(M0804C_PRIV_SIZE) + MEM_ARENA_ALIGN_UP(sizeof(at_handler_t)) + \
+     AT_STORAGE_SIZE(M0804C_AT_CMD_NUM, rx_buf_size))
+#endif
+
 wapi_status_t m0804c_inst(m0804c_handler_t *const self, wapi_m0804c_input_arg_t *const p_input_args);
 /* call in IDLE ISR */
 void m0804c_at_notify_recv_isr_cb(m0804c_handler_t *const self);
@@ -157,11 +442,69 @@ wapi_status_t m0804c_use_cert_conn(m0804c_handler_t *const self);
 #if IS_USE_CONN_BY_PWD
 wapi_status_t m0804c_use_pwd_conn(m0804c_handler_t *const self);
 #endif
-wapi_status_t m0804c_send(m0804c_handler_t *const self, uint8_t *buf, uint16_t length,\
+/* retry policy of a process (NULL: default), takes effect with its next failure */
+wapi_status_t m0804c_set_backoff(m0804c_handler_t *const self, wapi_process_type_t process_type,
+                                 const wapi_backoff_t *policy);
+/* recoveries of dropped sockets so far and how long they took */
+wapi_status_t m0804c_get_reconn_stats(m0804c_handler_t *const self, wapi_reconn_stats_t *stats);
+/* power on to the first answer of the module at its last boot, 0 before one or without pf_get_tick_ms */
+wapi_status_t m0804c_get_boot_ms(m0804c_handler_t *const self, uint32_t *boot_ms);
+/* add socket to the table (NULL: remove), takes effect the next time the connect process opens it */
+wapi_status_t m0804c_socket_config(m0804c_handler_t *const self, uint8_t socket, const wapi_socket_param_t *param);
+/* true while socket is connected and takes data */
+bool m0804c_socket_is_open(m0804c_handler_t *const self, uint8_t socket);
+/**
+ * recv_parse_cb gets the first module output that follows the "+OK" to the last NSEND, as a
+ * rule the module's debug info. It runs on the wapi_work thread, and its return value is
+ * ignored. That chunk ends the send whatever it holds, no final result code is awaited.
+ * buf holds at most WAPI_WORK_DATA_LEN bytes, and arg carries the chunk length as uintptr_t,
+ * so a value above len means the chunk was truncated. When the work queue is full, that
+ * delivery is dropped, but the send still succeeds.
+ */
+wapi_status_t m0804c_send(m0804c_handler_t *const self, uint8_t socket, uint8_t *buf, uint16_t length,\
                          pf_at_recv_parse_t recv_parse_cb);
-wapi_status_t m0804c_send_without_response(m0804c_handler_t *const self, uint8_t *buf,\
+wapi_status_t m0804c_send_without_response(m0804c_handler_t *const self, uint8_t socket, uint8_t *buf,\
                          uint16_t length);
+/* send length bytes pulled from producer chunk by chunk, recv_parse_cb as above after the last chunk */
+wapi_status_t m0804c_send_stream(m0804c_handler_t *const self, uint8_t socket, uint32_t length,
+                                 pf_m0804c_produce_t producer, void *arg, pf_at_recv_parse_t recv_parse_cb);
+/* send one datagram on a WAPI_SOCKET_UDP socket, whole or not at all */
+wapi_status_t m0804c_sendto(m0804c_handler_t *const self, uint8_t socket, const uint8_t *buf, uint16_t length);
+/* send num datagrams in order, up to WAPI_UDP_BATCH_MAX per AT round trip */
+wapi_status_t m0804c_sendto_batch(m0804c_handler_t *const self, uint8_t socket, const wapi_dgram_t *dgrams,
+                                  uint16_t num);
+#if WAPI_TX_COALESCE
+/* queue length bytes on stream socket without blocking, all or nothing (WAPI_ERR_QUEUE_FULL) */
+wapi_status_t m0804c_send_async(m0804c_handler_t *const self, uint8_t socket, const uint8_t *buf,
+                                uint16_t length);
+/* send what is queued on socket now, without waiting for a full chunk */
+wapi_status_t m0804c_send_flush(m0804c_handler_t *const self, uint8_t socket);
+/* max wait of a partial chunk in ms (all sockets), 0 sends every message at once */
+wapi_status_t m0804c_set_tx_delay(m0804c_handler_t *const self, uint32_t delay_ms);
+/* queued bytes of socket lost so far to a closed socket or a failed send */
+wapi_status_t m0804c_get_tx_dropped(m0804c_handler_t *const self, uint8_t socket, uint32_t *drop_len);
+#endif
+/* send num messages in order, up to WAPI_SEND_WINDOW in flight, pf_sent_cb once per message */
+wapi_status_t m0804c_send_window(m0804c_handler_t *const self, uint8_t socket, const wapi_msg_t *msgs,
+                                 uint16_t num);
+/* select the NSEND payload encoding of socket, takes effect with the next message */
+wapi_status_t m0804c_set_send_mode(m0804c_handler_t *const self, uint8_t socket, wapi_send_mode_t mode);
+/* encoding socket actually uses, WAPI_SEND_MODE_BINARY only once the module has accepted it */
+wapi_send_mode_t m0804c_get_send_mode(m0804c_handler_t *const self, uint8_t socket);
+/* copy up to len received bytes of socket to buf without blocking, *recv_len: bytes copied */
+wapi_status_t m0804c_recv(m0804c_handler_t *const self, uint8_t socket, uint8_t *buf, uint16_t len,
+                          uint16_t *recv_len);
+/* received bytes of socket waiting for m0804c_recv */
+uint16_t m0804c_recv_available(m0804c_handler_t *const self, uint8_t socket);
+/* notify once socket holds watermark bytes (0 or 1: every push), default every push */
+wapi_status_t m0804c_set_rx_watermark(m0804c_handler_t *const self, uint8_t socket, uint16_t watermark);
 wapi_status_t m0804c_cert_upload(m0804c_handler_t *const self);
+/* AT handler of an initialized instance, NULL otherwise (raw/typed AT commands) */
+at_handler_t *m0804c_get_at_handler(m0804c_handler_t *const self);
+#if AT_LATENCY_STATS
+/* print latency statistics of every AT command and transparent send type to RTT */
+void m0804c_lat_report(m0804c_handler_t *const self);
+#endif
 
 /* return true when valid, others invalid */
 bool is_wapi_info_valid(wapi_info_t *const wapi_info);
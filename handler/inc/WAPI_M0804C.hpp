@@ -0,0 +1,67 @@
+/**
+ * @file WAPI_M0804C.hpp
+ * @brief Optional header-only C++17 layer over the M0804C handler
+ *
+ * Typed M0804C commands for at::send(), built from the templates the C command table uses,
+ * so a wrong argument (e.g. &wapi_info->ssid for %s) fails to compile instead of being
+ * formatted at runtime.
+ *
+ *   m0804c::send_cmd<m0804c::cmd::conn_wapi_by_cert>(&handler, 0, wapi_info->ssid);
+ */
+
+#ifndef __WAPI_M0804C_HPP__
+#define __WAPI_M0804C_HPP__
+
+#include "AT_handler.hpp"
+
+extern "C" {
+#include "WAPI_M0804C.h"
+}
+
+namespace m0804c
+{
+
+namespace cmd
+{
+AT_CPP_CMD(test,                M0804C_AT_TEST,                 M0804C_AT_TMPL_TEST);
+AT_CPP_CMD(get_version,         M0804C_AT_GET_VERSION,          M0804C_AT_TMPL_GET_VERSION);
+AT_CPP_CMD(set_echo,            M0804C_AT_SET_ECHO,             M0804C_AT_TMPL_SET_ECHO);
+AT_CPP_CMD(set_band,            M0804C_AT_SET_BAND,             M0804C_AT_TMPL_SET_BAND);
+AT_CPP_CMD(reboot,              M0804C_AT_REBOOT,               M0804C_AT_TMPL_REBOOT);
+AT_CPP_CMD(set_tx_pwr,          M0804C_AT_SET_TX_PWR,           M0804C_AT_TMPL_SET_TX_PWR);
+AT_CPP_CMD(set_low_pwr,         M0804C_AT_SET_LOW_PWR,          M0804C_AT_TMPL_SET_LOW_PWR);
+AT_CPP_CMD(disconn_trans,       M0804C_AT_DISCONN_TRANS,        M0804C_AT_TMPL_DISCONN_TRANS);
+AT_CPP_CMD(set_ip,              M0804C_AT_SET_IP,               M0804C_AT_TMPL_SET_IP);
+AT_CPP_CMD(conn_wapi_by_cert,   M0804C_AT_CONN_WAPI_BY_CERT,    M0804C_AT_TMPL_CONN_WAPI_BY_CERT);
+AT_CPP_CMD(conn_wapi_by_pwd,    M0804C_AT_CONN_WAPI_BY_PWD,     M0804C_AT_TMPL_CONN_WAPI_BY_PWD);
+AT_CPP_CMD(check_link_layer,    M0804C_AT_CHECK_LINK_LAYER,     M0804C_AT_TMPL_CHECK_LINK_LAYER);
+AT_CPP_CMD(tcp_udp_conn,        M0804C_AT_TCP_UDP_CONN,         M0804C_AT_TMPL_TCP_UDP_CONN);
+AT_CPP_CMD(recv_data,           M0804C_AT_RECV_DATA,            M0804C_AT_TMPL_RECV_DATA);
+AT_CPP_CMD(upload_cert_start,   M0804C_AT_UPLOAD_CERT_START,    M0804C_AT_TMPL_UPLOAD_CERT_START);
+AT_CPP_CMD(check_cert,          M0804C_AT_CHECK_CERT,           M0804C_AT_TMPL_CHECK_CERT);
+AT_CPP_CMD(disconn_socket,      M0804C_AT_DISCONN_SOCKET,       M0804C_AT_TMPL_DISCONN_SOCKET);
+} // namespace cmd
+
+/* Typed AT command on the instance's AT handler, AT_ERR_HANDLER_NOT_READY before m0804c_inst */
+template <typename Cmd, typename... Args>
+at_status_t send_cmd(m0804c_handler_t *const self, const Args &... args)
+{
+    at_handler_t *at_handler = m0804c_get_at_handler(self);
+    if (!at_handler)
+        return AT_ERR_HANDLER_NOT_READY;
+    return at::send<Cmd>(at_handler, args...);
+}
+
+/* m0804c_send of a data view */
+inline wapi_status_t send(m0804c_handler_t *const self, uint8_t socket, at::span<const uint8_t> data,
+                          pf_at_recv_parse_t recv_parse_cb)
+{
+    if (data.size() > UINT16_MAX)
+        return WAPI_ERR_PARAM_INVALID;
+    return m0804c_send(self, socket, const_cast<uint8_t *>(data.data()), static_cast<uint16_t>(data.size()),
+                       recv_parse_cb);
+}
+
+} // namespace m0804c
+
+#endif /* __WAPI_M0804C_HPP__ */
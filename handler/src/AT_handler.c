@@ -20,23 +20,39 @@
 #define MALLOC(size)        malloc(size)  
 #define FREE(ptr)           free(ptr)
 
+/* Instance storage: caller arena in static mode, heap otherwise */
+#if (UART_PROTO_STATIC_ALLOC)
+#define INST_ALLOC(self, size)  mem_arena_alloc((self)->at_input_arg->arena, size)
+#define INST_FREE(self, ptr)    ((void)(ptr))   /* Rewound as a whole on init failure */
+#else
+#define INST_ALLOC(self, size)  MALLOC(size)
+#define INST_FREE(self, ptr)    FREE(ptr)
+#endif
+
 #define PRIV_DATA(p) (p)->at_priv_data                /* Private internal data */
 #define UART_INTERFACE(p) (p)->at_input_arg->uart_proto_input_arg->uart_ops /* UART hardware interface */
 #define UP_OS_IF(p) (p)->at_input_arg->uart_proto_input_arg->os_interface       /* Reuse UART proto OS iface for queue/thread */
 #define OS_IF(p) (p)->at_input_arg->at_os_interface               /* AT handler OSAL interface */
 
-#define ACQUIRE_SEND_FEEDBACK_SEMA(self, timeout) \
-            OS_IF(self)->pf_sema_take(PRIV_DATA(self)->send_feedback_sema_handle, timeout) \
+#define ACQUIRE_SEND_CHANNEL(self, lane, timeout) \
+            chan_acquire(self, lane, timeout) \
 
-#define RELEASE_SEND_FEEDBACK_SEMA(self) \
+#define RELEASE_SEND_CHANNEL(self) \
     do { \
-            OS_IF(self)->pf_sema_give(PRIV_DATA(self)->send_feedback_sema_handle); \
-            AT_DEBUG_OUT("line=%d: Released send feedback semaphore", __LINE__); \
+            chan_release(self); \
+            AT_DEBUG_OUT("line=%d: Released send channel", __LINE__); \
     } while(0)
 
+#define WHEEL(p) (p)->at_input_arg->timer_wheel                /* Shared timer wheel, NULL if unused */
+
+/* Response timeout on the shared wheel when one is given, O(1) and no timer task command */
 #define TIMER_START(self, timeout_ms) \
     do { \
-        int32_t ret = OS_IF(self)->pf_timer_start(PRIV_DATA(self)->timeout_timer, timeout_ms); \
+        int32_t ret = 0; \
+        if (WHEEL(self)) \
+            wheel_timer_start(WHEEL(self), &PRIV_DATA(self)->timeout_wheel_timer, timeout_ms); \
+        else \
+            ret = OS_IF(self)->pf_timer_start(PRIV_DATA(self)->timeout_timer, timeout_ms); \
         if (0 == ret) { \
             AT_DEBUG_OUT("line=%d: Timer started with timeout %d ms", __LINE__, timeout_ms); \
         } else { \
@@ -46,7 +62,11 @@
 
 #define TIMER_STOP(self) \
     do { \
-        int32_t ret = OS_IF(self)->pf_timer_stop(PRIV_DATA(self)->timeout_timer, 0); \
+        int32_t ret = 0; \
+        if (WHEEL(self)) \
+            wheel_timer_stop(WHEEL(self), &PRIV_DATA(self)->timeout_wheel_timer); \
+        else \
+            ret = OS_IF(self)->pf_timer_stop(PRIV_DATA(self)->timeout_timer, 0); \
         if (0 == ret) { \
             AT_DEBUG_OUT("line=%d: Timer stopped", __LINE__); \
         } else { \
@@ -54,6 +74,20 @@
         } \
     } while(0)    
 
+#define SEND_BUF_NONE       0xFF    /* No send buffer attached to the transmission */
+#define LANE_NONE           0xFF    /* No outstanding channel grant */
+#define LAT_SLOT_NONE       0xFF    /* Transaction not tracked by latency statistics */
+
+#define TXN_OF(self, seq)   (&PRIV_DATA(self)->txn[(seq) & (AT_TXN_NUM - 1)])
+
+#if (AT_TXN_NUM < 2) || (AT_TXN_NUM & (AT_TXN_NUM - 1))
+#error "AT_TXN_NUM must be a power of 2 and >= 2"
+#endif
+
+#if (AT_SEND_BUF_NUM < 1) || (AT_SEND_BUF_NUM > 8)
+#error "AT_SEND_BUF_NUM must be in range 1..8"
+#endif
+
 /* Private Type Definitions -------------------------------------------------*/
 
 typedef enum
@@ -84,19 +118,97 @@ typedef struct
     }u;
 } send_info_t;
 
+/**
+ * Transaction states. The state and the sequence ID share one word (at_txn_t.tag)
+ * so a single compare-and-swap decides which of TX complete ISR, parse thread and
+ * timeout timer owns a transition.
+ */
+typedef enum
+{
+    TXN_FREE = 0,
+    TXN_SENDING,        /* On the wire, TX complete pending */
+    TXN_SENT,           /* Waiting for the first response */
+    TXN_ACKED,          /* Part of the expected responses received */
+    TXN_DONE,
+    TXN_TIMEOUT
+} txn_state_t;
+
+#define TXN_TAG(seq, state)     (((uint32_t)(seq) << 8) | (uint32_t)(state))
+#define TXN_SEQ(tag)            ((uint16_t)((tag) >> 8))
+#define TXN_STATE(tag)          ((txn_state_t)((tag) & 0xFF))
+#define TXN_BIT(state)          (1UL << (state))
+#define TXN_WAIT_RSP_MASK       (TXN_BIT(TXN_SENT) | TXN_BIT(TXN_ACKED))
+#define TXN_PENDING_MASK        (TXN_BIT(TXN_SENDING) | TXN_WAIT_RSP_MASK)
+
+typedef struct
+{
+    volatile uint32_t tag;              /* seq << 8 | state, transitions through txn_cas() */
+    send_info_t send_info;
+    volatile uint8_t remain_receive_count;
+    uint8_t skip_count;                 /* Chunks rejected with AT_ERR_RECV_NOT_MATCH since the last progress */
+} at_txn_t;
+
+
+#if AT_LATENCY_STATS
+typedef struct
+{
+    at_lat_stats_t stats;
+    bool is_last_timeout;               /* Previous transaction of this slot expired */
+} lat_slot_t;
+#endif
 
 typedef struct at_priv_data
 {
     bool is_inited; /* Initialization flag: true = handler ready, false = uninitialized */
-    uint8_t remain_receive_count;
-    send_info_t send_info;
+    bool is_expect_response;            /* false: release send semaphore on TX complete */
+    at_txn_t txn[AT_TXN_NUM];           /* Transactions indexed by sequence ID */
+    uint16_t next_seq;
+    volatile uint16_t cur_seq;          /* Transaction owning the send channel */
+    volatile uint16_t timer_seq;        /* Transaction guarded by timeout_timer */
     uart_proto_t *uart_proto_handle;
-    void *send_feedback_sema_handle;
-    void *send_queue_handle;
+    void *lane_sema_handle[AT_LANE_NUM];        /* Grant signal of each lane */
+    volatile uint8_t lane_waiting[AT_LANE_NUM]; /* Senders queued on each lane */
+    volatile uint8_t grant_lane;        /* Lane the channel was handed to, not yet claimed */
+    volatile bool is_chan_busy;         /* Channel owned by a transaction */
+    uint8_t ctrl_streak;                /* Consecutive control grants while data waits */
     void *timeout_timer;  
-    uint8_t send_buf[AT_SEND_LEN_MAX];     
+    wheel_timer_t timeout_wheel_timer;  /* Used instead of timeout_timer with a shared wheel */
+    volatile uint8_t tx_seg_num;        /* DMA transfers of the current send */
+    volatile uint8_t tx_seg_idx;        /* DMA transfer currently on the wire */
+    volatile bool is_tx_orphaned;       /* Send state reset during the transfer, its TX complete frees the channel */
+    at_trans_seg_t tx_seg[AT_TRANS_SEG_MAX];
+    volatile uint8_t send_buf_busy;     /* Bit n set: send_buf[n] owned by a sender or by DMA */
+    void *send_buf_free_sema;           /* Counts clear bits of send_buf_busy, NULL: no waiting */
+    uint8_t tx_buf_idx;                 /* Send buffer handed to pf_uart_write, SEND_BUF_NONE if none */
+    uint8_t send_buf[AT_SEND_BUF_NUM][AT_SEND_LEN_MAX];     
+#if AT_LINE_REASSEMBLY
+    volatile bool is_line_reset_req;    /* Drop partial line on next chunk (set on RX/send state reset) */
+    bool is_line_discard;               /* Skipping the rest of a URC line longer than line_buf */
+    volatile uint16_t rx_block_remain;  /* Bytes left of a length-delimited response block */
+    uint16_t line_len;                  /* Bytes held in line_buf */
+    uint8_t line_buf[AT_LINE_BUF_LEN];  /* Partial line / block carried across IDLE chunks */
+#endif
+    uint16_t collect_seq;               /* Transaction the collected lines belong to */
+    uint16_t collect_len;               /* Bytes held in collect_buf */
+    uint16_t collect_line;              /* Start of the line in progress */
+    uint8_t collect_buf[AT_COLLECT_BUF_LEN];
+#if AT_LATENCY_STATS
+    lat_slot_t *lat_slot_tab;           /* table_len command slots, then AT_LAT_TRANS_TYPE_NUM type slots */
+    uint8_t lat_slot_num;
+    volatile uint8_t lat_slot;          /* Slot of the transaction in flight, LAT_SLOT_NONE if untracked */
+    bool is_lat_first_rsp;              /* First response of the transaction still pending */
+    uint32_t lat_send_tick;
+    volatile uint32_t lat_tx_done_tick;
+#endif
 } at_priv_data_t;
 
+#if (UART_PROTO_STATIC_ALLOC)
+MEM_ARENA_SIZE_CHECK(sizeof(at_priv_data_t) <= AT_PRIV_SIZE, at_priv);
+#if AT_LATENCY_STATS
+MEM_ARENA_SIZE_CHECK(sizeof(lat_slot_t) <= AT_LAT_SLOT_SIZE, at_lat_slot);
+#endif
+#endif
+
 typedef struct
 {
     uint8_t *payload;     /* Pointer to the frame payload data */
@@ -106,6 +218,338 @@ typedef struct
 
 /* Private Function Implementations ------------------------------------------*/
 
+/**
+ * @brief Acquire the send channel on a priority lane
+ *
+ * Takes the channel at once when it is idle, otherwise queues on the lane until the
+ * current owner hands it over. At most one grant is outstanding (the channel is exclusive),
+ * a grant racing with a waiter timeout is claimed by that waiter and the late semaphore
+ * give is absorbed by the next waiter of the lane as a spurious wake-up. That waiter goes
+ * on for the time left of its timeout (the whole timeout again without pf_get_tick_ms).
+ * @return 0 when the channel is owned, others timeout
+ */
+static int32_t chan_acquire(at_handler_t *const self, at_lane_t lane, uint32_t timeout)
+{
+    at_priv_data_t *priv = PRIV_DATA(self);
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    if (!priv->is_chan_busy)
+    {
+        priv->is_chan_busy = true;
+        UP_OS_IF(self)->pf_os_exit_critical(primask);
+        return 0;
+    }
+    priv->lane_waiting[lane]++;
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+
+    bool is_deadline = (OS_DELAY_MAX != timeout) && OS_IF(self)->pf_get_tick_ms;
+    uint32_t start_ms = is_deadline ? OS_IF(self)->pf_get_tick_ms() : 0;
+    uint32_t wait = timeout;
+    while (1)
+    {
+        int32_t ret = OS_IF(self)->pf_sema_take(priv->lane_sema_handle[lane], wait);
+        primask = UP_OS_IF(self)->pf_os_enter_critical();
+        if (priv->grant_lane == lane)
+        {
+            /* Grant for this lane, claimed by us (also when it raced with our timeout) */
+            priv->grant_lane = LANE_NONE;
+            UP_OS_IF(self)->pf_os_exit_critical(primask);
+            return 0;
+        }
+        if (0 != ret)
+        {
+            priv->lane_waiting[lane]--;
+            UP_OS_IF(self)->pf_os_exit_critical(primask);
+            return ret;
+        }
+        /* Stale give of a grant claimed by a timed-out peer, keep waiting for the time left */
+        UP_OS_IF(self)->pf_os_exit_critical(primask);
+        if (is_deadline)
+        {
+            uint32_t elapsed = OS_IF(self)->pf_get_tick_ms() - start_ms;
+            wait = (elapsed < timeout) ? timeout - elapsed : 0;
+        }
+    }
+}
+
+/**
+ * @brief Release the send channel, hand it to the next lane by priority
+ *
+ * Control lane goes first, unless it has been served AT_LANE_STARVATION_MAX times
+ * in a row while data was waiting. Safe in thread, timer and ISR context.
+ */
+static void chan_release(at_handler_t *const self)
+{
+    at_priv_data_t *priv = PRIV_DATA(self);
+    uint8_t lane = LANE_NONE;
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    if (!priv->is_chan_busy || LANE_NONE != priv->grant_lane)
+    {
+        /* Already idle or already handed over, ignore duplicate release */
+        UP_OS_IF(self)->pf_os_exit_critical(primask);
+        return;
+    }
+    if (priv->lane_waiting[AT_LANE_CTRL] &&
+        (!priv->lane_waiting[AT_LANE_DATA] || priv->ctrl_streak < AT_LANE_STARVATION_MAX))
+    {
+        lane = AT_LANE_CTRL;
+        priv->ctrl_streak = priv->lane_waiting[AT_LANE_DATA] ? priv->ctrl_streak + 1 : 0;
+    }
+    else if (priv->lane_waiting[AT_LANE_DATA])
+    {
+        lane = AT_LANE_DATA;
+        priv->ctrl_streak = 0;
+    }
+
+    if (LANE_NONE == lane)
+    {
+        priv->is_chan_busy = false;
+    }
+    else
+    {
+        /* Ownership passes directly, channel stays busy */
+        priv->lane_waiting[lane]--;
+        priv->grant_lane = lane;
+    }
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+
+    if (LANE_NONE != lane)
+        OS_IF(self)->pf_sema_give(priv->lane_sema_handle[lane]);
+}
+
+/**
+ * @brief Compare-and-swap the state of transaction seq
+ *
+ * Succeeds only while the entry still belongs to seq and is in one of the states of
+ * expect_mask, so a late ISR, parser or timer cannot touch a newer transaction.
+ * The swap is done in the OSAL critical section, which also covers cores without
+ * exclusive load/store.
+ * @return true if this caller made the transition
+ */
+static bool txn_cas(at_handler_t *const self, uint16_t seq, uint32_t expect_mask, txn_state_t new_state)
+{
+    at_txn_t *txn = TXN_OF(self, seq);
+    bool is_swapped = false;
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    uint32_t tag = txn->tag;
+    if (TXN_SEQ(tag) == seq && (expect_mask & TXN_BIT(TXN_STATE(tag))))
+    {
+        txn->tag = TXN_TAG(seq, new_state);
+        is_swapped = true;
+    }
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+    return is_swapped;
+}
+
+/**
+ * @brief Open a transaction, called with the send channel owned and before transmission
+ *
+ * The entry is not reachable through cur_seq yet, plain stores are enough.
+ */
+static void txn_begin(at_handler_t *const self, const send_info_t *send_info, uint8_t receive_count)
+{
+    uint16_t seq = ++PRIV_DATA(self)->next_seq;
+    at_txn_t *txn = TXN_OF(self, seq);
+    txn->send_info = *send_info;
+    txn->remain_receive_count = receive_count;
+    txn->skip_count = 0;
+    txn->tag = TXN_TAG(seq, TXN_SENDING);
+    PRIV_DATA(self)->cur_seq = seq;
+}
+
+/**
+ * @brief Take a free send buffer out of the rotation
+ *
+ * The owner formats into it without holding the send semaphore, so the next command
+ * is encoded while the previous one is still on the wire. With a counting semaphore the
+ * caller waits up to timeout for one to come back from DMA.
+ * @return Buffer index, SEND_BUF_NONE if all buffers stay in use
+ */
+static uint8_t send_buf_acquire(at_handler_t *const self, uint32_t timeout)
+{
+    uint8_t idx = SEND_BUF_NONE;
+    /* A count taken guarantees a clear bit, release clears it before giving */
+    if (PRIV_DATA(self)->send_buf_free_sema &&
+        0 != OS_IF(self)->pf_sema_take(PRIV_DATA(self)->send_buf_free_sema, timeout))
+        return SEND_BUF_NONE;
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    for (uint8_t i = 0; i < AT_SEND_BUF_NUM; i++)
+    {
+        if (!(PRIV_DATA(self)->send_buf_busy & (1U << i)))
+        {
+            PRIV_DATA(self)->send_buf_busy |= (1U << i);
+            idx = i;
+            break;
+        }
+    }
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+    return idx;
+}
+
+/**
+ * @brief Return a send buffer to the rotation (thread or TX complete ISR)
+ */
+static void send_buf_release(at_handler_t *const self, uint8_t idx)
+{
+    if (idx >= AT_SEND_BUF_NUM)
+        return;
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    PRIV_DATA(self)->send_buf_busy &= ~(1U << idx);
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+    if (PRIV_DATA(self)->send_buf_free_sema)
+        OS_IF(self)->pf_sema_give(PRIV_DATA(self)->send_buf_free_sema);
+}
+
+/**
+ * @brief Release borrowed segments of the current send and clear the DMA chain
+ *
+ * Called from TX complete ISR when the last segment has been transmitted, the only point
+ * where DMA is known to be done with them. The chain is taken in a critical section against
+ * at_reset_send_state, so each send is released once.
+ * @return true if the send state was reset while the transfer ran
+ */
+static bool release_tx_segs(at_handler_t *const self)
+{
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    uint8_t seg_num = PRIV_DATA(self)->tx_seg_num;
+    bool is_orphaned = PRIV_DATA(self)->is_tx_orphaned;
+    PRIV_DATA(self)->tx_seg_num = 0;
+    PRIV_DATA(self)->tx_seg_idx = 0;
+    PRIV_DATA(self)->is_tx_orphaned = false;
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+    /* Ownership of the send buffer returns from DMA */
+    send_buf_release(self, PRIV_DATA(self)->tx_buf_idx);
+    PRIV_DATA(self)->tx_buf_idx = SEND_BUF_NONE;
+    for (uint8_t i = 0; i < seg_num; i++)
+    {
+        at_trans_seg_t *seg = &PRIV_DATA(self)->tx_seg[i];
+        if (AT_SEG_BORROWED == seg->owner && seg->pf_release)
+            seg->pf_release(seg->data, seg->release_arg);
+    }
+    return is_orphaned;
+}
+
+#if AT_LATENCY_STATS
+#define LAT_TICK(self)      OS_IF(self)->pf_get_tick_ms()
+
+static uint8_t lat_bucket(uint32_t ms)
+{
+    uint8_t bucket = 0;
+    while (ms && bucket < AT_LAT_BUCKET_NUM - 1)
+    {
+        ms >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void lat_hist_add(at_lat_hist_t *hist, uint32_t ms)
+{
+    uint8_t bucket = lat_bucket(ms);
+    if (hist->bucket[bucket] < 0xFFFF)
+        hist->bucket[bucket]++;
+    hist->sum_ms = (hist->sum_ms > UINT32_MAX - ms) ? UINT32_MAX : hist->sum_ms + ms;
+    if (ms > hist->max_ms)
+        hist->max_ms = ms;
+}
+
+/**
+ * @brief Start measuring a transaction, called with the send channel owned
+ *
+ * The measurement runs in the sender, TX complete ISR, parse thread and timer in turn,
+ * never concurrently, as the channel serializes transactions. Each step updates the
+ * counters and histograms of its slot in the critical section, so at_lat_snapshot never
+ * sees a transaction counted in one field but not yet in the other.
+ */
+static void lat_begin(at_handler_t *const self, uint8_t slot)
+{
+    at_priv_data_t *priv = PRIV_DATA(self);
+    priv->lat_slot = LAT_SLOT_NONE;
+    if (!priv->lat_slot_tab || slot >= priv->lat_slot_num)
+        return;
+
+    lat_slot_t *lat = &priv->lat_slot_tab[slot];
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    lat->stats.send_cnt++;
+    if (lat->is_last_timeout)
+    {
+        lat->stats.retry_cnt++;
+        lat->is_last_timeout = false;
+    }
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+    priv->lat_send_tick = LAT_TICK(self);
+    priv->is_lat_first_rsp = true;
+    priv->lat_slot = slot;
+}
+
+/* last DMA transfer done, a send without response completes here */
+static void lat_tx_done(at_handler_t *const self)
+{
+    at_priv_data_t *priv = PRIV_DATA(self);
+    if (LAT_SLOT_NONE == priv->lat_slot)
+        return;
+
+    at_lat_stats_t *stats = &priv->lat_slot_tab[priv->lat_slot].stats;
+    priv->lat_tx_done_tick = LAT_TICK(self);
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    lat_hist_add(&stats->hist[AT_LAT_TX_DONE], priv->lat_tx_done_tick - priv->lat_send_tick);
+    if (!priv->is_expect_response)
+    {
+        lat_hist_add(&stats->hist[AT_LAT_COMPLETE], priv->lat_tx_done_tick - priv->lat_send_tick);
+        stats->done_cnt++;
+        priv->lat_slot = LAT_SLOT_NONE;
+    }
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+}
+
+static void lat_response(at_handler_t *const self, bool is_done)
+{
+    at_priv_data_t *priv = PRIV_DATA(self);
+    if (LAT_SLOT_NONE == priv->lat_slot)
+        return;
+
+    at_lat_stats_t *stats = &priv->lat_slot_tab[priv->lat_slot].stats;
+    uint32_t now = LAT_TICK(self);
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    if (priv->is_lat_first_rsp)
+    {
+        priv->is_lat_first_rsp = false;
+        lat_hist_add(&stats->hist[AT_LAT_FIRST_RSP], now - priv->lat_tx_done_tick);
+    }
+    if (is_done)
+    {
+        lat_hist_add(&stats->hist[AT_LAT_COMPLETE], now - priv->lat_send_tick);
+        stats->done_cnt++;
+        priv->lat_slot = LAT_SLOT_NONE;
+    }
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+}
+
+static void lat_timeout(at_handler_t *const self)
+{
+    at_priv_data_t *priv = PRIV_DATA(self);
+    if (LAT_SLOT_NONE == priv->lat_slot)
+        return;
+
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    priv->lat_slot_tab[priv->lat_slot].stats.timeout_cnt++;
+    priv->lat_slot_tab[priv->lat_slot].is_last_timeout = true;
+    priv->lat_slot = LAT_SLOT_NONE;
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+}
+
+#define LAT_BEGIN(self, slot)           lat_begin(self, slot)
+#define LAT_TX_DONE(self)               lat_tx_done(self)
+#define LAT_RESPONSE(self, is_done)     lat_response(self, is_done)
+#define LAT_TIMEOUT(self)               lat_timeout(self)
+#define LAT_CANCEL(self)                (PRIV_DATA(self)->lat_slot = LAT_SLOT_NONE)
+#else
+#define LAT_BEGIN(self, slot)           ((void)0)
+#define LAT_TX_DONE(self)               ((void)0)
+#define LAT_RESPONSE(self, is_done)     ((void)0)
+#define LAT_TIMEOUT(self)               ((void)0)
+#define LAT_CANCEL(self)                ((void)0)
+#endif
+
 /**
  * @brief Count the number of %s/%d placeholders in a string
  *
@@ -164,23 +608,17 @@ static uint8_t count_va_args(uint8_t max_cnt, va_list args)
     return cnt;
 }
 
-at_status_t at_cmd_send_impl(at_handler_t *const self, uint32_t at_func, ...)
+at_status_t at_cmd_prepare(at_handler_t *const self, uint32_t at_func, at_cmd_frame_t *const frame)
 {
-    va_list args;
-    const at_cmd_set_t *cmd_entry = NULL;         /* Pointer to matched command table entry */
-    volatile uint8_t expected_param_count = 0;         /* Expected args (from placeholder count) */
-    volatile uint8_t actual_param_count = 0;           /* Actual args (from variadic list) */
-
-    /* Basic input validation */
-    if (!self)
+    if (!self || !frame)
         return AT_ERR_PARAM_INVALID;
-    if(!PRIV_DATA(self)->is_inited)
+    if(!PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return AT_ERR_HANDLER_NOT_READY;
-            
+
     /* Look up AT command template in command table */
     at_cmd_set_table_t *cmd_table = self->at_input_arg->at_cmd_set_table;
-    uint8_t table_length = self->at_input_arg->at_cmd_set_table->table_len;
-    for (uint8_t i = 0; i < table_length; i++)
+    const at_cmd_set_t *cmd_entry = NULL;
+    for (uint8_t i = 0; i < cmd_table->table_len; i++)
     {
         if (cmd_table->table[i].at_func == at_func)
         {
@@ -189,11 +627,88 @@ at_status_t at_cmd_send_impl(at_handler_t *const self, uint32_t at_func, ...)
         }
     }
     if (cmd_entry == NULL)  /* Command ID not found in table */
-    {
         return AT_ERR_CMD_NOT_FOUND;
+
+    /* Encode into a free send buffer while the previous command may still be on the wire */
+    uint8_t buf_idx = send_buf_acquire(self, AT_CHAN_WAIT_TICK);
+    if (SEND_BUF_NONE == buf_idx)
+    {
+        AT_DEBUG_ERR("No free send buffer, previous commands still pending");
+        return AT_ERR_NOT_CONSUMED;
     }
+    frame->buf = PRIV_DATA(self)->send_buf[buf_idx];
+    frame->cap = AT_SEND_LEN_MAX;
+    frame->buf_idx = buf_idx;
+    frame->cmd_entry = cmd_entry;
+    return AT_OK;
+}
+
+void at_cmd_abort(at_handler_t *const self, at_cmd_frame_t *const frame)
+{
+    if (!self || !frame || !frame->buf)
+        return;
+    send_buf_release(self, frame->buf_idx);
+    frame->buf = NULL;
+}
+
+at_status_t at_cmd_commit(at_handler_t *const self, at_cmd_frame_t *const frame, uint16_t len)
+{
+    if (!self || !frame || !frame->buf)
+        return AT_ERR_PARAM_INVALID;
+    if (!len || len > frame->cap)
+    {
+        at_cmd_abort(self, frame);
+        return AT_ERR_PARAM_INVALID;
+    }
+    const at_cmd_set_t *cmd_entry = frame->cmd_entry;
+    uint8_t buf_idx = frame->buf_idx;
+    uint8_t *send_buf = frame->buf;
+
+    if(0 != ACQUIRE_SEND_CHANNEL(self, AT_LANE_CTRL, AT_CHAN_WAIT_TICK))
+    {
+        at_cmd_abort(self, frame);
+        AT_DEBUG_ERR("Previous AT command not consumed, send channel unavailable");
+        return AT_ERR_NOT_CONSUMED;
+    }      
+    frame->buf = NULL;  /* Buffer ownership passes to the transaction */
+        
+    send_info_t send_info = { .at_send_type = SEND_CMD, .u.cmd_event.cmd_entry = cmd_entry };
+    txn_begin(self, &send_info, cmd_entry->receive_count);
+    PRIV_DATA(self)->is_expect_response = true;
+    AT_DEBUG_OUT("Send remaining receive count: %u", cmd_entry->receive_count);
+
+    /* Single copied segment, the chain is finished by the first TX complete */
+    PRIV_DATA(self)->tx_seg[0] = (at_trans_seg_t){ .data = send_buf,
+                                                   .len = len,
+                                                   .owner = AT_SEG_COPY };
+    PRIV_DATA(self)->tx_seg_idx = 0;
+    PRIV_DATA(self)->tx_buf_idx = buf_idx;  /* Buffer ownership passes to DMA */
+    PRIV_DATA(self)->tx_seg_num = 1;
+
+    LAT_BEGIN(self, (uint8_t)(cmd_entry - self->at_input_arg->at_cmd_set_table->table));
+
+    /* Transmit encoded command via UART (hardware-agnostic callback) */
+    PRIV_DATA(self)->timer_seq = PRIV_DATA(self)->cur_seq;
+    uart_proto_write(PRIV_DATA(self)->uart_proto_handle, send_buf, len);
+
+    TIMER_START(self, AT_TIMEOUT_TICK);
+
+    return AT_OK;
+}
+
+at_status_t at_cmd_send_impl(at_handler_t *const self, uint32_t at_func, ...)
+{
+    va_list args;
+    at_cmd_frame_t frame;
+    volatile uint8_t expected_param_count = 0;         /* Expected args (from placeholder count) */
+    volatile uint8_t actual_param_count = 0;           /* Actual args (from variadic list) */
+
+    at_status_t status = at_cmd_prepare(self, at_func, &frame);
+    if (AT_OK != status)
+        return status;
+
     /* Get expected parameter count from command template placeholders */
-    expected_param_count = count_placeholder(cmd_entry->send);
+    expected_param_count = count_placeholder(frame.cmd_entry->send);
 
     /* Validate variadic argument count matches expected count */
     va_start(args, at_func);
@@ -202,59 +717,107 @@ at_status_t at_cmd_send_impl(at_handler_t *const self, uint32_t at_func, ...)
 
     if (actual_param_count != expected_param_count)
     {
+        at_cmd_abort(self, &frame);
         AT_DEBUG_ERR("AT command parameter count mismatch: expected=%u, actual=%u", expected_param_count, actual_param_count);
         return AT_ERR_PARAM_INVALID;  /* Mismatch between expected/actual arguments */
     }
+
     /* Format AT command string with variadic arguments */
     va_start(args, at_func);
-
-    int send_len = vsnprintf((char*)PRIV_DATA(self)->send_buf, AT_SEND_LEN_MAX, cmd_entry->send, args);
+    int send_len = vsnprintf((char*)frame.buf, frame.cap, frame.cmd_entry->send, args);
     va_end(args);
     
     /* Check for formatting errors or buffer overflow */
-    if (send_len < 0 || send_len >= (AT_SEND_LEN_MAX))
+    if (send_len < 0 || send_len >= (int)frame.cap)
     {
+        at_cmd_abort(self, &frame);
         return AT_ERR_OTHERS;
     } 
-
-    if(0 != ACQUIRE_SEND_FEEDBACK_SEMA(self, 0))
-    {
-        AT_DEBUG_ERR("Previous AT command not consumed, send feedback semaphore unavailable");
-        return AT_ERR_NOT_CONSUMED;
-    }      
-        
-    PRIV_DATA(self)->send_info.at_send_type = SEND_CMD;
-    PRIV_DATA(self)->send_info.u.cmd_event.cmd_entry = cmd_entry;
-    PRIV_DATA(self)->remain_receive_count = cmd_entry->receive_count;
-    AT_DEBUG_OUT("Send remaining receive count: %u", PRIV_DATA(self)->remain_receive_count);
-
-    /* Transmit formatted command via UART (hardware-agnostic callback) */
-    UART_INTERFACE(self)->pf_uart_write(PRIV_DATA(self)->send_buf, strlen((char*)PRIV_DATA(self)->send_buf));
-
-    TIMER_START(self, AT_TIMEOUT_TICK);
-
-    return AT_OK;
+    return at_cmd_commit(self, &frame, (uint16_t)send_len);
 }
 
 at_status_t at_trans_send(at_handler_t *const self, uint8_t *const data, uint16_t len, 
                           const at_trans_callback_t *callback)
+{
+    at_trans_seg_t seg = {
+        .data = data,
+        .len = len,
+#if IS_ENABLE_SEND_BUF_PROTECTED
+        .owner = AT_SEG_COPY,
+#else
+        .owner = AT_SEG_BORROWED,
+#endif
+        .pf_release = NULL,
+        .release_arg = NULL
+    };
+    return at_trans_sendv(self, &seg, 1, callback);
+}
+
+at_status_t at_trans_sendv(at_handler_t *const self, const at_trans_seg_t *segs, uint8_t seg_num,
+                           const at_trans_callback_t *callback)
 {
     if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return AT_ERR_HANDLER_NOT_READY;
 
-    if(0 != ACQUIRE_SEND_FEEDBACK_SEMA(self, 0))
+    if (!segs || !seg_num || seg_num > AT_TRANS_SEG_MAX)
+        return AT_ERR_PARAM_INVALID;
+
+    /* Copy-required segments must fit in the protected send buffer */
+    uint16_t copy_len = 0;
+    for (uint8_t i = 0; i < seg_num; i++)
+    {
+        if (!segs[i].data || !segs[i].len)
+            return AT_ERR_PARAM_INVALID;
+        if (AT_SEG_COPY == segs[i].owner)
+            copy_len += segs[i].len;
+    }
+    if (copy_len > AT_SEND_LEN_MAX)
+    {
+        AT_DEBUG_ERR("Transparent copy length overflow: %u > max=%u", copy_len, AT_SEND_LEN_MAX);
+        return AT_ERR_PARAM_INVALID;
+    }
+
+    /* Pack copy-required segments into a free send buffer before waiting for the channel */
+    uint8_t buf_idx = SEND_BUF_NONE;
+    uint8_t *send_buf = NULL;
+    if (copy_len)
     {
-        AT_DEBUG_ERR("Previous transparent data not consumed, send feedback semaphore unavailable");
+        buf_idx = send_buf_acquire(self, AT_CHAN_WAIT_TICK);
+        if (SEND_BUF_NONE == buf_idx)
+        {
+            AT_DEBUG_ERR("No free send buffer, previous transparent data still pending");
+            return AT_ERR_NOT_CONSUMED;
+        }
+        send_buf = PRIV_DATA(self)->send_buf[buf_idx];
+        uint16_t buf_pos = 0;
+        for (uint8_t i = 0; i < seg_num; i++)
+        {
+            if (AT_SEG_COPY != segs[i].owner)
+                continue;
+            memcpy(send_buf + buf_pos, segs[i].data, segs[i].len);
+            buf_pos += segs[i].len;
+        }
+    }
+
+    at_lane_t lane = (callback && callback->lane < AT_LANE_NUM) ? callback->lane : AT_LANE_DATA;
+    if(0 != ACQUIRE_SEND_CHANNEL(self, lane, AT_CHAN_WAIT_TICK))
+    {
+        send_buf_release(self, buf_idx);
+        AT_DEBUG_ERR("Previous transparent data not consumed, send channel unavailable");
         return AT_ERR_NOT_CONSUMED;
     }
     
+    PRIV_DATA(self)->is_expect_response = false;
+    send_info_t send_info = { .at_send_type = SEND_TRANSPARENT };
+    uint8_t recv_count = 0;
     /* Send with response - setup transparent event */
     if(callback && callback->pf_at_recv_parse[0])
     {
-        uint8_t recv_count = callback->receive_count ? callback->receive_count : 1;
+        recv_count = callback->receive_count ? callback->receive_count : 1;
         if (recv_count > MAX_RECV_CNT_OF_TRANS_SEND)
         {
-            RELEASE_SEND_FEEDBACK_SEMA(self);
+            send_buf_release(self, buf_idx);
+            RELEASE_SEND_CHANNEL(self);
             AT_DEBUG_ERR("Transparent receive_count overflow: %u > max=%u", recv_count, MAX_RECV_CNT_OF_TRANS_SEND);
             return AT_ERR_PARAM_INVALID;
         }
@@ -264,36 +827,147 @@ at_status_t at_trans_send(at_handler_t *const self, uint8_t *const data, uint16_
         {
             if (!callback->pf_at_recv_parse[i])
             {
-                RELEASE_SEND_FEEDBACK_SEMA(self);
+                send_buf_release(self, buf_idx);
+                RELEASE_SEND_CHANNEL(self);
                 AT_DEBUG_ERR("Transparent callback is NULL at index %u", i);
                 return AT_ERR_PARAM_INVALID;
             }
         }
         
-        PRIV_DATA(self)->send_info.at_send_type = SEND_TRANSPARENT;
-        PRIV_DATA(self)->send_info.u.transparent_event.callback = *callback;
-        PRIV_DATA(self)->remain_receive_count = recv_count;
+        send_info.u.transparent_event.callback = *callback;
+        send_info.u.transparent_event.callback.receive_count = recv_count;
+        PRIV_DATA(self)->is_expect_response = true;
+#if AT_LINE_REASSEMBLY
+        PRIV_DATA(self)->rx_block_remain = callback->rx_block_len;
+#endif
     }
     
-    /* Prepare data transmission */
-#if IS_ENABLE_SEND_BUF_PROTECTED
-    memcpy(PRIV_DATA(self)->send_buf, data, len);
-    UART_INTERFACE(self)->pf_uart_write(PRIV_DATA(self)->send_buf, len);
-#else
-    UART_INTERFACE(self)->pf_uart_write(data, len);
-#endif
-
-    /* Send without response */
-    if(!callback || !callback->pf_at_recv_parse[0])
+    /**
+     * Build the DMA chain: adjacent copy segments were packed into send_buf
+     * and go out as one transfer, borrowed segments are sent in place.
+     */
+    uint8_t tx_num = 0;
+    uint16_t buf_pos = 0;
+    for (uint8_t i = 0; i < seg_num; i++)
     {
-        RELEASE_SEND_FEEDBACK_SEMA(self);
+        at_trans_seg_t *tx = &PRIV_DATA(self)->tx_seg[tx_num];
+        if (AT_SEG_BORROWED == segs[i].owner)
+        {
+            *tx = segs[i];
+            tx_num++;
+            continue;
+        }
+        if (tx_num && AT_SEG_COPY == PRIV_DATA(self)->tx_seg[tx_num - 1].owner)
+        {
+            PRIV_DATA(self)->tx_seg[tx_num - 1].len += segs[i].len;
+        }
+        else
+        {
+            *tx = (at_trans_seg_t){ .data = send_buf + buf_pos,
+                                    .len = segs[i].len,
+                                    .owner = AT_SEG_COPY };
+            tx_num++;
+        }
+        buf_pos += segs[i].len;
+    }
+    PRIV_DATA(self)->tx_seg_idx = 0;
+    PRIV_DATA(self)->tx_buf_idx = buf_idx;  /* Buffer ownership passes to DMA */
+    PRIV_DATA(self)->tx_seg_num = tx_num;
+    txn_begin(self, &send_info, recv_count);
+    PRIV_DATA(self)->timer_seq = PRIV_DATA(self)->cur_seq;
+
+    uint8_t trans_type = callback ? callback->trans_type : 0;
+    LAT_BEGIN(self, (trans_type < AT_LAT_TRANS_TYPE_NUM) ?
+                    (uint8_t)(self->at_input_arg->at_cmd_set_table->table_len + trans_type) : LAT_SLOT_NONE);
+
+    /* Start the first transfer, the rest are chained from TX complete ISR */
+    uart_proto_write(PRIV_DATA(self)->uart_proto_handle, (uint8_t *)PRIV_DATA(self)->tx_seg[0].data,
+                     PRIV_DATA(self)->tx_seg[0].len);
+
+    /* Send without response, semaphore is released on TX complete */
+    if(!PRIV_DATA(self)->is_expect_response)
         return AT_OK;
-    }   
 
     TIMER_START(self, TRANSPARANT_TIMEOUT_TICK);    
     return AT_OK;
 }
 
+/**
+ * @brief Append response bytes to collect_buf
+ *
+ * On overflow the complete lines held so far are dropped, so the line in progress
+ * (and with it a final result code) always starts in the buffer. The tail of a line
+ * longer than the buffer is cut off.
+ */
+static void collect_append(at_priv_data_t *priv, const uint8_t *p_data, uint16_t data_len)
+{
+    if (priv->collect_len + data_len > AT_COLLECT_BUF_LEN && priv->collect_line)
+    {
+        AT_DEBUG_ERR("Collect buffer overflow, %u bytes of earlier lines dropped", priv->collect_line);
+        priv->collect_len -= priv->collect_line;
+        memmove(priv->collect_buf, priv->collect_buf + priv->collect_line, priv->collect_len);
+        priv->collect_line = 0;
+    }
+    uint16_t room = AT_COLLECT_BUF_LEN - priv->collect_len;
+    if (data_len > room)
+        data_len = room;
+    memcpy(priv->collect_buf + priv->collect_len, p_data, data_len);
+    priv->collect_len += data_len;
+}
+
+static bool collect_is_final_line(at_handler_t *const self)
+{
+    at_priv_data_t *priv = PRIV_DATA(self);
+    const char *const *code = self->at_input_arg->at_cmd_set_table->final_codes;
+    const uint8_t *line = priv->collect_buf + priv->collect_line;
+    uint16_t line_len = priv->collect_len - priv->collect_line;
+    for (; *code; code++)
+    {
+        size_t code_len = strlen(*code);
+        if (code_len <= line_len && 0 == memcmp(line, *code, code_len))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Collect the response lines of an AT_RSP_COLLECT command
+ *
+ * Chunks may end inside a line (no line reassembly), a line is only checked against
+ * the final result codes once its "\n" has arrived.
+ * @return true when the final result code line has been collected
+ */
+static bool collect_feed(at_handler_t *const self, uint16_t seq, const uint8_t *p_data, uint16_t data_len)
+{
+    at_priv_data_t *priv = PRIV_DATA(self);
+    if (priv->collect_seq != seq)
+    {
+        /* First response of this transaction */
+        priv->collect_seq = seq;
+        priv->collect_len = 0;
+        priv->collect_line = 0;
+    }
+    while (data_len)
+    {
+        const uint8_t *eol = memchr(p_data, '\n', data_len);
+        uint16_t take = eol ? (uint16_t)(eol - p_data + 1) : data_len;
+        collect_append(priv, p_data, take);
+        p_data += take;
+        data_len -= take;
+        if (!eol)
+            break;
+        bool is_final = collect_is_final_line(self);
+        priv->collect_line = priv->collect_len;
+        if (is_final)
+        {
+            if (data_len)
+                AT_DEBUG_ERR("%u bytes after final result code dropped", data_len);
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * @brief Core AT command send implementation (variadic arguments)
  *
@@ -313,61 +987,123 @@ at_status_t at_trans_send(at_handler_t *const self, uint8_t *const data, uint16_
  *         - AT_ERR_OTHERS: Command formatting/transmission failure
  */
 
-static void at_parse_algo(uint8_t *const p_data, uint16_t data_len, void *arg)
+static void at_response_dispatch(at_handler_t *const self, uint8_t *const p_data, uint16_t data_len)
 {
-    at_handler_t *const self = (at_handler_t *)arg;
-    if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
-        return;
-    send_info_t send_info;
     AT_DEBUG_STRING(p_data, data_len);
-    if (0 != UP_OS_IF(self)->pf_os_queue_get(PRIV_DATA(self)->send_queue_handle, &send_info, 0))
+    uint16_t seq = PRIV_DATA(self)->cur_seq;
+    at_txn_t *txn = TXN_OF(self, seq);
+    uint32_t tag = txn->tag;
+    if (TXN_SEQ(tag) != seq || !(TXN_WAIT_RSP_MASK & TXN_BIT(TXN_STATE(tag))))
     {
-        AT_DEBUG_ERR("Received data but no corresponding send info in queue");  
+        AT_DEBUG_ERR("Received data but no transaction waiting for response");  
         return;  
     }
+    const send_info_t *send_info = &txn->send_info;
 
     uint32_t timeout_tick = AT_TIMEOUT_TICK;
-    if(SEND_CMD == send_info.at_send_type)    
+    at_status_t status = AT_OK;
+    bool is_collect = false;
+    bool is_final = false;
+    pf_at_recv_parse_t cmd_parse = NULL;
+    if(SEND_CMD == send_info->at_send_type &&
+       AT_RSP_COLLECT == send_info->u.cmd_event.cmd_entry->rsp_mode)
+    {
+        /* Intermediate lines only restart the timer, the parser sees the whole response */
+        const at_cmd_set_t *cmd_entry = send_info->u.cmd_event.cmd_entry;
+        is_collect = true;
+        is_final = collect_feed(self, seq, p_data, data_len);
+        if (is_final)
+            status = cmd_entry->pf_at_recv_parse[0](PRIV_DATA(self)->collect_buf, PRIV_DATA(self)->collect_len,
+                                           cmd_entry->arg, self->at_input_arg->at_cmd_set_table->holder);
+    }
+    else if(SEND_CMD == send_info->at_send_type)    
     {
-        const at_cmd_set_t *cmd_entry = send_info.u.cmd_event.cmd_entry;
-        uint8_t parse_algo_index = cmd_entry->receive_count - PRIV_DATA(self)->remain_receive_count;
+        const at_cmd_set_t *cmd_entry = send_info->u.cmd_event.cmd_entry;
+        uint8_t parse_algo_index = cmd_entry->receive_count - txn->remain_receive_count;
         if(parse_algo_index > cmd_entry->receive_count)
         {
             AT_DEBUG_ERR("Invalid parse algorithm index: %u > max_count=%u", parse_algo_index, cmd_entry->receive_count);
             return;
         }            
-        if(cmd_entry->pf_at_recv_parse[parse_algo_index])
-            cmd_entry->pf_at_recv_parse[parse_algo_index](p_data, data_len,\
-                                 cmd_entry->arg, self->at_input_arg->at_cmd_set_table->holder);
+        cmd_parse = cmd_entry->pf_at_recv_parse[parse_algo_index];
+        if(cmd_parse)
+            status = cmd_parse(p_data, data_len, cmd_entry->arg, self->at_input_arg->at_cmd_set_table->holder);
         else
             AT_DEBUG_ERR("AT command parse callback is NULL at index %u", parse_algo_index);                
     }
-    else if(SEND_TRANSPARENT == send_info.at_send_type)
+    else if(SEND_TRANSPARENT == send_info->at_send_type)
     {
+        const at_trans_callback_t *callback = &send_info->u.transparent_event.callback;
         timeout_tick = TRANSPARANT_TIMEOUT_TICK;
-        uint8_t parse_algo_index = send_info.u.transparent_event.callback.receive_count - PRIV_DATA(self)->remain_receive_count;
-        if(parse_algo_index >= send_info.u.transparent_event.callback.receive_count)
+        uint8_t parse_algo_index = callback->receive_count - txn->remain_receive_count;
+        if(parse_algo_index >= callback->receive_count)
         {
-            AT_DEBUG_ERR("Invalid transparent parse algorithm index: %u >= max_count=%u", parse_algo_index, send_info.u.transparent_event.callback.receive_count);
+            AT_DEBUG_ERR("Invalid transparent parse algorithm index: %u >= max_count=%u", parse_algo_index, callback->receive_count);
             return;
         }
-        if(send_info.u.transparent_event.callback.pf_at_recv_parse[parse_algo_index])
-            send_info.u.transparent_event.callback.pf_at_recv_parse[parse_algo_index](p_data, data_len,\
-                             send_info.u.transparent_event.callback.arg, send_info.u.transparent_event.callback.holder);
+        if(callback->pf_at_recv_parse[parse_algo_index])
+            status = callback->pf_at_recv_parse[parse_algo_index](p_data, data_len, callback->arg, callback->holder);
         else
             AT_DEBUG_ERR("Transparent parse callback is NULL at index %u", parse_algo_index);
     }
-    if (PRIV_DATA(self)->remain_receive_count > 0)
-        PRIV_DATA(self)->remain_receive_count --;
-    AT_DEBUG_OUT("Recv remaining receive count: %u, len=%u", PRIV_DATA(self)->remain_receive_count, data_len);
-    if ((0 == PRIV_DATA(self)->remain_receive_count) ||
-        ((SEND_CMD == send_info.at_send_type) && 
-         (PRIV_DATA(self)->remain_receive_count > MAX_RECV_CNT_OF_CMD_SEND)) ||
-        ((SEND_TRANSPARENT == send_info.at_send_type) && 
-         (PRIV_DATA(self)->remain_receive_count > MAX_RECV_CNT_OF_TRANS_SEND)))
+    /**
+     * Part of a multi-answer response: same slot, fresh timer, and noise seen so far no longer
+     * counts against the skip limit, so a long answer is bounded per step rather than in total.
+     */
+    if (AT_RECV_PARTIAL == status && !is_collect)
+    {
+        if (!txn_cas(self, seq, TXN_WAIT_RSP_MASK, TXN_ACKED))
+        {
+            AT_DEBUG_ERR("Response of transaction %u arrived after timeout", seq);
+            return;
+        }
+        txn->skip_count = 0;
+        LAT_RESPONSE(self, false);
+        TIMER_START(self, timeout_tick);
+        return;
+    }
+    /**
+     * Not the awaited response: keep the slot and leave the timer running, so noise can
+     * neither complete the transaction nor extend it. A collected response is always final.
+     */
+    if (AT_ERR_RECV_NOT_MATCH == status && !is_collect)
+    {
+        if (txn->skip_count < AT_RSP_SKIP_MAX)
+        {
+            txn->skip_count++;
+            AT_DEBUG_OUT("Response not matched, skipped %u/%u", txn->skip_count, AT_RSP_SKIP_MAX);
+            return;
+        }
+        AT_DEBUG_ERR("Skip limit reached, non-matching response consumed");
+        /* The command owner learns its answer is lost from a last call without data */
+        if (cmd_parse)
+            (void)cmd_parse(NULL, 0, send_info->u.cmd_event.cmd_entry->arg,
+                            self->at_input_arg->at_cmd_set_table->holder);
+    }
+    if (txn->remain_receive_count > 0 && !is_collect)
+        txn->remain_receive_count --;
+    AT_DEBUG_OUT("Recv remaining receive count: %u, len=%u", txn->remain_receive_count, data_len);
+    /* A transparent parser reporting an error (e.g. socket closed) ends it, nothing else comes */
+    bool is_abort = (SEND_TRANSPARENT == send_info->at_send_type) &&
+                    (AT_OK != status) && (AT_ERR_RECV_NOT_MATCH != status) && (AT_RECV_PARTIAL != status);
+    bool is_done = is_collect ? is_final :
+                   is_abort || (0 == txn->remain_receive_count) ||
+                   ((SEND_CMD == send_info->at_send_type) && 
+                    (txn->remain_receive_count > MAX_RECV_CNT_OF_CMD_SEND)) ||
+                   ((SEND_TRANSPARENT == send_info->at_send_type) && 
+                    (txn->remain_receive_count > MAX_RECV_CNT_OF_TRANS_SEND));
+
+    /* Losing the swap means the timer closed the transaction while it was parsed */
+    if (!txn_cas(self, seq, TXN_WAIT_RSP_MASK, is_done ? TXN_DONE : TXN_ACKED))
+    {
+        AT_DEBUG_ERR("Response of transaction %u arrived after timeout", seq);
+        return;
+    }
+    LAT_RESPONSE(self, is_done);
+    if (is_done)
     {
         TIMER_STOP(self);
-        RELEASE_SEND_FEEDBACK_SEMA(self);
+        RELEASE_SEND_CHANNEL(self);
         AT_DEBUG_OUT("AT command/transparent data reception completed" );
     }
     else
@@ -376,15 +1112,203 @@ static void at_parse_algo(uint8_t *const p_data, uint16_t data_len, void *arg)
          * restart the timeout timer to receive next data.
          */
     {
-        if (0 != UP_OS_IF(self)->pf_os_queue_put(PRIV_DATA(self)->send_queue_handle, &send_info, 0))
+        TIMER_START(self, timeout_tick);
+    }
+}
+
+/* URC entry whose prefix starts the line, NULL if none */
+static const at_urc_t *urc_match(const at_urc_t *urc_table, const uint8_t *line, uint16_t len)
+{
+    for (const at_urc_t *urc = urc_table; urc->prefix; urc++)
+    {
+        size_t prefix_len = strlen(urc->prefix);
+        if (len >= prefix_len && 0 == memcmp(line, urc->prefix, prefix_len))
+            return urc;
+    }
+    return NULL;
+}
+
+/* true when the bytes hold nothing but line terminators and spaces */
+static bool is_blank(const uint8_t *p_data, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        if ('\r' != p_data[i] && '\n' != p_data[i] && ' ' != p_data[i])
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Hand URC lines of a chunk to their callbacks, the rest to the waiting transaction
+ *
+ * A chunk without URC is dispatched whole. Around a URC the runs in between are dispatched
+ * in place, blank ones are dropped so a bare "\r\n" cannot count as a response.
+ */
+static void at_rx_dispatch(at_handler_t *const self, uint8_t *const p_data, uint16_t data_len)
+{
+    const at_cmd_set_table_t *cmd_set_table = self->at_input_arg->at_cmd_set_table;
+    if (!cmd_set_table->urc_table)
+    {
+        at_response_dispatch(self, p_data, data_len);
+        return;
+    }
+
+    uint16_t run_start = 0;
+    uint16_t pos = 0;
+    while (pos < data_len)
+    {
+        const uint8_t *lf = memchr(p_data + pos, '\n', data_len - pos);
+        uint16_t line_end = lf ? (uint16_t)(lf - p_data + 1) : data_len;
+        const at_urc_t *urc = urc_match(cmd_set_table->urc_table, p_data + pos, line_end - pos);
+        if (urc)
         {
-            AT_DEBUG_ERR("Failed to re-queue send info for next receive");
-            TIMER_STOP(self);
-            RELEASE_SEND_FEEDBACK_SEMA(self);
-            return;
+            if (pos > run_start && !is_blank(p_data + run_start, pos - run_start))
+                at_response_dispatch(self, p_data + run_start, pos - run_start);
+            urc->pf_urc(p_data + pos, line_end - pos, cmd_set_table->holder);
+            run_start = line_end;
         }
-        TIMER_START(self, timeout_tick);
+        pos = line_end;
+    }
+    if (0 == run_start)
+        at_response_dispatch(self, p_data, data_len);
+    else if (run_start < data_len && !is_blank(p_data + run_start, data_len - run_start))
+        at_response_dispatch(self, p_data + run_start, data_len - run_start);
+}
+
+#if AT_LINE_REASSEMBLY
+/**
+ * @brief Find the end of the last complete line in a chunk
+ *
+ * A "\r" held at the end of line_buf pairs with a leading "\n" of the chunk.
+ * @return Bytes of the chunk up to and including the last "\r\n", 0 if none
+ */
+static uint16_t last_line_end(at_handler_t *const self, const uint8_t *p_data, uint16_t data_len)
+{
+    for (uint16_t i = data_len; i > 0; i--)
+    {
+        if ('\n' != p_data[i - 1])
+            continue;
+        if (i >= 2 && '\r' == p_data[i - 2])
+            return i;
+        if (1 == i && PRIV_DATA(self)->line_len &&
+            '\r' == PRIV_DATA(self)->line_buf[PRIV_DATA(self)->line_len - 1])
+            return i;
     }
+    return 0;
+}
+
+/* Raw blocks go straight to the transaction, lines are scanned for URCs */
+static void feed_dispatch(at_handler_t *const self, uint8_t *p_data, uint16_t len, bool is_block)
+{
+    if (is_block)
+        at_response_dispatch(self, p_data, len);
+    else
+        at_rx_dispatch(self, p_data, len);
+}
+
+/**
+ * @brief Reassemble IDLE chunks into complete lines (or a length-delimited block)
+ *
+ * Chunks that already end on a line boundary with nothing held are dispatched in place,
+ * only a trailing partial line is copied out of the DMA ring buffer.
+ */
+static void line_reassembly_feed(at_handler_t *const self, uint8_t *p_data, uint16_t data_len)
+{
+    at_priv_data_t *priv = PRIV_DATA(self);
+
+    if (priv->is_line_reset_req)
+    {
+        priv->is_line_reset_req = false;
+        priv->line_len = 0;
+        priv->is_line_discard = false;
+    }
+
+    while (data_len)
+    {
+        uint16_t take;
+        bool is_complete;
+        bool is_block = (0 != priv->rx_block_remain);
+        if (!is_block && priv->is_line_discard)
+        {
+            /* Up to the terminator of the URC line being dropped */
+            const uint8_t *lf = memchr(p_data, '\n', data_len);
+            take = lf ? (uint16_t)(lf - p_data + 1) : data_len;
+            priv->is_line_discard = !lf;
+            p_data += take;
+            data_len -= take;
+            continue;
+        }
+        if (is_block)
+        {
+            take = (data_len < priv->rx_block_remain) ? data_len : priv->rx_block_remain;
+            priv->rx_block_remain -= take;
+            is_complete = (0 == priv->rx_block_remain);
+        }
+        else
+        {
+            take = last_line_end(self, p_data, data_len);
+            is_complete = (0 != take);
+            if (!is_complete)
+                take = data_len;
+        }
+
+        if (is_complete && 0 == priv->line_len)
+        {
+            feed_dispatch(self, p_data, take, is_block);   /* Zero copy, chunk ends on a boundary */
+        }
+        else
+        {
+            if (priv->line_len + take > AT_LINE_BUF_LEN)
+            {
+                /* A URC in pieces would lose its head and feed its tail to the transaction */
+                const at_urc_t *urc_table = self->at_input_arg->at_cmd_set_table->urc_table;
+                if (!is_block && urc_table &&
+                    urc_match(urc_table, priv->line_len ? priv->line_buf : p_data,
+                              priv->line_len ? priv->line_len : take))
+                {
+                    AT_DEBUG_ERR("URC line longer than %u bytes dropped", AT_LINE_BUF_LEN);
+                    priv->line_len = 0;
+                    priv->is_line_discard = true;
+                    continue;
+                }
+                /* Line longer than the buffer, hand over what is held to keep the stream moving */
+                AT_DEBUG_ERR("Line buffer overflow: held=%u, incoming=%u", priv->line_len, take);
+                if (priv->line_len)
+                    feed_dispatch(self, priv->line_buf, priv->line_len, is_block);
+                priv->line_len = 0;
+                if (take > AT_LINE_BUF_LEN)
+                {
+                    feed_dispatch(self, p_data, take, is_block);
+                    p_data += take;
+                    data_len -= take;
+                    continue;
+                }
+            }
+            memcpy(priv->line_buf + priv->line_len, p_data, take);
+            priv->line_len += take;
+            if (is_complete)
+            {
+                feed_dispatch(self, priv->line_buf, priv->line_len, is_block);
+                priv->line_len = 0;
+            }
+        }
+        p_data += take;
+        data_len -= take;
+    }
+}
+#endif
+
+static void at_parse_algo(uint8_t *const p_data, uint16_t data_len, void *arg)
+{
+    at_handler_t *const self = (at_handler_t *)arg;
+    if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return;
+#if AT_LINE_REASSEMBLY
+    line_reassembly_feed(self, p_data, data_len);
+#else
+    at_rx_dispatch(self, p_data, data_len);
+#endif
 }
 
 static void timeout_callback(void *timer_handle, void *arg)
@@ -392,14 +1316,54 @@ static void timeout_callback(void *timer_handle, void *arg)
     (void)timer_handle;
     at_handler_t *const self = (at_handler_t *)arg;
 
-    send_info_t send_info;
-    if (0 != UP_OS_IF(self)->pf_os_queue_get(PRIV_DATA(self)->send_queue_handle, &send_info, 0))
+    /* A stale expiry racing with the final response loses the swap and is ignored */
+    uint16_t seq = PRIV_DATA(self)->timer_seq;
+    if (!txn_cas(self, seq, TXN_PENDING_MASK, TXN_TIMEOUT))
     {
-        AT_DEBUG_ERR("Timeout: received response but failed to get send info from queue");
+        AT_DEBUG_OUT("Timeout of closed transaction %u ignored", seq);
+        return;
     }
+#if AT_LINE_REASSEMBLY
+    /* Unterminated leftovers belong to the expired response, parse thread drops them */
+    PRIV_DATA(self)->rx_block_remain = 0;
+    PRIV_DATA(self)->is_line_reset_req = true;
+#endif
         
     AT_DEBUG_ERR("AT response reception timeout");
-    RELEASE_SEND_FEEDBACK_SEMA(self);
+    LAT_TIMEOUT(self);
+    RELEASE_SEND_CHANNEL(self);
+}
+
+static void wheel_timeout_callback(void *arg)
+{
+    timeout_callback(NULL, arg);
+}
+
+/**
+ * @brief Undo the allocations of a failed at_inst in reverse order
+ *
+ * The caller's frame_parse_att must not be left pointing at the released algo.
+ */
+static void at_inst_rollback(at_handler_t *const self, parse_algo_t *algo, size_t arena_mark)
+{
+    if (algo)
+    {
+        self->at_input_arg->uart_proto_input_arg->frame_parse_att->parse_algo = NULL;
+        INST_FREE(self, algo);
+    }
+    if (PRIV_DATA(self))
+    {
+        /* uart_proto_inst releases its own storage when it fails */
+        if (PRIV_DATA(self)->uart_proto_handle)
+            INST_FREE(self, PRIV_DATA(self)->uart_proto_handle);
+        INST_FREE(self, PRIV_DATA(self));
+        PRIV_DATA(self) = NULL;
+    }
+#if (UART_PROTO_STATIC_ALLOC)
+    mem_arena_rewind(self->at_input_arg->arena, arena_mark);
+#else
+    (void)arena_mark;
+#endif
 }
 
 /* Public Function Implementations -------------------------------------------*/
@@ -429,10 +1393,11 @@ at_status_t at_inst(at_handler_t *const self, at_input_arg_t *const p_input_args
         !p_input_args->at_os_interface->pf_sema_delete ||
         !p_input_args->at_os_interface->pf_sema_give ||
         !p_input_args->at_os_interface->pf_sema_take ||
-        !p_input_args->at_os_interface->pf_timer_create ||
-        !p_input_args->at_os_interface->pf_timer_start ||
-        !p_input_args->at_os_interface->pf_timer_stop ||
-        !p_input_args->at_os_interface->pf_timer_delete)
+        (!p_input_args->timer_wheel &&
+         (!p_input_args->at_os_interface->pf_timer_create ||
+          !p_input_args->at_os_interface->pf_timer_start ||
+          !p_input_args->at_os_interface->pf_timer_stop ||
+          !p_input_args->at_os_interface->pf_timer_delete)))
     {
         return AT_ERR_PARAM_INVALID;
     }
@@ -452,17 +1417,38 @@ at_status_t at_inst(at_handler_t *const self, at_input_arg_t *const p_input_args
             if(!table[i].pf_at_recv_parse[j])
                 return AT_ERR_PARAM_INVALID;    
         }
+        if(AT_RSP_COLLECT == table[i].rsp_mode)
+        {
+            /* Collector needs final result codes to know where the response ends */
+            const char *const *final_codes = p_input_args->at_cmd_set_table->final_codes;
+            if(1 != table[i].receive_count || !final_codes || !final_codes[0])
+                return AT_ERR_PARAM_INVALID;
+        }
+        else if(AT_RSP_COUNT != table[i].rsp_mode)
+            return AT_ERR_PARAM_INVALID;
     }
 
+    size_t arena_mark = 0;
+#if (UART_PROTO_STATIC_ALLOC)
+    if (!p_input_args->arena)
+        return AT_ERR_PARAM_INVALID;
+    /* One arena for the whole stack, the UART layer carves its storage from it too */
+    if (!p_input_args->uart_proto_input_arg->arena)
+        p_input_args->uart_proto_input_arg->arena = p_input_args->arena;
+    arena_mark = mem_arena_mark(p_input_args->arena);
+#endif
+
     /* Bind initialization arguments to handler instance */
     self->at_input_arg = p_input_args;
 
-    /* Allocate private runtime data (FreeRTOS thread-safe malloc) */
-    PRIV_DATA(self) = MALLOC(sizeof(at_priv_data_t));
+    /* Allocate private runtime data (FreeRTOS thread-safe malloc or arena) */
+    PRIV_DATA(self) = INST_ALLOC(self, sizeof(at_priv_data_t));
     if (!PRIV_DATA(self)) /* Handle malloc failure */
     {
         return AT_ERR_OTHERS;
     }
+    memset(PRIV_DATA(self), 0, sizeof(at_priv_data_t));
+    PRIV_DATA(self)->tx_buf_idx = SEND_BUF_NONE;
     PRIV_DATA(self)->is_inited = false; /* Mark as uninitialized during setup */
     
     parse_algo_t *algo = self->at_input_arg->uart_proto_input_arg->frame_parse_att->parse_algo;
@@ -470,10 +1456,10 @@ at_status_t at_inst(at_handler_t *const self, at_input_arg_t *const p_input_args
     {
         AT_DEBUG_OUT("Using built-in AT handler parse algorithm");
     }
-    algo = (parse_algo_t *)MALLOC(sizeof(parse_algo_t));
+    algo = (parse_algo_t *)INST_ALLOC(self, sizeof(parse_algo_t));
     if (!algo)
     {
-        FREE(PRIV_DATA(self));
+        at_inst_rollback(self, NULL, arena_mark);
         return AT_ERR_OTHERS;
     }
     self->at_input_arg->uart_proto_input_arg->frame_parse_att->parse_algo = algo;
@@ -485,29 +1471,57 @@ at_status_t at_inst(at_handler_t *const self, at_input_arg_t *const p_input_args
     algo->u.transparent_algo.pf_transparent_parse = at_parse_algo;
 
     /* Allocate and instantiate UART protocol handle */
-    PRIV_DATA(self)->uart_proto_handle = (uart_proto_t *)MALLOC(sizeof(uart_proto_t));
+    PRIV_DATA(self)->uart_proto_handle = (uart_proto_t *)INST_ALLOC(self, sizeof(uart_proto_t));
     if (!PRIV_DATA(self)->uart_proto_handle)
     {
-        FREE(PRIV_DATA(self));
-        FREE(algo);
+        at_inst_rollback(self, algo, arena_mark);
         return AT_ERR_OTHERS;
     }
+    /* uart_proto_inst checks the private pointer for re-init, must start NULL */
+    memset(PRIV_DATA(self)->uart_proto_handle, 0, sizeof(uart_proto_t));
 
     uart_proto_status_t uart_proto_status = uart_proto_inst(PRIV_DATA(self)->uart_proto_handle,
                                                             self->at_input_arg->uart_proto_input_arg);
     if (UART_PROTO_OK != uart_proto_status)
     {        
-        FREE(PRIV_DATA(self));
-        FREE(algo);
-        FREE(PRIV_DATA(self)->uart_proto_handle);
+        at_inst_rollback(self, algo, arena_mark);
         return AT_ERR_OTHERS;
     }
 
-    OS_IF(self)->pf_sema_binary_create(&PRIV_DATA(self)->send_feedback_sema_handle);
-    UP_OS_IF(self)->pf_os_queue_create(1, sizeof(send_info_t), &PRIV_DATA(self)->send_queue_handle);
-    OS_IF(self)->pf_timer_create(&PRIV_DATA(self)->timeout_timer, "at_timeout", AT_TIMEOUT_TICK,\
-                                 0, timeout_callback, self);
-    RELEASE_SEND_FEEDBACK_SEMA(self);
+#if AT_LATENCY_STATS
+    /* Statistics are optional, the handler runs without them on missing tick or memory */
+    PRIV_DATA(self)->lat_slot = LAT_SLOT_NONE;
+    if (OS_IF(self)->pf_get_tick_ms)
+    {
+        uint8_t slot_num = table_length + AT_LAT_TRANS_TYPE_NUM;
+        PRIV_DATA(self)->lat_slot_tab = (lat_slot_t *)INST_ALLOC(self, slot_num * sizeof(lat_slot_t));
+        if (PRIV_DATA(self)->lat_slot_tab)
+        {
+            memset(PRIV_DATA(self)->lat_slot_tab, 0, slot_num * sizeof(lat_slot_t));
+            PRIV_DATA(self)->lat_slot_num = slot_num;
+        }
+        else
+            AT_DEBUG_ERR("No memory for latency statistics, disabled");
+    }
+#endif
+
+    for (uint8_t i = 0; i < AT_LANE_NUM; i++)
+    {
+        OS_IF(self)->pf_sema_binary_create(&PRIV_DATA(self)->lane_sema_handle[i]);
+        OS_IF(self)->pf_sema_take(PRIV_DATA(self)->lane_sema_handle[i], 0);
+    }
+    /* Without a counting semaphore a sender finding every buffer in use fails at once */
+    if (OS_IF(self)->pf_sema_counting_create)
+        OS_IF(self)->pf_sema_counting_create(&PRIV_DATA(self)->send_buf_free_sema,
+                                             AT_SEND_BUF_NUM, AT_SEND_BUF_NUM);
+    PRIV_DATA(self)->grant_lane = LANE_NONE;
+    PRIV_DATA(self)->is_chan_busy = true;
+    if (WHEEL(self))
+        wheel_timer_init(&PRIV_DATA(self)->timeout_wheel_timer, wheel_timeout_callback, self);
+    else
+        OS_IF(self)->pf_timer_create(&PRIV_DATA(self)->timeout_timer, "at_timeout", AT_TIMEOUT_TICK,\
+                                     0, timeout_callback, self);
+    RELEASE_SEND_CHANNEL(self);
 
     /* Mark handler as initialized and ready for use */
     PRIV_DATA(self)->is_inited = true;
@@ -528,22 +1542,136 @@ void at_error_recv_isr_cb(at_handler_t *const self)
     if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return;
     reset_rx_state(PRIV_DATA(self)->uart_proto_handle);
+#if AT_LINE_REASSEMBLY
+    PRIV_DATA(self)->is_line_reset_req = true;
+#endif
 }
 
 void at_send_complete_isr_cb(at_handler_t *const self)
 {
     if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return;
+    if (0 == PRIV_DATA(self)->tx_seg_num) /* Nothing in flight (e.g. send state was reset) */
+        return;
+
+    /* Chain next scatter-gather segment, one DMA transfer per segment */
+    if (PRIV_DATA(self)->tx_seg_idx + 1 < PRIV_DATA(self)->tx_seg_num)
+    {
+        at_trans_seg_t *seg = &PRIV_DATA(self)->tx_seg[++PRIV_DATA(self)->tx_seg_idx];
+        uart_proto_write(PRIV_DATA(self)->uart_proto_handle, (uint8_t *)seg->data, seg->len);
+        return;
+    }
+    if (release_tx_segs(self))
+    {
+        /* at_reset_send_state dropped the transaction and left the channel to this transfer */
+        RELEASE_SEND_CHANNEL(self);
+        return;
+    }
 
-    UP_OS_IF(self)->pf_os_queue_put(PRIV_DATA(self)->send_queue_handle, &PRIV_DATA(self)->send_info, 0);
+    /* The transaction may already be closed by its timeout */
+    uint16_t seq = PRIV_DATA(self)->cur_seq;
+    if (PRIV_DATA(self)->is_expect_response)
+    {
+        if (txn_cas(self, seq, TXN_BIT(TXN_SENDING), TXN_SENT))
+            LAT_TX_DONE(self);
+    }
+    else if (txn_cas(self, seq, TXN_BIT(TXN_SENDING), TXN_DONE))
+    {
+        LAT_TX_DONE(self);
+        RELEASE_SEND_CHANNEL(self);
+    }
 }
 
 void at_reset_send_state(at_handler_t *const self)
 {
     if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return;
-    RELEASE_SEND_FEEDBACK_SEMA(self);
+    txn_cas(self, PRIV_DATA(self)->cur_seq, TXN_PENDING_MASK, TXN_FREE);
+    LAT_CANCEL(self);
+    /**
+     * The UART has no DMA abort: a transfer on the wire keeps its segments, send buffer and
+     * the channel until its TX complete, otherwise the next sender could overwrite the frame.
+     */
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    bool is_tx_busy = (0 != PRIV_DATA(self)->tx_seg_num);
+    PRIV_DATA(self)->is_tx_orphaned = is_tx_busy;
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+    if (!is_tx_busy)
+        RELEASE_SEND_CHANNEL(self);
     reset_rx_state(PRIV_DATA(self)->uart_proto_handle);
+#if AT_LINE_REASSEMBLY
+    PRIV_DATA(self)->rx_block_remain = 0;
+    PRIV_DATA(self)->is_line_reset_req = true;
+#endif
     AT_DEBUG_OUT("AT handler send state reset");
 }
 
+#if AT_LATENCY_STATS
+at_status_t at_lat_snapshot(at_handler_t *const self, bool is_trans, uint8_t id, at_lat_stats_t *out)
+{
+    if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited || !PRIV_DATA(self)->lat_slot_tab)
+        return AT_ERR_HANDLER_NOT_READY;
+    if (!out)
+        return AT_ERR_PARAM_INVALID;
+
+    const at_cmd_set_table_t *cmd_table = self->at_input_arg->at_cmd_set_table;
+    uint8_t slot = LAT_SLOT_NONE;
+    if (is_trans)
+    {
+        if (id < AT_LAT_TRANS_TYPE_NUM)
+            slot = cmd_table->table_len + id;
+    }
+    else
+    {
+        for (uint8_t i = 0; i < cmd_table->table_len; i++)
+        {
+            if (cmd_table->table[i].at_func == id)
+            {
+                slot = i;
+                break;
+            }
+        }
+    }
+    if (LAT_SLOT_NONE == slot)
+        return AT_ERR_CMD_NOT_FOUND;
+
+    /* Writers update a slot in the critical section too, see lat_begin */
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    *out = PRIV_DATA(self)->lat_slot_tab[slot].stats;
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+    return AT_OK;
+}
+
+void at_lat_reset(at_handler_t *const self)
+{
+    if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited || !PRIV_DATA(self)->lat_slot_tab)
+        return;
+    uint32_t primask = UP_OS_IF(self)->pf_os_enter_critical();
+    memset(PRIV_DATA(self)->lat_slot_tab, 0, PRIV_DATA(self)->lat_slot_num * sizeof(lat_slot_t));
+    UP_OS_IF(self)->pf_os_exit_critical(primask);
+}
+
+uint32_t at_lat_percentile(const at_lat_hist_t *hist, uint8_t percent)
+{
+    if (!hist || percent > 100)
+        return 0;
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < AT_LAT_BUCKET_NUM; i++)
+        total += hist->bucket[i];
+    if (!total)
+        return 0;
+
+    uint32_t rank = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < AT_LAT_BUCKET_NUM; i++)
+    {
+        seen += hist->bucket[i];
+        if (seen >= rank && hist->bucket[i])
+        {
+            uint32_t bound = (1UL << i) - 1;
+            return (i == AT_LAT_BUCKET_NUM - 1 || bound > hist->max_ms) ? hist->max_ms : bound;
+        }
+    }
+    return hist->max_ms;
+}
+#endif
@@ -10,6 +10,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "WAPI_M0804C.h"
+#include "hex_codec.h"
 #include <stdio.h>
 
 
@@ -21,40 +22,55 @@
 #define AT_ERR_REPEAT_CNT                   4
 #define WAPI_PROCESS_RETRY_MAX              2
 #define WAPI_PROCESS_FAIL_MAX               3
+#define WAPI_READY_POLL_MAX                 (WAPI_READY_TIMEOUT_MS / AT_TIMEOUT_TICK_STANDARD)
 
-#define SEND_BUF_SIZE                       128       
+#if (WAPI_READY_POLL_MAX < 1) || (WAPI_READY_POLL_MAX > 255)
+#error "WAPI_READY_TIMEOUT_MS must cover 1..255 polls of AT_TIMEOUT_TICK_STANDARD"
+#endif
+
+#define SEND_BUF_SIZE                       WAPI_SEND_BUF_SIZE
+#define NSEND_PREFIX_LEN_MAX                16      /* "AT+NSEND,<socket>,1," */
+#define NSEND_BIN_PREFIX_LEN_MAX            20      /* "AT+NSEND,<socket>,0,<len>," */
+#define SEND_BUF_WAIT_TICK                  AT_CHAN_WAIT_TICK   /* Holders are queued senders or on the wire */
+#define SEND_WINDOW_WAIT_TICK               (TRANSPARANT_TIMEOUT_TICK + AT_TIMEOUT_TICK_STANDARD)
+
+#if (WAPI_RX_RING_SIZE & (WAPI_RX_RING_SIZE - 1))
+#error "WAPI_RX_RING_SIZE must be a power of 2"
+#endif
+
+#if AT_LINE_REASSEMBLY && (AT_LINE_BUF_LEN < M0804C_URC_RECV_LINE_MAX)
+#error "AT_LINE_BUF_LEN must hold M0804C_URC_RECV_LINE_MAX, a push split over DMA bursts is reassembled there"
+#endif
+
+#if (WAPI_UDP_BATCH_MAX < 1) || (WAPI_UDP_BATCH_MAX > 255)
+#error "WAPI_UDP_BATCH_MAX must be 1..255, the answers still due are counted in a uint8_t"
+#endif
 
-#define CUR_SOCKET                          1
+#if (WAPI_SEND_WINDOW < 1) || (WAPI_SEND_WINDOW > 8)
+#error "WAPI_SEND_WINDOW must be 1..8, one bit of the error mask per message"
+#endif
+
+#if WAPI_TX_COALESCE && (WAPI_TX_QUEUE_SIZE & (WAPI_TX_QUEUE_SIZE - 1))
+#error "WAPI_TX_QUEUE_SIZE must be a power of 2"
+#endif
 
 #define PRIV_DATA(self)     (self)->priv_data                /* Private internal data */
 #define AT_OS(self)         (self)->input_arg->at_input_arg->at_os_interface
 #define UP_OS(self)         (self)->input_arg->at_input_arg->uart_proto_input_arg->os_interface
+#define WHEEL(self)         (self)->input_arg->at_input_arg->timer_wheel     /* Deadlines of the wapi_sm task */
 
 #include <stdlib.h>
 #define MALLOC(size)        malloc(size)  
 #define FREE(ptr)           free(ptr)
 
-typedef enum
-{
-    TEST = 0,
-    GET_VERSION,
-    SET_ECHO,
-    SET_BAND,
-    AT_REBOOT,
-    SET_TX_PWR,
-    SET_LOW_PWR,
-    DISCONN_TRANS,
-    SET_IP,
-    CONN_WAPI_BY_CERT,
-    CONN_WAPI_BY_PWD,
-    CHECK_LINK_LAYER,
-    TCP_UDP_CONN,
-    RECV_DATA,
-    SEND_DATA,
-    UPLOAD_CERT_START,
-    CHECK_CERT,
-    DISCONN_SOCKET,
-}at_func_t;
+/* Instance storage: caller arena in static mode, heap otherwise */
+#if (UART_PROTO_STATIC_ALLOC)
+#define INST_ALLOC(args, size)  mem_arena_alloc((args)->arena, size)
+#define INST_FREE(args, ptr)    ((void)(ptr))   /* Rewound as a whole on init failure */
+#else
+#define INST_ALLOC(args, size)  MALLOC(size)
+#define INST_FREE(args, ptr)    FREE(ptr)
+#endif
 
 typedef enum
 {
@@ -69,54 +85,198 @@ typedef enum
     CONN_BY_PWD
 }wapi_conn_mode_t;
 
+typedef void (*pf_wapi_process_fun_t)(m0804c_handler_t *const self);
+typedef void (*pf_process_complete_t)(m0804c_handler_t *const self, uint8_t index, process_status_t process_status);
+
+typedef struct 
+{
+    pf_wapi_process_fun_t pf_wapi_process_fun; 
+    pf_process_complete_t pf_process_cpl;
+    uint32_t recv_timeout_tick;
+    uint32_t process_interval_tick;
+}wapi_process_t;
+
 /* Callbacks for different process stages */
 typedef struct
 {
-    wapi_process_type_t process_type;                     /* Type of the WAPI process */
+    wapi_process_type_t process_type;                     /* Type of the WAPI process, PROCESS_TYPE_NUM: run for an API call */
     const char *process_name;                             /* Name of the process for logging/debugging */
     void (*pf_process_start)(m0804c_handler_t *self);      /* Called before process starts */
     void (*pf_process_success)(m0804c_handler_t *self);    /* Called when process succeeds */
     void (*pf_process_retry)(m0804c_handler_t *self);      /* Called when process fails and will retry */
+    /* Next table once the previous one (PRIV_DATA(self)->sm.table, NULL at first) succeeded, NULL: done */
+    wapi_process_t *(*pf_next_table)(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max);
+    bool is_best_effort;                                  /* A failed table fails the process, the next ones still run */
 }wapi_process_callbacks_t;
 
-typedef void (*pf_wapi_process_fun_t)(m0804c_handler_t *const self);
-typedef void (*pf_process_complete_t)(m0804c_handler_t *const self, uint8_t index, process_status_t process_status);
+/* Events of the wapi_sm task */
+typedef enum
+{
+    WAPI_EV_KICK = 0,                            /* A process was requested */
+    WAPI_EV_STEP_OK,                             /* Answer of the running step matched */
+    WAPI_EV_STEP_ERR,                            /* Answer of the running step did not match */
+    WAPI_EV_RECONNECT,                           /* A socket dropped, see wapi_reconnect_post */
+    WAPI_EV_DEADLINE,                            /* deadline_timer expired */
+    WAPI_EV_CERT_SEG,                            /* Segment of the certificate file being uploaded answered */
+    WAPI_EV_RETRY                                /* + process type: its retry_timer expired */
+}wapi_sm_event_t;
 
-typedef struct 
+/* Processes of the wapi_sm task, a pending one starts before the ones after it */
+typedef enum
 {
-    pf_wapi_process_fun_t pf_wapi_process_fun; 
-    pf_process_complete_t pf_process_cpl;
-    uint32_t recv_timeout_tick;
-    uint32_t process_interval_tick;
-}wapi_process_t;
+    SM_PROC_INIT = PROCESS_INIT,
+    SM_PROC_CERT_AUTH = PROCESS_CERT_AUTH,
+    SM_PROC_PWD_AUTH = PROCESS_PWD_AUTH,
+    SM_PROC_CONNECT = PROCESS_CONNECT,
+    SM_PROC_CERT_UPLOAD,                         /* m0804c_cert_upload */
+    SM_PROC_DISCONN,                             /* m0804c_disconn */
+    SM_PROC_NUM
+}wapi_sm_proc_t;
+
+typedef enum
+{
+    SM_PHASE_IDLE = 0,                           /* No process running */
+    SM_PHASE_WAIT,                               /* Step command sent, answer due by deadline_timer */
+    SM_PHASE_DELAY                               /* Step interval or backoff until deadline_timer */
+}wapi_sm_phase_t;
+
+/* Wheel timer of the wapi_sm task, its expiry posts event to the task */
+typedef struct
+{
+    wheel_timer_t timer;
+    m0804c_handler_t *self;
+    uint8_t event;                               /* wapi_sm_event_t */
+}wapi_sm_timer_t;
+
+/* Process runner of the wapi_sm task, only the task touches it but pending */
+typedef struct
+{
+    volatile uint8_t pending;                    /* Bit n: wapi_sm_proc_t n requested */
+    bool is_module_ready;                        /* Init succeeded, authentication may run */
+    uint8_t proc;                                /* Running wapi_sm_proc_t, SM_PROC_NUM: none */
+    uint8_t phase;                               /* wapi_sm_phase_t */
+    wapi_process_t *table;                       /* Running table */
+    uint8_t table_num;
+    uint8_t step;                                /* Index in table */
+    uint8_t attempt;                             /* Of the step, up to AT_ERR_REPEAT_CNT */
+    uint8_t run;                                 /* Of the table, up to run_max */
+    uint8_t run_max;
+    uint8_t cert_seg;                            /* Segment of cert_file in flight */
+    uint8_t retry_mask;                          /* Bit n: retry of process type n waits for retry_timer[n] */
+    uint8_t fail_cnt[PROCESS_TYPE_NUM];          /* Failed processes in a row */
+    wapi_status_t status;                        /* Of the running process */
+    wapi_status_t api_status;                    /* Of the last process run for an API call */
+    wapi_sm_timer_t deadline_timer;              /* Armed in every phase but SM_PHASE_IDLE */
+    wapi_sm_timer_t retry_timer[PROCESS_TYPE_NUM];
+    const file_att_t *cert_file;                 /* Uploaded by the running step, NULL: none */
+}wapi_sm_t;
+
+/* Per socket NSEND encoding, WAPI_SEND_MODE_BINARY moves through PROBE before it is used */
+typedef enum
+{
+    NSEND_HEX = 0,
+    NSEND_BIN_PROBE,            /* Binary requested, module not asked yet */
+    NSEND_BIN                   /* Binary accepted by the module */
+}nsend_state_t;
+
+/* data_len: bytes posted, above len when they did not fit in the item */
+typedef void (*pf_wapi_work_t)(m0804c_handler_t *const self, uint8_t *buf, uint16_t len, uint16_t data_len,
+                               void *arg);
 
+/* Deferred work item, runs on the wapi_work thread */
 typedef struct
 {
-    bool is_success;
-}wapi_recv_state_t;
+    pf_wapi_work_t pf_work;
+    void *arg;
+    uint16_t len;                                /* Bytes valid in data */
+    uint16_t data_len;                           /* Bytes posted, the first WAPI_WORK_DATA_LEN are kept */
+    uint8_t data[WAPI_WORK_DATA_LEN];
+}wapi_work_t;
+
+/* Received bytes of one socket, written by the parse thread, read by m0804c_recv */
+typedef struct
+{
+    volatile uint16_t head;                      /* Free running, advanced after the bytes are in place */
+    volatile uint16_t tail;                      /* Free running, advanced by m0804c_recv */
+    uint16_t watermark;
+    volatile bool is_notify_pending;             /* pf_rx_notify_cb posted, not yet run */
+    uint8_t buf[WAPI_RX_RING_SIZE];
+}wapi_rx_ring_t;
+
+#if WAPI_TX_COALESCE
+/* Bytes queued by m0804c_send_async, written under the critical section, sent by the wapi_tx thread */
+typedef struct
+{
+    volatile uint16_t head;                      /* Free running, advanced by m0804c_send_async */
+    volatile uint16_t tail;                      /* Free running, advanced once the bytes are sent */
+    volatile uint32_t drop_len;                  /* Bytes taken and lost, see m0804c_get_tx_dropped */
+    uint8_t buf[WAPI_TX_QUEUE_SIZE];
+}wapi_tx_queue_t;
+#endif
+
+/* One module socket, opened and closed by the process tables */
+typedef struct
+{
+    wapi_socket_param_t param;
+    bool is_configured;                          /* param set by m0804c_socket_config */
+    volatile bool is_open;                       /* Connected, cleared on close and module restart */
+    volatile uint8_t nsend_state;                /* nsend_state_t */
+    uint8_t dgram_seq;                           /* Datagram batches sent, selects the answer slot */
+    uint8_t dgram_remain[2];                     /* Answers outstanding of the last two batches */
+    void *tx_sema_handle;                        /* Held by the message being sent on the socket */
+    void *win_sema_handle;                       /* Given once every message of the window is answered */
+    void *probe_done_sema_handle;                /* Given when the binary NSEND probe is answered */
+    volatile bool is_win_waiting;                /* m0804c_send_window waits, answers are counted */
+    uint8_t win_num;                             /* Messages of the window in flight */
+    uint8_t win_answered;                        /* Answers matched so far, in order */
+    uint8_t win_err_mask;                        /* Bit n: message n answered "[ERR]" */
+    volatile bool is_chunk_rejected;             /* A chunk of the message being streamed answered "[ERR]" */
+    wapi_rx_ring_t rx_ring;
+#if WAPI_TX_COALESCE
+    wapi_tx_queue_t tx_queue;
+#endif
+}wapi_socket_t;
 
 typedef struct m0804c_priv_data
 {
     bool is_inited;
     bool trans_send_flag;
+    volatile uint8_t send_buf_busy;              /* Bit n: wapi_send_buf[n] lent to DMA until TX complete */
+    void *send_buf_free_sema_handle;             /* Counts the send buffers not lent */
+    uint8_t send_buf_socket[WAPI_SEND_BUF_NUM];  /* Socket of the NSEND in each send buffer */
+    volatile uint8_t tx_socket;                  /* Socket of the last NSEND sent, answered next */
+    uint8_t proc_socket;                         /* Socket the running open/close table works on */
     wapi_conn_mode_t wapi_conn_mode;
-    void *process_syn_sema_handle;
-    void *multi_send_syn_sema_handle;
-    void *recv_state_queue_handle;
-    void *init_start_sema_handle;
-    void *init_success_sema_handle;
-#if IS_USE_CONN_BY_CERT
-    void *use_cert_sema_handle;
+    void *probe_lock_sema_handle;                /* Held by the binary NSEND probe running */
+    void *sm_queue_handle;                       /* wapi_sm_event_t items for the wapi_sm task */
+    void *api_lock_sema_handle;                  /* Held by the API call waiting for its process */
+    void *api_done_sema_handle;                  /* Given when that process ended */
+    wapi_sm_t sm;
+    void *work_queue_handle;                     /* wapi_work_t items for the wapi_work thread */
+    volatile bool is_reconnect_pending;          /* Reconnect posted, not yet started */
+    volatile uint8_t reconn_tier;                /* wapi_reconn_tier_t of the recovery running */
+    uint32_t reconn_start_ms;                    /* Socket error seen */
+    wapi_reconn_stats_t reconn_stats;
+    uint32_t power_on_ms;                        /* pf_m0804c_open returned */
+    uint32_t boot_ms;                            /* Power on to the first answer, see m0804c_get_boot_ms */
+    wapi_backoff_t backoff[PROCESS_TYPE_NUM];    /* Retry policy of each process */
+    uint32_t rand_state;                         /* Backoff jitter, 0: not seeded yet */
+#if WAPI_TX_COALESCE
+    void *tx_kick_sema_handle;                   /* Wakes the wapi_tx thread */
+    uint32_t tx_delay_ms;                        /* Max wait of a partial chunk */
+    volatile bool is_tx_idle;                    /* wapi_tx thread waits for the first queued byte */
+    volatile uint8_t tx_flush_mask;              /* Bit n: send socket n's partial chunk now */
 #endif
-#if IS_USE_CONN_BY_PWD
-    void *use_pwd_sema_handle;
-#endif
-    void *connect_cfg_success_sema_handle;
     at_handler_t *at_handler;
     at_cmd_set_table_t at_cmd_set_table_copy;    /* Instance-specific copy of AT command table */
-    uint8_t wapi_send_buf[SEND_BUF_SIZE];
+    uint8_t wapi_send_buf[WAPI_SEND_BUF_NUM][SEND_BUF_SIZE];
+    wapi_socket_t sockets[WAPI_SOCKET_NUM];
 }m0804c_priv_data_t;
 
+#if (UART_PROTO_STATIC_ALLOC)
+MEM_ARENA_SIZE_CHECK(sizeof(m0804c_priv_data_t) <= M0804C_PRIV_SIZE, m0804c_priv);
+#endif
+
 /* ============================================================================
  * Forward Declarations
  * ============================================================================ */
@@ -128,6 +288,7 @@ static at_status_t at_recv_parse_upload_cert_start(uint8_t *buf, uint16_t len, v
 static at_status_t at_recv_parse_link_layer_check(uint8_t *buf, uint16_t len, void *arg, void *holder);
 static at_status_t recv_force_correct(uint8_t *buf, uint16_t len, void *arg, void *holder);
 static at_status_t check_connect(uint8_t *buf, uint16_t len, void *arg, void *holder);
+static void wapi_recv_urc(uint8_t *buf, uint16_t len, void *holder);
 
 /* WAPI operation functions */
 static void wapi_test(m0804c_handler_t *const self);
@@ -151,16 +312,22 @@ static void wapi_upload_as_cert_file(m0804c_handler_t *const self);
 static void wapi_upload_asue_cert(m0804c_handler_t *const self);
 static void wapi_upload_asue_cert_file(m0804c_handler_t *const self);
 
-/* Process functions */
-static wapi_status_t wapi_init_process(m0804c_handler_t *const self);
-static wapi_status_t connect_by_cert_process(m0804c_handler_t *const self);
-static wapi_status_t connect_by_pwd_process(m0804c_handler_t *const self);
-static wapi_status_t connect_net_process(m0804c_handler_t *const self);
-static wapi_status_t cert_upload_process(m0804c_handler_t *const self);
-static wapi_status_t disconn_process(m0804c_handler_t *const self);
+/* Process table sequences */
+static wapi_process_t *init_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max);
+#if IS_USE_CONN_BY_CERT
+static wapi_process_t *cert_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max);
+#endif
+#if IS_USE_CONN_BY_PWD
+static wapi_process_t *pwd_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max);
+#endif
+static wapi_process_t *conn_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max);
+static wapi_process_t *upload_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max);
+static wapi_process_t *disconn_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max);
+static bool wapi_socket_is_used(m0804c_handler_t *const self, uint8_t socket);
 
 /* Process callbacks functions */
 static void wapi_process_complete_cb(m0804c_handler_t *const self, uint8_t index, process_status_t process_status);
+static void wapi_ready_complete_cb(m0804c_handler_t *const self, uint8_t index, process_status_t process_status);
 static void init_process_start(m0804c_handler_t *self);
 static void init_process_retry(m0804c_handler_t *self);
 static void init_process_success(m0804c_handler_t *self);
@@ -174,15 +341,21 @@ static void conn_cfg_by_pwd_process_start(m0804c_handler_t *self);
 static void conn_cfg_by_pwd_process_retry(m0804c_handler_t *self);
 static void conn_cfg_by_pwd_process_success(m0804c_handler_t *self);
 #endif
-static void conn_process_start(m0804c_handler_t *self);
 static void conn_process_retry(m0804c_handler_t *self);
 static void conn_process_success(m0804c_handler_t *self);
 
 /* Utility functions */
 static void reset_wapi_state(m0804c_handler_t *self);
-static wapi_status_t wapi_send_data(m0804c_handler_t *self, uint8_t *buf, uint16_t length,
-                                    pf_at_recv_parse_t recv_parse_cb);
-static wapi_status_t m0804c_start_recv(m0804c_handler_t *const self);
+static wapi_status_t wapi_sm_post(m0804c_handler_t *self, wapi_sm_event_t event);
+static void wapi_sm_request(m0804c_handler_t *self, wapi_sm_proc_t proc);
+static void wapi_sm_cancel(m0804c_handler_t *self, wapi_sm_proc_t proc);
+static uint32_t wapi_now_ms(m0804c_handler_t *self);
+static void wapi_reconnect_escalate(m0804c_handler_t *self, wapi_reconn_tier_t tier);
+static void wapi_reconnect_done(m0804c_handler_t *self);
+static wapi_status_t wapi_send_stream(m0804c_handler_t *self, uint8_t socket, uint32_t length,
+                                      const uint8_t *buf, pf_m0804c_produce_t producer, void *arg,
+                                      pf_at_recv_parse_t recv_parse_cb, bool is_expect_response);
+static wapi_status_t m0804c_start_recv(m0804c_handler_t *const self, uint8_t socket);
 /* ============================================================================
  * Global Data
  * ============================================================================ */
@@ -206,44 +379,69 @@ static at_handler_t *wapi_get_at_handler(m0804c_handler_t *const self)
     return NULL;
 }
 
+at_handler_t *m0804c_get_at_handler(m0804c_handler_t *const self)
+{
+    return wapi_get_at_handler(self);
+}
+
 extern uart_ops_t g_wapi_uart_ops;
 extern recv_buf_att_t g_wapi_uart_rx_buf;
 
 static const at_cmd_set_t m0804c_at_table[] = 
 {
-    {TEST, "AT\r\n", 1, {at_recv_parse_ok}, NULL},
-    {GET_VERSION, "ATI\r\n", 1, {at_recv_parse_ok}, NULL},
-    {SET_ECHO, "AT+ECHO=%d\r\n", 1, {at_recv_parse_ok}, NULL},
-    {SET_BAND, "AT+BAND=%d\r\n", 1, {at_recv_parse_ok}, NULL},
-    {AT_REBOOT, "AT+REBOOT\r\n", 1, {at_recv_parse_reboot}, NULL},
-    {SET_TX_PWR, "AT+TXPWR=0,22\r\n", 1, {at_recv_parse_ok}, NULL},
-    {SET_LOW_PWR, "AT+SETDP=%d\r\n", 1, {at_recv_parse_ok}, NULL},
-    {DISCONN_TRANS, "AT+WSDISCNCT\r\n", 1, {at_recv_parse_ok}, NULL},
-    {SET_IP, "AT+WFIXIP=%d,%d.%d.%d.%d,%d.%d.%d.%d,%d.%d.%d.%d\r\n", 1, {at_recv_parse_ok}, NULL},
-    {CONN_WAPI_BY_CERT, "AT+WAPICT,%d,%s\r\n", 1, {at_recv_parse_ok}, NULL},
-    {CONN_WAPI_BY_PWD, "AT+WAPICT,%d,%s,%s\r\n", 1, {at_recv_parse_ok}, NULL},
-    {CHECK_LINK_LAYER, "AT+WAPICT=?\r\n", 1, {at_recv_parse_link_layer_check}, NULL},
-    {TCP_UDP_CONN, "AT+NCRECLNT=%s,%d.%d.%d.%d,%d,%d,%d,%d,%d,%d,%d\r\n", 1, {at_recv_parse_tcp_connect}, NULL},
-    {RECV_DATA, "AT+NRECV,%d,%d,%d\r\n", 1, {at_recv_parse_ok}, NULL},
-    {SEND_DATA, "AT+NSEND,%d,%d,", 1, {at_recv_parse_ok}, NULL},
-    {UPLOAD_CERT_START, "AT+UPCERT=%s\r\n", 1, {at_recv_parse_upload_cert_start}, NULL},
-    {CHECK_CERT, "AT+UPCERT=?\r\n", 1, {at_recv_parse_ok}, NULL},
-    {DISCONN_SOCKET, "AT+NSTOP,%d\r\n", 1, {at_recv_parse_ok}, NULL},
+    {M0804C_AT_TEST, M0804C_AT_TMPL_TEST, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_GET_VERSION, M0804C_AT_TMPL_GET_VERSION, 1, {at_recv_parse_ok}, NULL, AT_RSP_COLLECT},
+    {M0804C_AT_SET_ECHO, M0804C_AT_TMPL_SET_ECHO, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_SET_BAND, M0804C_AT_TMPL_SET_BAND, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_REBOOT, M0804C_AT_TMPL_REBOOT, 1, {at_recv_parse_reboot}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_SET_TX_PWR, M0804C_AT_TMPL_SET_TX_PWR, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_SET_LOW_PWR, M0804C_AT_TMPL_SET_LOW_PWR, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_DISCONN_TRANS, M0804C_AT_TMPL_DISCONN_TRANS, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_SET_IP, M0804C_AT_TMPL_SET_IP, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_CONN_WAPI_BY_CERT, M0804C_AT_TMPL_CONN_WAPI_BY_CERT, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_CONN_WAPI_BY_PWD, M0804C_AT_TMPL_CONN_WAPI_BY_PWD, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_CHECK_LINK_LAYER, M0804C_AT_TMPL_CHECK_LINK_LAYER, 1, {at_recv_parse_link_layer_check}, NULL, AT_RSP_COLLECT},
+    {M0804C_AT_TCP_UDP_CONN, M0804C_AT_TMPL_TCP_UDP_CONN, 1, {at_recv_parse_tcp_connect}, NULL, AT_RSP_COLLECT},
+    {M0804C_AT_RECV_DATA, M0804C_AT_TMPL_RECV_DATA, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_SEND_DATA, M0804C_AT_TMPL_SEND_DATA, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_UPLOAD_CERT_START, M0804C_AT_TMPL_UPLOAD_CERT_START, 1, {at_recv_parse_upload_cert_start}, NULL, AT_RSP_COUNT},
+    {M0804C_AT_CHECK_CERT, M0804C_AT_TMPL_CHECK_CERT, 1, {at_recv_parse_ok}, NULL, AT_RSP_COLLECT},
+    {M0804C_AT_DISCONN_SOCKET, M0804C_AT_TMPL_DISCONN_SOCKET, 1, {at_recv_parse_ok}, NULL, AT_RSP_COUNT},
+};
+
+/* Lines ending a multi-line (AT_RSP_COLLECT) response */
+static const char *const m0804c_final_codes[] = {"+OK", "[ERR]", NULL};
+
+/* Lines the module sends on its own, taken off the RX path before the transactions */
+static const at_urc_t m0804c_urc_table[] = {
+    {M0804C_URC_RECV_DATA, wapi_recv_urc},
+    {NULL, NULL}
 };
 
 static at_cmd_set_table_t g_m0804c_at_cmd_set_table = 
 {
     .table = m0804c_at_table,
     .table_len = sizeof(m0804c_at_table)/sizeof(m0804c_at_table[0]),
-    .holder = NULL
+    .holder = NULL,
+    .final_codes = m0804c_final_codes,
+    .urc_table = m0804c_urc_table
 };
 
+#if (UART_PROTO_STATIC_ALLOC)
+MEM_ARENA_SIZE_CHECK(sizeof(m0804c_at_table) / sizeof(m0804c_at_table[0]) <= M0804C_AT_CMD_NUM, m0804c_at_cmd_num);
+#endif
+
 /* ============================================================================
  * Process Tables Definition
  * ============================================================================ */
+/* Readiness probe, its command polled from power on until the module answers */
+static wapi_process_t wapi_process_ready[] = 
+{
+    {wapi_no_echo,          wapi_ready_complete_cb,   AT_TIMEOUT_TICK_STANDARD,   0},
+};
+
 static wapi_process_t wapi_process_init[] = 
 {
-    {wapi_no_echo,          wapi_process_complete_cb, 2*AT_TIMEOUT_TICK_STANDARD, 0},
     // {wapi_check_cert,       wapi_process_complete_cb, AT_TIMEOUT_TICK_STANDARD,   0},
     {wapi_both_2p4_5g,      wapi_process_complete_cb, AT_TIMEOUT_TICK_STANDARD,   0},
     {wapi_set_tx_pwr,       wapi_process_complete_cb, AT_TIMEOUT_TICK_STANDARD,   0},
@@ -270,10 +468,28 @@ static wapi_process_t wapi_process_use_pwd[] =
 static wapi_process_t wapi_process_conn_net[] = 
 {    
     {wapi_check_link_layer_connect, wapi_process_complete_cb, 5*AT_TIMEOUT_TICK_STANDARD, 3*AT_INTERVAL_TICK},
+};
+
+/* Reconnect of a dropped socket: the link was up a moment ago, no settling time */
+static wapi_process_t wapi_process_check_link[] = 
+{    
+    {wapi_check_link_layer_connect, wapi_process_complete_cb, 2*AT_TIMEOUT_TICK_STANDARD, 0},
+};
+
+/* Open/close tables run once per socket, on proc_socket */
+static wapi_process_t wapi_process_open_socket[] = 
+{    
     {wapi_tcp_connect,              wapi_process_complete_cb, AT_TIMEOUT_TICK_LONG,       0},
     {wapi_recv_data,                wapi_process_complete_cb, AT_TIMEOUT_TICK_STANDARD,   0},
 };
 
+/* No session to set up, the module answers a UDP socket at once */
+static wapi_process_t wapi_process_open_udp_socket[] = 
+{    
+    {wapi_tcp_connect,              wapi_process_complete_cb, AT_TIMEOUT_TICK_STANDARD,   0},
+    {wapi_recv_data,                wapi_process_complete_cb, AT_TIMEOUT_TICK_STANDARD,   0},
+};
+
 static wapi_process_t wapi_process_disconn[] = 
 {    
     {wapi_tcp_disconnect, wapi_process_complete_cb, AT_TIMEOUT_TICK_STANDARD, 0},
@@ -290,6 +506,18 @@ static wapi_process_t wapi_process_upload_certiface[] =
     {wapi_check_cert,            wapi_process_complete_cb, AT_TIMEOUT_TICK_STANDARD,   AT_INTERVAL_TICK}
 };
 
+/**
+ * Default retry policy of each process. Init only talks to the module and keeps retrying at
+ * once; authentication and connect reach the AP and the server and back off.
+ */
+static const wapi_backoff_t wapi_backoff_default[PROCESS_TYPE_NUM] =
+{
+    [PROCESS_INIT]      = {0,                  AT_TIMEOUT_TICK_LONG,     1, 0,  WAPI_PROCESS_FAIL_MAX, 0},
+    [PROCESS_CERT_AUTH] = {2*AT_INTERVAL_TICK, 2*AT_TIMEOUT_TICK_LONG,   2, 50, WAPI_PROCESS_FAIL_MAX, 4*AT_TIMEOUT_TICK_LONG},
+    [PROCESS_PWD_AUTH]  = {2*AT_INTERVAL_TICK, 2*AT_TIMEOUT_TICK_LONG,   2, 50, WAPI_PROCESS_FAIL_MAX, 4*AT_TIMEOUT_TICK_LONG},
+    [PROCESS_CONNECT]   = {AT_INTERVAL_TICK,   AT_TIMEOUT_TICK_LONG,     2, 50, WAPI_PROCESS_FAIL_MAX, 2*AT_TIMEOUT_TICK_LONG},
+};
+
 /* ============================================================================
  * Process Callbacks Structures
  * ============================================================================ */
@@ -299,6 +527,7 @@ static wapi_process_callbacks_t init_callbacks = {
     .pf_process_start = init_process_start,
     .pf_process_success = init_process_success,
     .pf_process_retry = init_process_retry,
+    .pf_next_table = init_next_table,
 };
 
 #if IS_USE_CONN_BY_CERT
@@ -308,6 +537,7 @@ static wapi_process_callbacks_t conn_cfg_by_cert_callbacks = {
     .pf_process_start = conn_cfg_by_cert_process_start,
     .pf_process_success = conn_cfg_by_cert_process_success,
     .pf_process_retry = conn_cfg_by_cert_process_retry,
+    .pf_next_table = cert_next_table,
 };
 #endif
 
@@ -318,15 +548,43 @@ static wapi_process_callbacks_t conn_cfg_by_pwd_callbacks = {
     .pf_process_start = conn_cfg_by_pwd_process_start,
     .pf_process_success = conn_cfg_by_pwd_process_success,
     .pf_process_retry = conn_cfg_by_pwd_process_retry,
+    .pf_next_table = pwd_next_table,
 };
 #endif
 
 static wapi_process_callbacks_t conn_callbacks = {
     .process_type = PROCESS_CONNECT,
     .process_name = "WAPI Conn Net",
-    .pf_process_start = conn_process_start,
     .pf_process_success = conn_process_success,
     .pf_process_retry = conn_process_retry,
+    .pf_next_table = conn_next_table,
+};
+
+/* Run for a blocked API call, no retry or report, the caller gets the result */
+static wapi_process_callbacks_t upload_callbacks = {
+    .process_type = PROCESS_TYPE_NUM,
+    .process_name = "WAPI Cert Upload",
+    .pf_next_table = upload_next_table,
+};
+
+static wapi_process_callbacks_t disconn_callbacks = {
+    .process_type = PROCESS_TYPE_NUM,
+    .process_name = "WAPI Disconn",
+    .pf_next_table = disconn_next_table,
+    .is_best_effort = true,             /* Every open socket is closed */
+};
+
+static wapi_process_callbacks_t *const wapi_sm_procs[SM_PROC_NUM] = {
+    [SM_PROC_INIT] = &init_callbacks,
+#if IS_USE_CONN_BY_CERT
+    [SM_PROC_CERT_AUTH] = &conn_cfg_by_cert_callbacks,
+#endif
+#if IS_USE_CONN_BY_PWD
+    [SM_PROC_PWD_AUTH] = &conn_cfg_by_pwd_callbacks,
+#endif
+    [SM_PROC_CONNECT] = &conn_callbacks,
+    [SM_PROC_CERT_UPLOAD] = &upload_callbacks,
+    [SM_PROC_DISCONN] = &disconn_callbacks,
 };
 
 /* ============================================================================
@@ -341,12 +599,30 @@ static void wapi_process_complete_cb(m0804c_handler_t *const self,\
     }         
 }
 
+/* First answer after power on: the module booted */
+static void wapi_ready_complete_cb(m0804c_handler_t *const self,\
+                                   uint8_t index, process_status_t process_status)
+{
+    uint32_t elapsed_ms = wapi_now_ms(self) - PRIV_DATA(self)->power_on_ms;
+    if(process_status != PROCESS_OK)
+    {
+        WAPI_DEBUG_ERR("Module not ready %u ms after power on", elapsed_ms);
+        return;
+    }
+    PRIV_DATA(self)->boot_ms = elapsed_ms;
+    WAPI_DEBUG_OUT("Module ready %u ms after power on", elapsed_ms);
+}
+
 /* Init process callbacks */
 static void init_process_start(m0804c_handler_t *self)
 {
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->init_start_sema_handle, OS_DELAY_MAX);
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->init_success_sema_handle, 0);
+    PRIV_DATA(self)->sm.is_module_ready = false;
+    /* The module restarts, none of its sockets survives */
+    PRIV_DATA(self)->trans_send_flag = false;
+    for(uint8_t i = 0; i < WAPI_SOCKET_NUM; i++)
+        PRIV_DATA(self)->sockets[i].is_open = false;
     self->input_arg->pwr_ops->pf_m0804c_open(self);
+    PRIV_DATA(self)->power_on_ms = wapi_now_ms(self);
     PRIV_DATA(self)->wapi_conn_mode = CONN_BY_NOTHING;
     reset_wapi_state(self);
 }
@@ -354,70 +630,79 @@ static void init_process_start(m0804c_handler_t *self)
 static void init_process_retry(m0804c_handler_t *self)
 {
     self->input_arg->pwr_ops->pf_m0804c_close(self);
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->init_start_sema_handle);
+    wapi_sm_request(self, SM_PROC_INIT);
 }
 
 static void init_process_success(m0804c_handler_t *self)
 {
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->init_success_sema_handle);
+    PRIV_DATA(self)->sm.is_module_ready = true;
 }
 
 #if IS_USE_CONN_BY_CERT
 static void conn_cfg_by_cert_process_start(m0804c_handler_t *self)
 {
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->use_cert_sema_handle, OS_DELAY_MAX);
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->connect_cfg_success_sema_handle, 0);
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->init_success_sema_handle, OS_DELAY_MAX);
+    /* Connect follows this authentication */
+    wapi_sm_cancel(self, SM_PROC_CONNECT);
 }
 
 static void conn_cfg_by_cert_process_retry(m0804c_handler_t *self)
 {    
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->init_success_sema_handle);
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->use_cert_sema_handle);
+    if(WAPI_RECONN_AUTH == PRIV_DATA(self)->reconn_tier)
+    {
+        wapi_reconnect_escalate(self, WAPI_RECONN_INIT);
+        return;
+    }
+    wapi_sm_request(self, SM_PROC_CERT_AUTH);
 }
 
 static void conn_cfg_by_cert_process_success(m0804c_handler_t *self)
 {
     PRIV_DATA(self)->wapi_conn_mode = CONN_BY_CERT;
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->connect_cfg_success_sema_handle);
+    wapi_sm_request(self, SM_PROC_CONNECT);
 }
 #endif
 
 #if IS_USE_CONN_BY_PWD
 static void conn_cfg_by_pwd_process_start(m0804c_handler_t *self)
 {
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->use_pwd_sema_handle, OS_DELAY_MAX);
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->connect_cfg_success_sema_handle, 0);
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->init_success_sema_handle, OS_DELAY_MAX);
+    /* Connect follows this authentication */
+    wapi_sm_cancel(self, SM_PROC_CONNECT);
 }
 
 static void conn_cfg_by_pwd_process_retry(m0804c_handler_t *self)
 {    
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->init_success_sema_handle);
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->use_pwd_sema_handle);
+    if(WAPI_RECONN_AUTH == PRIV_DATA(self)->reconn_tier)
+    {
+        wapi_reconnect_escalate(self, WAPI_RECONN_INIT);
+        return;
+    }
+    wapi_sm_request(self, SM_PROC_PWD_AUTH);
 }
 
 static void conn_cfg_by_pwd_process_success(m0804c_handler_t *self)
 {
     PRIV_DATA(self)->wapi_conn_mode = CONN_BY_PWD;
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->connect_cfg_success_sema_handle);
+    wapi_sm_request(self, SM_PROC_CONNECT);
 }
 #endif
-/* Conn process success callback */
-static void conn_process_start(m0804c_handler_t *self)
-{
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->connect_cfg_success_sema_handle, OS_DELAY_MAX);
-}
-
+/* Conn process callbacks */
 static void conn_process_retry(m0804c_handler_t *self)
 {
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->connect_cfg_success_sema_handle);
+    /* A reconnect goes one tier down instead of repeating the one that failed */
+    if(WAPI_RECONN_SOCKET == PRIV_DATA(self)->reconn_tier)
+        wapi_reconnect_escalate(self, WAPI_RECONN_AUTH);
+    else if(WAPI_RECONN_AUTH == PRIV_DATA(self)->reconn_tier)
+        wapi_reconnect_escalate(self, WAPI_RECONN_INIT);
+    else
+        wapi_sm_request(self, SM_PROC_CONNECT);
 }
 
 static void conn_process_success(m0804c_handler_t *self)
 {
     PRIV_DATA(self)->trans_send_flag = true;
-    // m0804c_start_recv(self);
+    if(WAPI_RECONN_NONE != PRIV_DATA(self)->reconn_tier)
+        wapi_reconnect_done(self);
+    // m0804c_start_recv(self, WAPI_DEFAULT_SOCKET);
 }
 
 /* ============================================================================
@@ -448,6 +733,17 @@ static int16_t find_substring_in_buffer(uint8_t *buf, uint16_t len, const char*
  * AT Parsing Functions
  * ============================================================================ */
 
+/* true when the chunk carries a final result code, i.e. it is the module's answer */
+static bool is_final_response(uint8_t *buf, uint16_t len)
+{
+    for (const char *const *code = m0804c_final_codes; *code; code++)
+    {
+        if (find_substring_in_buffer(buf, len, *code) >= 0)
+            return true;
+    }
+    return false;
+}
+
 static at_status_t at_recv_parse_base(uint8_t *buf, uint16_t len, const char* string, void *arg)
 {
     m0804c_handler_t *self = (m0804c_handler_t *)arg;
@@ -457,51 +753,50 @@ static at_status_t at_recv_parse_base(uint8_t *buf, uint16_t len, const char* st
     // WAPI_DEBUG_STRING(buf, len);
     
     at_status_t ret;
-    wapi_recv_state_t wapi_recv_state = {.is_success = false};
-    int32_t stat;
-    uint16_t string_len;
     int16_t pos;
     
-    /* Basic parameter validation (null pointer/invalid length) */
-    if(!buf || !string)
+    /* No data: the AT handler dropped the step's answer after AT_RSP_SKIP_MAX other chunks */
+    if(!buf)
     {
-        WAPI_DEBUG_ERR("Invalid parameter: buf or string is NULL");
-        ret = AT_ERR_PARAM_INVALID; 
+        WAPI_DEBUG_ERR("Answer lost among module output");
+        ret = AT_ERR_OTHERS;
         goto exit;
     }
-    
-    /* Boundary check: substring length is 0 or longer than buf  impossible to contain */
-    string_len = strlen(string);
-    if (0 == string_len || len < string_len)
+    if(!string || 0 == strlen(string))
     {
-        WAPI_DEBUG_ERR("Length mismatch: buf_len=%u, pattern_len=%u", len, string_len);
-        ret = AT_ERR_RECV_NOT_MATCH; 
+        WAPI_DEBUG_ERR("Invalid parameter: string is NULL");
+        ret = AT_ERR_PARAM_INVALID; 
         goto exit;
     }
-
+    
     pos = find_substring_in_buffer(buf, len, string);
     if (pos >= 0)
     {
         WAPI_DEBUG_OUT("Pattern matched at pos=%d, buffer_len=%u", pos, len);
-        wapi_recv_state.is_success = true;
-        stat = UP_OS(self)->pf_os_queue_put(PRIV_DATA(self)->recv_state_queue_handle, &wapi_recv_state, 0);
-        if(0 != stat)
+        if(WAPI_OK != wapi_sm_post(self, WAPI_EV_STEP_OK))
         {
-            WAPI_DEBUG_ERR("Queue put failed (stat=%d)", stat);
+            WAPI_DEBUG_ERR("Event queue full, step answer dropped");
             return AT_ERR_OTHERS;     
         }           
         return AT_OK; /* Found substring, match successful */
     }
 
-    /* Traversal complete, substring not found */
+    /**
+     * No match: without a final result code it is module debug output, the AT handler
+     * keeps waiting for the real answer. A final result code fails the step.
+     */
+    if (!is_final_response(buf, len))
+    {
+        WAPI_DEBUG_OUT("Pattern not found, unsolicited output skipped (len=%u)", len);
+        return AT_ERR_RECV_NOT_MATCH;
+    }
     WAPI_DEBUG_ERR("Pattern not found in buffer");
-    ret = AT_ERR_RECV_NOT_MATCH;      
+    ret = AT_ERR_OTHERS;      
     
     exit:        
-        stat = UP_OS(self)->pf_os_queue_put(PRIV_DATA(self)->recv_state_queue_handle, &wapi_recv_state, 0);   
-        if(0 != stat)
+        if(WAPI_OK != wapi_sm_post(self, WAPI_EV_STEP_ERR))
         {
-            WAPI_DEBUG_ERR("Failed to put state in queue (stat=%d)", stat);
+            WAPI_DEBUG_ERR("Event queue full, step answer dropped");
             return AT_ERR_OTHERS;     
         }   
         return ret; 
@@ -513,8 +808,12 @@ static at_status_t at_recv_parse_ok(uint8_t *buf, uint16_t len, void *arg, void
     return at_recv_parse_base(buf, len, "+OK", holder);    
 }
 
+/* A TCP socket is up once the module reports the session alive, a UDP one on "+OK" */
 static at_status_t at_recv_parse_tcp_connect(uint8_t *buf, uint16_t len, void *arg, void *holder)
 {    
+    m0804c_handler_t *self = (m0804c_handler_t *)holder;
+    if (self && WAPI_SOCKET_UDP == PRIV_DATA(self)->sockets[PRIV_DATA(self)->proc_socket].param.proto)
+        return at_recv_parse_base(buf, len, "+OK", holder);
     return at_recv_parse_base(buf, len, "tcp alive", holder);    
 }
 
@@ -539,8 +838,7 @@ static at_status_t recv_force_correct(uint8_t *buf, uint16_t len, void *arg, voi
     if (!self)
         return AT_ERR_PARAM_INVALID;
     /* receive dummy data, so directly return OK  */
-    wapi_recv_state_t wapi_recv_state = {.is_success = true};
-    UP_OS(self)->pf_os_queue_put(PRIV_DATA(self)->recv_state_queue_handle, &wapi_recv_state, 0);
+    wapi_sm_post(self, WAPI_EV_STEP_OK);
     return AT_OK;   
 }
 
@@ -549,76 +847,70 @@ static at_status_t sync_multi_send(uint8_t *buf, uint16_t len, void *arg, void *
     m0804c_handler_t *self = (m0804c_handler_t *)holder;
     if (!self)
         return AT_ERR_PARAM_INVALID;
-    at_reset_send_state(PRIV_DATA(self)->at_handler);
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->multi_send_syn_sema_handle);
+    /* The wapi_sm task sends the next segment, it queues on the channel until this response is finished */
+    if(WAPI_OK != wapi_sm_post(self, WAPI_EV_CERT_SEG))
+    {
+        WAPI_DEBUG_ERR("Event queue full, certificate segment answer dropped");
+        return AT_ERR_OTHERS;
+    }
     return AT_OK;   
 }
 
 static at_status_t multi_send_complete_cb(uint8_t *buf, uint16_t len, void *arg, void *holder)
 {    
-    sync_multi_send(buf, len, arg, holder);
     recv_force_correct(buf, len, arg, holder);
     // at_recv_parse_ok(buf, len, arg, holder);
     return AT_OK;   
 }
 
-static at_status_t multi_send_recv_timeout(void *arg)
-{    
-    m0804c_handler_t *self = (m0804c_handler_t *)arg;
-    if (!self)
-        return AT_ERR_PARAM_INVALID;
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->multi_send_syn_sema_handle);
-    return AT_OK;   
-}
-
 /* ============================================================================
  * WAPI Operation Functions
  * ============================================================================ */
 #if 1
 static void wapi_test(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), TEST);/* not echo */    
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_TEST);/* not echo */    
 }
 
 static void wapi_no_echo(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), SET_ECHO, 0);/* not echo */    
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_SET_ECHO, 0);/* not echo */    
 }
 
 static void wapi_get_version(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), GET_VERSION);/* not echo */    
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_GET_VERSION);/* not echo */    
 }
 
 static void wapi_both_2p4_5g(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), SET_BAND, 3);/* 2.4G and 5G compatible */ 
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_SET_BAND, 3);/* 2.4G and 5G compatible */ 
 }
 
 static void wapi_reboot(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), AT_REBOOT);/* reboot after set band */ 
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_REBOOT);/* reboot after set band */ 
 }
 
 static void wapi_set_tx_pwr(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), SET_TX_PWR);/* diable low power model */
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_SET_TX_PWR);/* diable low power model */
 }
 
 static void wapi_disable_low_pwr(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), SET_LOW_PWR, 0);/* diable low power model */
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_SET_LOW_PWR, 0);/* diable low power model */
 }
 
 static void wapi_disconn_transect(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), DISCONN_TRANS);
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_DISCONN_TRANS);
 }
 
 static void wapi_set_net_config(m0804c_handler_t *const self)
 {
     wapi_info_t *wapi_info = self->input_arg->data_provider->pf_get_wapi_info(self);
-    AT_CMD_SEND(wapi_get_at_handler(self), SET_IP, 1, wapi_info->local_ip[0], \
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_SET_IP, 1, wapi_info->local_ip[0], \
                 wapi_info->local_ip[1], wapi_info->local_ip[2], wapi_info->local_ip[3],\
                 wapi_info->local_ip_mask[0], wapi_info->local_ip_mask[1],\
                 wapi_info->local_ip_mask[2], wapi_info->local_ip_mask[3],\
@@ -629,13 +921,13 @@ static void wapi_set_net_config(m0804c_handler_t *const self)
 #if IS_USE_CONN_BY_CERT
 static void wapi_check_cert(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), CHECK_CERT);/* check certifacate */    
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_CHECK_CERT);/* check certifacate */    
 }
 
 static void wapi_connect_by_cert(m0804c_handler_t *const self)
 {
     wapi_info_t *wapi_info = self->input_arg->data_provider->pf_get_wapi_info(self);
-    AT_CMD_SEND(wapi_get_at_handler(self), CONN_WAPI_BY_CERT, 0, &wapi_info->ssid);
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_CONN_WAPI_BY_CERT, 0, wapi_info->ssid);
 }
 #endif
 
@@ -643,83 +935,189 @@ static void wapi_connect_by_cert(m0804c_handler_t *const self)
 static void wapi_connect_by_pwd(m0804c_handler_t *const self)
 {
     wapi_info_t *wapi_info = self->input_arg->data_provider->pf_get_wapi_info(self);
-    AT_CMD_SEND(wapi_get_at_handler(self), CONN_WAPI_BY_PWD, 0, &wapi_info->ssid, &wapi_info->pwd);
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_CONN_WAPI_BY_PWD, 0, wapi_info->ssid, wapi_info->pwd);
 }
 #endif
 
 static void wapi_check_link_layer_connect(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), CHECK_LINK_LAYER);
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_CHECK_LINK_LAYER);
 }
 
+/* The default socket goes to the server of wapi_info until it is configured, as TCP */
 static void wapi_tcp_connect(m0804c_handler_t *const self)
 {
-    wapi_info_t *wapi_info = self->input_arg->data_provider->pf_get_wapi_info(self);
-    AT_CMD_SEND(wapi_get_at_handler(self), TCP_UDP_CONN, "TCP", wapi_info->server_ip[0],\
-                 wapi_info->server_ip[1], wapi_info->server_ip[2], wapi_info->server_ip[3],\
-                 wapi_info->server_port, wapi_info->local_port, 1, 1, 1, 2, CUR_SOCKET);
+    uint8_t socket = PRIV_DATA(self)->proc_socket;
+    wapi_socket_param_t param = PRIV_DATA(self)->sockets[socket].param;
+    if(!PRIV_DATA(self)->sockets[socket].is_configured)
+    {
+        wapi_info_t *wapi_info = self->input_arg->data_provider->pf_get_wapi_info(self);
+        memcpy(param.remote_ip, wapi_info->server_ip, sizeof(param.remote_ip));
+        param.remote_port = wapi_info->server_port;
+        param.local_port = wapi_info->local_port;
+    }
+    const char *proto = (WAPI_SOCKET_UDP == param.proto) ? "UDP" : "TCP";
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_TCP_UDP_CONN, proto, param.remote_ip[0],\
+                 param.remote_ip[1], param.remote_ip[2], param.remote_ip[3],\
+                 param.remote_port, param.local_port, 1, 1, 1, 2, socket);
 }
 
 static void wapi_tcp_disconnect(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), DISCONN_SOCKET, CUR_SOCKET);
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_DISCONN_SOCKET, PRIV_DATA(self)->proc_socket);
 }
 
 static void wapi_recv_data(m0804c_handler_t *const self)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), RECV_DATA, CUR_SOCKET, 1, 1);
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_RECV_DATA, PRIV_DATA(self)->proc_socket, 1, 1);
+}
+
+static void reset_wapi_state(m0804c_handler_t *self)
+{
+    at_reset_send_state(wapi_get_at_handler(self));    
 }
 
-static uint8_t nibble_to_hex_char(uint8_t nibble)
+/**
+ * Post work to the wapi_work thread without blocking, data is copied into the item.
+ * Called on the UART parse thread.
+ */
+static wapi_status_t wapi_work_post(m0804c_handler_t *self, pf_wapi_work_t pf_work, void *arg,
+                                    const uint8_t *data, uint16_t len)
 {
-    if(nibble < 10)
+    wapi_work_t work = {.pf_work = pf_work, .arg = arg, .len = 0, .data_len = 0};
+    if (data && len)
     {
-        return nibble + '0';
+        work.data_len = len;
+        if (len > WAPI_WORK_DATA_LEN)
+        {
+            WAPI_DEBUG_ERR("Deferred data truncated: len=%u, max=%u", len, WAPI_WORK_DATA_LEN);
+            len = WAPI_WORK_DATA_LEN;
+        }
+        memcpy(work.data, data, len);
+        work.len = len;
     }
-    else if(nibble < 16)
+    if (0 != UP_OS(self)->pf_os_queue_put(PRIV_DATA(self)->work_queue_handle, &work, 0))
     {
-        return nibble + 'A' - 10;
+        WAPI_DEBUG_ERR("Work queue full, deferred work dropped");
+        return WAPI_ERR_OTHERS;
     }
-    else
+    return WAPI_OK;
+}
+
+static uint32_t wapi_now_ms(m0804c_handler_t *self)
+{
+    return AT_OS(self)->pf_get_tick_ms ? AT_OS(self)->pf_get_tick_ms() : 0;
+}
+
+/* Post an event to the wapi_sm task without blocking, any thread */
+static wapi_status_t wapi_sm_post(m0804c_handler_t *self, wapi_sm_event_t event)
+{
+    uint8_t item = (uint8_t)event;
+    if (0 != UP_OS(self)->pf_os_queue_put(PRIV_DATA(self)->sm_queue_handle, &item, 0))
+        return WAPI_ERR_QUEUE_FULL;
+    return WAPI_OK;
+}
+
+/* Run proc once the wapi_sm task is free, a request for a pending process adds nothing */
+static void wapi_sm_request(m0804c_handler_t *self, wapi_sm_proc_t proc)
+{
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    PRIV_DATA(self)->sm.pending |= (uint8_t)(1u << proc);
+    UP_OS(self)->pf_os_exit_critical(primask);
+    wapi_sm_post(self, WAPI_EV_KICK);   /* A full queue wakes the task as well */
+}
+
+static void wapi_sm_cancel(m0804c_handler_t *self, wapi_sm_proc_t proc)
+{
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    PRIV_DATA(self)->sm.pending &= (uint8_t)~(1u << proc);
+    UP_OS(self)->pf_os_exit_critical(primask);
+}
+
+/* One reconnect on its way at a time, repeated errors of the dead socket are absorbed */
+static void wapi_reconnect_post(m0804c_handler_t *self)
+{
+    if (!PRIV_DATA(self)->is_reconnect_pending)
     {
-        return 'H';
+        PRIV_DATA(self)->is_reconnect_pending = true;
+        if (WAPI_OK != wapi_sm_post(self, WAPI_EV_RECONNECT))
+            PRIV_DATA(self)->is_reconnect_pending = false;
     }
 }
 
-static void byte_array_to_hex_string(uint8_t *source, uint16_t source_len, uint8_t *dest, uint16_t *dest_len)
+/**
+ * Recovery of a dropped socket starts at the cheapest tier: the connect process checks the
+ * link once and reopens the sockets that are closed, the others keep sending meanwhile.
+ * Its failure moves on through wapi_reconnect_escalate. Runs on the wapi_sm task.
+ */
+static void wapi_reconnect_work(m0804c_handler_t *const self)
 {
-    uint16_t pos = source_len * 2 - 1;
-    uint8_t byte_idx = source_len - 1;
-    uint8_t nibble = 0;
-    
-    while(1)
+    PRIV_DATA(self)->is_reconnect_pending = false;
+    if (WAPI_RECONN_NONE != PRIV_DATA(self)->reconn_tier)
+        return;     /* The recovery running reopens this socket too */
+    PRIV_DATA(self)->reconn_start_ms = wapi_now_ms(self);
+    if (CONN_BY_NOTHING == PRIV_DATA(self)->wapi_conn_mode)
     {
-        if(pos % 2 != 0)
-        {
-            nibble = source[byte_idx] & 0x0F;
-        }
-        else
-        {
-            nibble = (source[byte_idx] >> 4) & 0x0F;
-            if(byte_idx)
-            {
-                byte_idx--;
-            }
-        }
+        wapi_reconnect_escalate(self, WAPI_RECONN_INIT);
+        return;
+    }
+    PRIV_DATA(self)->reconn_tier = WAPI_RECONN_SOCKET;
+    wapi_sm_request(self, SM_PROC_CONNECT);
+}
+
+/* Authenticate again on the initialized module, or restart it with init and connect process */
+static void wapi_reconnect_escalate(m0804c_handler_t *self, wapi_reconn_tier_t tier)
+{
+    wapi_conn_mode_t conn_mode = PRIV_DATA(self)->wapi_conn_mode;
+    WAPI_DEBUG_ERR("Reconnect: %s", (WAPI_RECONN_AUTH == tier) ? "authenticating again" : "restarting module");
+    PRIV_DATA(self)->reconn_tier = tier;
+    /* The module drops every socket when it authenticates or restarts */
+    PRIV_DATA(self)->trans_send_flag = false;
+    for(uint8_t i = 0; i < WAPI_SOCKET_NUM; i++)
+        PRIV_DATA(self)->sockets[i].is_open = false;
+
+    if (WAPI_RECONN_INIT == tier)
+        m0804c_init(self);
+#if IS_USE_CONN_BY_CERT
+    if(CONN_BY_CERT == conn_mode)
+        m0804c_use_cert_conn(self);
+#endif
+#if IS_USE_CONN_BY_PWD
+    if(CONN_BY_PWD == conn_mode)
+        m0804c_use_pwd_conn(self);
+#endif
+}
+
+/* Connect process succeeded within a recovery, a socket dropped meanwhile starts the next one */
+static void wapi_reconnect_done(m0804c_handler_t *self)
+{
+    wapi_reconn_stats_t *stats = &PRIV_DATA(self)->reconn_stats;
+    wapi_reconn_tier_t tier = (wapi_reconn_tier_t)PRIV_DATA(self)->reconn_tier;
+    uint32_t recover_ms = AT_OS(self)->pf_get_tick_ms ? wapi_now_ms(self) - PRIV_DATA(self)->reconn_start_ms : 0;
+    stats->recover_num[tier]++;
+    stats->last_tier = tier;
+    stats->last_recover_ms = recover_ms;
+    if (recover_ms > stats->max_recover_ms)
+        stats->max_recover_ms = recover_ms;
+    WAPI_DEBUG_OUT("Reconnected at tier %u in %lu ms", (unsigned)tier, (unsigned long)recover_ms);
+    PRIV_DATA(self)->reconn_tier = WAPI_RECONN_NONE;
 
-        dest[pos] = nibble_to_hex_char(nibble);
-        if(0 == pos)
+    for(uint8_t i = 0; i < WAPI_SOCKET_NUM; i++)
+    {
+        if(wapi_socket_is_used(self, i) && !PRIV_DATA(self)->sockets[i].is_open)
         {
+            wapi_reconnect_post(self);
             break;
         }
-        pos--;
     }
-    *dest_len = source_len * 2;
 }
 
-static void reset_wapi_state(m0804c_handler_t *self)
+/* recv_parse_cb of m0804c_send, its arg carries the length of the whole chunk */
+static void wapi_user_rsp_work(m0804c_handler_t *const self, uint8_t *buf, uint16_t len, uint16_t data_len,
+                               void *arg)
 {
-    at_reset_send_state(wapi_get_at_handler(self));    
+    pf_at_recv_parse_t recv_parse_cb = (pf_at_recv_parse_t)arg;
+    recv_parse_cb(buf, len, (void *)(uintptr_t)data_len, (void *)self);
 }
 
 static at_status_t check_connect(uint8_t *buf, uint16_t len, void *arg, void *holder)
@@ -728,8 +1126,6 @@ static at_status_t check_connect(uint8_t *buf, uint16_t len, void *arg, void *ho
     if (!self)
         return AT_ERR_PARAM_INVALID;
 
-    pf_at_recv_parse_t recv_parse_cb = (pf_at_recv_parse_t)arg;
-    
     char string[] = "[ERR] Socket not in use!";
     
     /* Basic parameter validation (null pointer/invalid length) */
@@ -743,27 +1139,26 @@ static at_status_t check_connect(uint8_t *buf, uint16_t len, void *arg, void *ho
     uint16_t string_len = strlen(string);
     if (0 == string_len || len < string_len)
     {
-        return AT_ERR_RECV_NOT_MATCH;
+        return AT_OK; /* Too short to carry the socket error, e.g. "+OK" */
     }
 
     if (find_substring_in_buffer(buf, len, string) >= 0)
     {
-        WAPI_DEBUG_ERR("Socket error detected, reconnecting...");
-        PRIV_DATA(self)->trans_send_flag = false;         
-        m0804c_init(self);/* restart init and connect process */  
-#if IS_USE_CONN_BY_CERT
-        if(CONN_BY_CERT == PRIV_DATA(self)->wapi_conn_mode)
-            m0804c_use_cert_conn(self);
-#endif
-#if IS_USE_CONN_BY_PWD
-        if(CONN_BY_PWD == PRIV_DATA(self)->wapi_conn_mode)
-            m0804c_use_pwd_conn(self);
-#endif
+        uint8_t socket = PRIV_DATA(self)->tx_socket;
+        WAPI_DEBUG_ERR("Socket %u error detected, reconnecting...", socket);
+        PRIV_DATA(self)->sockets[socket].is_open = false;
+        wapi_reconnect_post(self);
         return AT_ERR_OTHERS; /* Found substring, match successful */
     }
     return AT_OK;
 }
 
+/**
+ * Module output after the NSEND answer, as a rule its debug info. The first chunk ends the
+ * transaction, decided here on the parse thread: "[ERR]" or a socket error fails it, anything
+ * else completes it. Only the delivery to the application callback, which may block, is
+ * deferred to the wapi_work thread.
+ */
 static at_status_t send_recv_cb(uint8_t *buf, uint16_t len, void *arg, void *holder)
 {            
     m0804c_handler_t *self = (m0804c_handler_t *)holder;
@@ -774,137 +1169,970 @@ static at_status_t send_recv_cb(uint8_t *buf, uint16_t len, void *arg, void *hol
     {
         return status;
     }
+    if (find_substring_in_buffer(buf, len, "[ERR]") >= 0)
+        status = AT_ERR_OTHERS;
     pf_at_recv_parse_t recv_parse_cb = (pf_at_recv_parse_t)arg;   
-    /* Traversal complete, substring not found */
+    /* A full work queue loses this delivery only, the send still succeeds */
     if (recv_parse_cb)
-        return recv_parse_cb(buf, len, NULL, holder);
-    return AT_ERR_RECV_NOT_MATCH;
+        wapi_work_post(self, wapi_user_rsp_work, (void *)recv_parse_cb, buf, len);
+    return status;
 }
 
-static wapi_status_t wapi_send_data(m0804c_handler_t *self, uint8_t *buf, uint16_t length,
-                                    pf_at_recv_parse_t recv_parse_cb)
+/* Answer to an NSEND: "+OK" passes, "[ERR]" or a closed socket fails, other output is skipped */
+static at_status_t nsend_answer_cb(uint8_t *buf, uint16_t len, void *arg, void *holder)
 {
-    if (!self || !buf || 0 == length)
-        return WAPI_ERR_PARAM_INVALID;
-    
-    const char *cmd_format = "AT+NSEND,%d,1,";
-    uint16_t command_len = snprintf((char*)PRIV_DATA(self)->wapi_send_buf, SEND_BUF_SIZE, cmd_format, CUR_SOCKET);
-    
-    if (command_len >= SEND_BUF_SIZE)
-    {
-        WAPI_DEBUG_ERR("Send buffer overflow: command too long (len=%u, max=%u)", command_len, SEND_BUF_SIZE);
-        return WAPI_ERR_OTHERS;
-    }
-    
-    uint16_t hex_len;
-    byte_array_to_hex_string(buf, length, PRIV_DATA(self)->wapi_send_buf + command_len, &hex_len);
-    
-    uint16_t total_len = command_len + hex_len + 2; /* +2 for "\r\n" */
-    if (total_len > SEND_BUF_SIZE)
-    {
-        WAPI_DEBUG_ERR("Send buffer overflow: total length exceeds limit (len=%u, max=%u)", total_len, SEND_BUF_SIZE);
-        return WAPI_ERR_OTHERS;
-    }
-    
-    PRIV_DATA(self)->wapi_send_buf[total_len - 2] = '\r';
-    PRIV_DATA(self)->wapi_send_buf[total_len - 1] = '\n';
-    
-    at_trans_callback_t callback = {
-        .pf_at_recv_parse = {check_connect, send_recv_cb},
-        .arg = (void *)recv_parse_cb,
-        .holder = (void *)self,
-        .receive_count = 2
-    };
-    at_status_t status = at_trans_send(wapi_get_at_handler(self), PRIV_DATA(self)->wapi_send_buf,
-                                         total_len, &callback);
-    return (status == AT_OK) ? WAPI_OK : WAPI_ERR_OTHERS;
+    if (!buf)
+        return AT_ERR_PARAM_INVALID;
+    if (AT_OK != check_connect(buf, len, NULL, holder))
+        return AT_ERR_OTHERS;
+    if (!is_final_response(buf, len))
+        return AT_ERR_RECV_NOT_MATCH;   /* module debug output, keep waiting */
+    return (find_substring_in_buffer(buf, len, "+OK") >= 0) ? AT_OK : AT_ERR_OTHERS;
 }
 
-static wapi_status_t wapi_send_data_without_response(m0804c_handler_t *self, uint8_t *buf, uint16_t length)
+/* Answer to an NSEND chunk of a message, a failed one stops the chunks after it, arg is its socket */
+static at_status_t stream_chunk_cb(uint8_t *buf, uint16_t len, void *arg, void *holder)
 {
-    if (!self || !buf || 0 == length)
-        return WAPI_ERR_PARAM_INVALID;
-    
-    const char *cmd_format = "AT+NSEND,%d,1,";
-    uint16_t command_len = snprintf((char*)PRIV_DATA(self)->wapi_send_buf, SEND_BUF_SIZE, cmd_format, CUR_SOCKET);
-    
-    if (command_len >= SEND_BUF_SIZE)
+    wapi_socket_t *sock = (wapi_socket_t *)arg;
+    at_status_t status = nsend_answer_cb(buf, len, NULL, holder);
+    if (AT_ERR_OTHERS == status && sock)
     {
-        WAPI_DEBUG_ERR("Send buffer overflow: command too long (len=%u, max=%u)", command_len, SEND_BUF_SIZE);
-        return WAPI_ERR_OTHERS;
+        WAPI_DEBUG_ERR("Chunk rejected by the module");
+        sock->is_chunk_rejected = true;
     }
-    
-    uint16_t hex_len;
-    byte_array_to_hex_string(buf, length, PRIV_DATA(self)->wapi_send_buf + command_len, &hex_len);
-    
-    uint16_t total_len = command_len + hex_len + 2; /* +2 for "\r\n" */
-    if (total_len > SEND_BUF_SIZE)
+    return status;
+}
+
+/* Free send buffer for an NSEND of socket, WAPI_SEND_BUF_NUM if all of them stay lent for timeout */
+static uint8_t wapi_send_buf_take(m0804c_handler_t *self, uint8_t socket, uint32_t timeout)
+{
+    uint8_t idx;
+    /* A count taken guarantees a clear bit, release clears it before giving */
+    if (0 != AT_OS(self)->pf_sema_take(PRIV_DATA(self)->send_buf_free_sema_handle, timeout))
+        return WAPI_SEND_BUF_NUM;
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    for (idx = 0; idx < WAPI_SEND_BUF_NUM; idx++)
     {
-        WAPI_DEBUG_ERR("Send buffer overflow: total length exceeds limit (len=%u, max=%u)", total_len, SEND_BUF_SIZE);
-        return WAPI_ERR_OTHERS;
+        if (!(PRIV_DATA(self)->send_buf_busy & (1U << idx)))
+        {
+            PRIV_DATA(self)->send_buf_busy |= (uint8_t)(1U << idx);
+            PRIV_DATA(self)->send_buf_socket[idx] = socket;
+            break;
+        }
     }
-    
-    PRIV_DATA(self)->wapi_send_buf[total_len - 2] = '\r';
-    PRIV_DATA(self)->wapi_send_buf[total_len - 1] = '\n';
-    
-    at_trans_callback_t callback = {
-        .pf_at_recv_parse = {check_connect},
-        .arg = NULL,
-        .holder = (void *)self,
-        .receive_count = 1
-    };
-    at_status_t status = at_trans_send(wapi_get_at_handler(self), PRIV_DATA(self)->wapi_send_buf,
-                                         total_len, &callback);
-    return (status == AT_OK) ? WAPI_OK : WAPI_ERR_OTHERS;
+    UP_OS(self)->pf_os_exit_critical(primask);
+    return idx;
 }
 
-static void wapi_upload_as_cert(m0804c_handler_t *const self)
-{    
-    AT_CMD_SEND(wapi_get_at_handler(self), UPLOAD_CERT_START, "AS");
+static uint8_t wapi_send_buf_try_acquire(m0804c_handler_t *self, uint8_t socket)
+{
+    return wapi_send_buf_take(self, socket, 0);
 }
 
-static void wapi_upload_asue_cert(m0804c_handler_t *const self)
+/**
+ * Free send buffer, WAPI_SEND_BUF_NUM if all of them stay lent for SEND_BUF_WAIT_TICK.
+ * Senders of several sockets share the buffers, a holder is either queued on the send
+ * channel or on the wire and gives its buffer back in TX complete ISR, which wakes the
+ * sender blocked on send_buf_free_sema.
+ */
+static uint8_t wapi_send_buf_acquire(m0804c_handler_t *self, uint8_t socket)
 {
-    AT_CMD_SEND(wapi_get_at_handler(self), UPLOAD_CERT_START, "ASUE");
+    return wapi_send_buf_take(self, socket, SEND_BUF_WAIT_TICK);
 }
 
-/* Common function for uploading certificate files in segments */
-static void wapi_upload_cert_file_common(m0804c_handler_t *self, file_att_t *file)
+/* Send buffer back to the free ones, also for a send that never started */
+static void wapi_send_buf_release(const uint8_t *data, void *release_arg)
 {
-    const uint8_t seg_len = 64;
-    uint8_t cnt = (file->file_append.file_len + seg_len - 1)/seg_len;
-    
-    for(uint8_t i=0; i<cnt; i++)
+    m0804c_handler_t *self = (m0804c_handler_t *)release_arg;
+    uint8_t idx = (uint8_t)((data - PRIV_DATA(self)->wapi_send_buf[0]) / SEND_BUF_SIZE);
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    PRIV_DATA(self)->send_buf_busy &= (uint8_t)~(1U << idx);
+    UP_OS(self)->pf_os_exit_critical(primask);
+    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->send_buf_free_sema_handle);
+}
+
+/**
+ * TX complete ISR: DMA has finished reading the send buffer. The next transaction only
+ * starts once this one is answered, so the answer check_connect sees belongs to tx_socket.
+ */
+static void wapi_send_buf_sent(const uint8_t *data, void *release_arg)
+{
+    m0804c_handler_t *self = (m0804c_handler_t *)release_arg;
+    uint8_t idx = (uint8_t)((data - PRIV_DATA(self)->wapi_send_buf[0]) / SEND_BUF_SIZE);
+    PRIV_DATA(self)->tx_socket = PRIV_DATA(self)->send_buf_socket[idx];
+    wapi_send_buf_release(data, release_arg);
+}
+
+/* NSEND prefix of a length byte chunk at the start of send_buf, 0 if it is too long */
+static uint16_t wapi_nsend_prefix(uint8_t *send_buf, uint8_t socket, uint16_t length, bool is_binary)
+{
+    uint16_t len_max = is_binary ? NSEND_BIN_PREFIX_LEN_MAX : NSEND_PREFIX_LEN_MAX;
+    int len = is_binary ?
+              snprintf((char*)send_buf, SEND_BUF_SIZE, M0804C_AT_TMPL_SEND_DATA_BIN, socket, length) :
+              snprintf((char*)send_buf, SEND_BUF_SIZE, M0804C_AT_TMPL_SEND_DATA, socket, 1);
+    if (len <= 0 || len > len_max)
+    {
+        WAPI_DEBUG_ERR("Send buffer overflow: command too long (len=%d, max=%u)", len, len_max);
+        return 0;
+    }
+    return (uint16_t)len;
+}
+
+/**
+ * Build "AT+NSEND,<socket>,1,<hex>\r\n", or "AT+NSEND,<socket>,0,<len>,<bytes>\r\n" in binary,
+ * for length payload bytes in a free send buffer and send it in place. The buffer is lent to
+ * the AT handler (no second copy) and comes back in TX complete ISR. The payload is read from
+ * src, or pulled from producer straight to its place: behind the prefix in binary, into the
+ * upper half of the hex area and expanded there in hex.
+ */
+static wapi_status_t wapi_send_nsend(m0804c_handler_t *self, uint8_t socket, const uint8_t *src,
+                                     uint16_t length, pf_m0804c_produce_t producer, void *arg,
+                                     uint32_t offset, bool is_binary, const at_trans_callback_t *callback)
+{
+    if (!self || (!src && !producer) || 0 == length ||
+        length > (is_binary ? WAPI_NSEND_BIN_CHUNK_MAX : WAPI_NSEND_CHUNK_MAX))
+        return WAPI_ERR_PARAM_INVALID;
+
+    uint8_t idx = wapi_send_buf_acquire(self, socket);
+    if (WAPI_SEND_BUF_NUM == idx)
+    {
+        WAPI_DEBUG_ERR("Send buffer still in use by previous transmission");
+        return WAPI_ERR_OTHERS;
+    }
+    uint8_t *send_buf = PRIV_DATA(self)->wapi_send_buf[idx];
+
+    uint16_t command_len = wapi_nsend_prefix(send_buf, socket, length, is_binary);
+    if (!command_len)
     {
-        uint8_t send_len = seg_len;
-        pf_at_recv_parse_t pf_at_recv_parse = sync_multi_send;
-        
-        if(cnt-1 == i)
+        wapi_send_buf_release(send_buf, self);
+        return WAPI_ERR_OTHERS;
+    }
+    uint8_t *payload = send_buf + command_len;
+    uint8_t *raw = is_binary ? payload : payload + WAPI_NSEND_CHUNK_MAX;
+
+    if (producer)
+    {
+        if (length != producer(self, offset, raw, length, arg))
         {
-           pf_at_recv_parse = multi_send_complete_cb;
-           send_len = file->file_append.file_len % seg_len;
+            WAPI_DEBUG_ERR("Producer failed at offset %lu", (unsigned long)offset);
+            wapi_send_buf_release(send_buf, self);
+            return WAPI_ERR_OTHERS;
         }
-            
-        uint32_t offset = seg_len * i;
-        int32_t stat = AT_OS(self)->pf_sema_take(PRIV_DATA(self)->multi_send_syn_sema_handle,\
-                                                 AT_TIMEOUT_TICK_STANDARD);
-        if(0 == stat)
+        src = raw;
+    }
+    else if (is_binary)
+        memcpy(raw, src, length);
+
+    uint16_t payload_len = length;
+    if (!is_binary)
+    {
+        hex_encode(src, length, payload);   /* front to back, expands raw in place */
+        payload_len = length * 2;
+    }
+
+    uint16_t total_len = command_len + payload_len + 2; /* +2 for "\r\n" */
+    send_buf[total_len - 2] = '\r';
+    send_buf[total_len - 1] = '\n';
+
+    at_trans_seg_t seg = {
+        .data = send_buf,
+        .len = total_len,
+        .owner = AT_SEG_BORROWED,
+        .pf_release = wapi_send_buf_sent,
+        .release_arg = (void *)self
+    };
+    at_status_t status = at_trans_sendv(wapi_get_at_handler(self), &seg, 1, callback);
+    if (AT_OK != status)
+        wapi_send_buf_release(send_buf, self);
+    return (status == AT_OK) ? WAPI_OK : WAPI_ERR_OTHERS;
+}
+
+/* Answer to the empty binary NSEND of wapi_nsend_probe */
+static at_status_t nsend_probe_cb(uint8_t *buf, uint16_t len, void *arg, void *holder)
+{
+    m0804c_handler_t *self = (m0804c_handler_t *)holder;
+    if (!self)
+        return AT_ERR_PARAM_INVALID;
+    if (!is_final_response(buf, len))
+        return AT_ERR_RECV_NOT_MATCH;   /* module debug output, keep waiting */
+
+    at_status_t status = check_connect(buf, len, arg, holder);
+    bool is_accepted = (AT_OK == status) && find_substring_in_buffer(buf, len, "+OK") >= 0;
+
+    /* An answer after wapi_nsend_probe gave up is dropped, the socket already fell back to hex */
+    wapi_socket_t *sock = &PRIV_DATA(self)->sockets[(uint8_t)(uintptr_t)arg];
+    bool is_waiting = false;
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    if (NSEND_BIN_PROBE == sock->nsend_state)
+    {
+        sock->nsend_state = is_accepted ? NSEND_BIN : NSEND_HEX;
+        is_waiting = true;
+    }
+    UP_OS(self)->pf_os_exit_critical(primask);
+    if (is_waiting)
+        AT_OS(self)->pf_sema_give(sock->probe_done_sema_handle);
+    return status;
+}
+
+/**
+ * Ask the module whether socket takes the binary format. An empty binary NSEND moves no socket
+ * data and is answered "+OK" or "[ERR]", no answer counts as a rejection. Probes of several
+ * sockets take turns on probe_lock_sema, each one waits for its answer on the socket's own
+ * probe_done_sema.
+ */
+static void wapi_nsend_probe(m0804c_handler_t *self, uint8_t socket)
+{
+    wapi_socket_t *sock = &PRIV_DATA(self)->sockets[socket];
+    if (0 != AT_OS(self)->pf_sema_take(PRIV_DATA(self)->probe_lock_sema_handle, AT_TIMEOUT_TICK_STANDARD))
+        return; /* Asked again with the next message */
+    uint8_t idx = wapi_send_buf_acquire(self, socket);
+    if (WAPI_SEND_BUF_NUM == idx)
+    {
+        AT_OS(self)->pf_sema_give(PRIV_DATA(self)->probe_lock_sema_handle);
+        return;
+    }
+    /* A late answer to a probe that gave up may have given it */
+    AT_OS(self)->pf_sema_take(sock->probe_done_sema_handle, 0);
+    uint8_t *send_buf = PRIV_DATA(self)->wapi_send_buf[idx];
+
+    int total_len = snprintf((char*)send_buf, SEND_BUF_SIZE, M0804C_AT_TMPL_SEND_DATA_BIN "\r\n", socket, 0);
+    at_trans_callback_t callback = {
+        .pf_at_recv_parse = {nsend_probe_cb},
+        .arg = (void *)(uintptr_t)socket,
+        .holder = (void *)self,
+        .receive_count = 1,
+        .trans_type = WAPI_TRANS_NSEND
+    };
+    at_trans_seg_t seg = {
+        .data = send_buf,
+        .len = (uint16_t)total_len,
+        .owner = AT_SEG_BORROWED,
+        .pf_release = wapi_send_buf_sent,
+        .release_arg = (void *)self
+    };
+    callback.lane = sock->param.lane;
+
+    if (AT_OK != at_trans_sendv(wapi_get_at_handler(self), &seg, 1, &callback))
+    {
+        wapi_send_buf_release(send_buf, self);
+        AT_OS(self)->pf_sema_give(PRIV_DATA(self)->probe_lock_sema_handle);
+        return;
+    }
+    if (0 != AT_OS(self)->pf_sema_take(sock->probe_done_sema_handle, AT_TIMEOUT_TICK_STANDARD))
+    {
+        uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+        if (NSEND_BIN_PROBE == sock->nsend_state)
+            sock->nsend_state = NSEND_HEX;
+        UP_OS(self)->pf_os_exit_critical(primask);
+    }
+    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->probe_lock_sema_handle);
+
+    if (NSEND_BIN == sock->nsend_state)
+        WAPI_DEBUG_OUT("Socket %d sends binary", socket);
+    else
+        WAPI_DEBUG_ERR("Binary send rejected, socket %d falls back to hex", socket);
+}
+
+/* Socket takes data: connect process done and the socket opened by it */
+static bool wapi_socket_ready(m0804c_handler_t *self, uint8_t socket)
+{
+    return PRIV_DATA(self)->trans_send_flag && PRIV_DATA(self)->sockets[socket].is_open;
+}
+
+/**
+ * Send length bytes on socket as consecutive NSEND chunks of up to WAPI_NSEND_CHUNK_MAX bytes
+ * (WAPI_NSEND_BIN_CHUNK_MAX in binary).
+ *
+ * Each chunk is encoded into a free send buffer while the previous one is on the wire
+ * and waits for its "+OK", the send channel keeps them in order. Only the last chunk
+ * carries recv_parse_cb, so the application sees one completion per message. The socket
+ * is held for the whole message, every chunk queues on the channel again, so messages of
+ * other sockets interleave chunk by chunk. A chunk answered "[ERR]" aborts the message, only
+ * the chunk already queued behind it still goes out.
+ */
+static wapi_status_t wapi_send_stream(m0804c_handler_t *self, uint8_t socket, uint32_t length,
+                                      const uint8_t *buf, pf_m0804c_produce_t producer, void *arg,
+                                      pf_at_recv_parse_t recv_parse_cb, bool is_expect_response)
+{
+    if (socket >= WAPI_SOCKET_NUM || !length || (!buf && !producer))
+        return WAPI_ERR_PARAM_INVALID;
+    wapi_socket_t *sock = &PRIV_DATA(self)->sockets[socket];
+
+    if (0 != AT_OS(self)->pf_sema_take(sock->tx_sema_handle, WAPI_SOCKET_TX_WAIT_TICK))
+    {
+        WAPI_DEBUG_ERR("Socket %u still busy with its previous message", socket);
+        return WAPI_ERR_OTHERS;
+    }
+
+    /* The encoding is settled before the first chunk and kept for the whole message */
+    if (NSEND_BIN_PROBE == sock->nsend_state && wapi_socket_ready(self, socket))
+        wapi_nsend_probe(self, socket);
+    bool is_binary = (NSEND_BIN == sock->nsend_state);
+    uint16_t chunk_max = is_binary ? WAPI_NSEND_BIN_CHUNK_MAX : WAPI_NSEND_CHUNK_MAX;
+
+    wapi_status_t status = WAPI_OK;
+    uint32_t offset = 0;
+    sock->is_chunk_rejected = false;
+    while (offset < length)
+    {
+        /* A chunk failing with a socket error stops the rest of the message */
+        if (!wapi_socket_ready(self, socket))
+        {
+            status = WAPI_ERR_SEND_NOT_READY;
+            break;
+        }
+        if (sock->is_chunk_rejected)
+        {
+            status = WAPI_ERR_OTHERS;
+            WAPI_DEBUG_ERR("Message aborted after %lu of %lu bytes", (unsigned long)offset, (unsigned long)length);
+            break;
+        }
+
+        uint16_t chunk_len = (length - offset > chunk_max) ? chunk_max : (uint16_t)(length - offset);
+        at_trans_callback_t callback = {
+            .pf_at_recv_parse = {stream_chunk_cb},
+            .arg = (void *)sock,
+            .holder = (void *)self,
+            .receive_count = 1,
+            .lane = sock->param.lane,
+            .trans_type = WAPI_TRANS_NSEND
+        };
+        if (offset + chunk_len == length && is_expect_response)
+        {
+            callback.pf_at_recv_parse[0] = nsend_answer_cb;    /* no chunk left to stop */
+            callback.pf_at_recv_parse[1] = send_recv_cb;
+            callback.arg = (void *)recv_parse_cb;
+            callback.receive_count = 2;
+        }
+        status = wapi_send_nsend(self, socket, buf ? buf + offset : NULL, chunk_len,
+                                 producer, arg, offset, is_binary, &callback);
+        if (WAPI_OK != status)
         {
-            at_trans_callback_t callback = {
-                .pf_at_recv_parse = {pf_at_recv_parse},
-                .arg = NULL,
-                .holder = (void *)self,
-                .receive_count = 1
+            if (offset)
+                WAPI_DEBUG_ERR("Message aborted after %lu of %lu bytes", (unsigned long)offset, (unsigned long)length);
+            break;
+        }
+        offset += chunk_len;
+    }
+    AT_OS(self)->pf_sema_give(sock->tx_sema_handle);
+    return status;
+}
+
+/* Final result codes in a chunk, answers of a batch may share one DMA burst */
+static uint8_t count_final_responses(uint8_t *buf, uint16_t len)
+{
+    uint8_t cnt = 0;
+    for (const char *const *code = m0804c_final_codes; *code; code++)
+    {
+        uint16_t pos = 0;
+        int16_t found;
+        while (pos < len && (found = find_substring_in_buffer(buf + pos, len - pos, *code)) >= 0)
+        {
+            cnt++;
+            pos += (uint16_t)found + (uint16_t)strlen(*code);
+        }
+    }
+    return cnt;
+}
+
+/* Answers of one datagram batch, counted down in the slot arg points to */
+static at_status_t dgram_batch_cb(uint8_t *buf, uint16_t len, void *arg, void *holder)
+{
+    uint8_t *remain = (uint8_t *)arg;
+    if (!remain || !buf)
+        return AT_ERR_PARAM_INVALID;
+    if (find_substring_in_buffer(buf, len, "[ERR]") >= 0)
+        WAPI_DEBUG_ERR("Datagram rejected by the module");
+
+    uint8_t cnt = count_final_responses(buf, len);
+    *remain = (cnt >= *remain) ? 0 : (uint8_t)(*remain - cnt);
+    /* The transaction keeps the channel up to the last answer, each answer restarts its timer */
+    if (!*remain)
+        return AT_OK;
+    return cnt ? AT_RECV_PARTIAL : AT_ERR_RECV_NOT_MATCH;
+}
+
+/* NSEND of a whole datagram at dst, 0 if it does not fit in size bytes */
+static uint16_t wapi_dgram_pack(uint8_t *dst, uint16_t size, uint8_t socket, const uint8_t *data,
+                                uint16_t length, bool is_binary)
+{
+    int prefix_len = is_binary ?
+                     snprintf((char*)dst, size, M0804C_AT_TMPL_SEND_DATA_BIN, socket, length) :
+                     snprintf((char*)dst, size, M0804C_AT_TMPL_SEND_DATA, socket, 1);
+    uint16_t payload_len = is_binary ? length : length * 2;
+    if (prefix_len <= 0 || (uint32_t)prefix_len + payload_len + 2 > size)
+        return 0;
+    if (is_binary)
+        memcpy(dst + prefix_len, data, length);
+    else
+        hex_encode(data, length, dst + prefix_len);
+    uint16_t total_len = (uint16_t)prefix_len + payload_len + 2;
+    dst[total_len - 2] = '\r';
+    dst[total_len - 1] = '\n';
+    return total_len;
+}
+
+/**
+ * Send num datagrams on socket, as many as fit into one send buffer (at most
+ * WAPI_UDP_BATCH_MAX) per AT transaction. The answer slot alternates per batch: a batch
+ * reaches the channel only after the previous one closed, so the slot it reuses is free.
+ */
+static wapi_status_t wapi_sendto_batch(m0804c_handler_t *self, uint8_t socket, const wapi_dgram_t *dgrams,
+                                       uint16_t num)
+{
+    wapi_socket_t *sock = &PRIV_DATA(self)->sockets[socket];
+    if (0 != AT_OS(self)->pf_sema_take(sock->tx_sema_handle, WAPI_SOCKET_TX_WAIT_TICK))
+    {
+        WAPI_DEBUG_ERR("Socket %u still busy with its previous message", socket);
+        return WAPI_ERR_OTHERS;
+    }
+
+    if (NSEND_BIN_PROBE == sock->nsend_state && wapi_socket_ready(self, socket))
+        wapi_nsend_probe(self, socket);
+    bool is_binary = (NSEND_BIN == sock->nsend_state);
+    uint16_t dgram_max = is_binary ? WAPI_NSEND_BIN_CHUNK_MAX : WAPI_NSEND_CHUNK_MAX;
+
+    wapi_status_t status = WAPI_OK;
+    for (uint16_t i = 0; i < num; i++)
+    {
+        if (!dgrams[i].data || 0 == dgrams[i].len || dgrams[i].len > dgram_max)
+            status = WAPI_ERR_PARAM_INVALID;
+    }
+
+    uint16_t sent = 0;
+    while (WAPI_OK == status && sent < num)
+    {
+        if (!wapi_socket_ready(self, socket))
+        {
+            status = WAPI_ERR_SEND_NOT_READY;
+            break;
+        }
+        uint8_t idx = wapi_send_buf_acquire(self, socket);
+        if (WAPI_SEND_BUF_NUM == idx)
+        {
+            WAPI_DEBUG_ERR("Send buffer still in use by previous transmission");
+            status = WAPI_ERR_OTHERS;
+            break;
+        }
+        uint8_t *send_buf = PRIV_DATA(self)->wapi_send_buf[idx];
+
+        /* A datagram of dgram_max always fits an empty buffer */
+        uint16_t total_len = 0;
+        uint8_t batch = 0;
+        while (sent + batch < num && batch < WAPI_UDP_BATCH_MAX)
+        {
+            const wapi_dgram_t *dgram = &dgrams[sent + batch];
+            uint16_t len = wapi_dgram_pack(send_buf + total_len, SEND_BUF_SIZE - total_len, socket,
+                                           dgram->data, dgram->len, is_binary);
+            if (!len)
+                break;
+            total_len += len;
+            batch++;
+        }
+
+        uint8_t slot = sock->dgram_seq++ & 1;
+        sock->dgram_remain[slot] = batch;
+        at_trans_callback_t callback = {
+            .pf_at_recv_parse = {dgram_batch_cb},
+            .arg = (void *)&sock->dgram_remain[slot],
+            .holder = (void *)self,
+            .receive_count = 1,
+            .lane = sock->param.lane,
+            .trans_type = WAPI_TRANS_NSEND
+        };
+        at_trans_seg_t seg = {
+            .data = send_buf,
+            .len = total_len,
+            .owner = AT_SEG_BORROWED,
+            .pf_release = wapi_send_buf_sent,
+            .release_arg = (void *)self
+        };
+        if (AT_OK != at_trans_sendv(wapi_get_at_handler(self), &seg, 1, &callback))
+        {
+            wapi_send_buf_release(send_buf, self);
+            status = WAPI_ERR_OTHERS;
+            break;
+        }
+        sent += batch;
+    }
+    AT_OS(self)->pf_sema_give(sock->tx_sema_handle);
+
+    if (sent && sent < num)
+        WAPI_DEBUG_ERR("Datagrams stopped after %u of %u", sent, num);
+    return status;
+}
+
+/**
+ * Index in m0804c_final_codes of the first final result code at or after *pos, -1 if there
+ * is none; *pos moves past it. Answers of a window come in order, also within one burst.
+ */
+static int8_t next_final_response(uint8_t *buf, uint16_t len, uint16_t *pos)
+{
+    int8_t code = -1;
+    int16_t code_pos = 0;
+    for (int8_t i = 0; m0804c_final_codes[i]; i++)
+    {
+        int16_t found = find_substring_in_buffer(buf + *pos, len - *pos, m0804c_final_codes[i]);
+        if (found >= 0 && (code < 0 || found < code_pos))
+        {
+            code = i;
+            code_pos = found;
+        }
+    }
+    if (code >= 0)
+        *pos += (uint16_t)code_pos + (uint16_t)strlen(m0804c_final_codes[code]);
+    return code;
+}
+
+/* Answers of the window in flight on the socket arg points to, matched to its messages in order */
+static at_status_t send_window_cb(uint8_t *buf, uint16_t len, void *arg, void *holder)
+{
+    m0804c_handler_t *self = (m0804c_handler_t *)holder;
+    wapi_socket_t *sock = (wapi_socket_t *)arg;
+    if (!self || !sock || !buf)
+        return AT_ERR_PARAM_INVALID;
+    /* "[ERR] Socket not in use!" of a stream socket reconnects as for every NSEND */
+    if (WAPI_SOCKET_TCP == sock->param.proto)
+        check_connect(buf, len, NULL, holder);
+
+    uint8_t cnt = 0, err_mask = 0;
+    uint16_t pos = 0;
+    int8_t code;
+    while (cnt < WAPI_SEND_WINDOW && (code = next_final_response(buf, len, &pos)) >= 0)
+    {
+        if (code)   /* Not "+OK" */
+            err_mask |= (uint8_t)(1U << cnt);
+        cnt++;
+    }
+
+    bool is_done = true;
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    if (sock->is_win_waiting)
+    {
+        uint8_t take = (uint8_t)(sock->win_num - sock->win_answered);
+        if (cnt < take)
+            take = cnt;
+        sock->win_err_mask |= (uint8_t)((err_mask & ((1U << take) - 1)) << sock->win_answered);
+        sock->win_answered += take;
+        is_done = (sock->win_answered == sock->win_num);
+        if (is_done)
+            sock->is_win_waiting = false;
+        else
+            sock = NULL;
+    }
+    else
+        sock = NULL;    /* m0804c_send_window gave up, close the transaction */
+    UP_OS(self)->pf_os_exit_critical(primask);
+
+    if (sock)
+        AT_OS(self)->pf_sema_give(sock->win_sema_handle);
+    /* The transaction keeps the channel up to the last answer, each answer restarts its timer */
+    if (is_done)
+        return AT_OK;
+    return cnt ? AT_RECV_PARTIAL : AT_ERR_RECV_NOT_MATCH;
+}
+
+/**
+ * Send num messages on socket, each one NSEND, a window of up to WAPI_SEND_WINDOW per AT
+ * transaction: packed into one send buffer and the next ones free right now (never waited
+ * for while one is held), then awaited before their callbacks run. A message not sent or not
+ * answered still gets its callback, with the reason.
+ */
+static wapi_status_t wapi_send_window(m0804c_handler_t *self, uint8_t socket, const wapi_msg_t *msgs,
+                                      uint16_t num)
+{
+    wapi_socket_t *sock = &PRIV_DATA(self)->sockets[socket];
+    if (0 != AT_OS(self)->pf_sema_take(sock->tx_sema_handle, WAPI_SOCKET_TX_WAIT_TICK))
+    {
+        WAPI_DEBUG_ERR("Socket %u still busy with its previous message", socket);
+        return WAPI_ERR_OTHERS;
+    }
+
+    if (NSEND_BIN_PROBE == sock->nsend_state && wapi_socket_ready(self, socket))
+        wapi_nsend_probe(self, socket);
+    bool is_binary = (NSEND_BIN == sock->nsend_state);
+    uint16_t msg_max = is_binary ? WAPI_NSEND_BIN_CHUNK_MAX : WAPI_NSEND_CHUNK_MAX;
+    for (uint16_t i = 0; i < num; i++)
+    {
+        if (!msgs[i].data || 0 == msgs[i].len || msgs[i].len > msg_max)
+        {
+            AT_OS(self)->pf_sema_give(sock->tx_sema_handle);
+            return WAPI_ERR_PARAM_INVALID;
+        }
+    }
+
+    wapi_status_t status = WAPI_OK;
+    uint16_t done = 0;
+    while (WAPI_OK == status && done < num)
+    {
+        if (!wapi_socket_ready(self, socket))
+        {
+            status = WAPI_ERR_SEND_NOT_READY;
+            break;
+        }
+        uint8_t idx = wapi_send_buf_acquire(self, socket);
+        if (WAPI_SEND_BUF_NUM == idx)
+        {
+            WAPI_DEBUG_ERR("Send buffer still in use by previous transmission");
+            status = WAPI_ERR_OTHERS;
+            break;
+        }
+
+        /* A message of msg_max always fits an empty buffer */
+        at_trans_seg_t segs[WAPI_SEND_BUF_NUM];
+        uint8_t seg_num = 0;
+        uint8_t win = 0;
+        while (idx < WAPI_SEND_BUF_NUM)
+        {
+            segs[seg_num++] = (at_trans_seg_t){
+                .data = PRIV_DATA(self)->wapi_send_buf[idx],
+                .len = 0,
+                .owner = AT_SEG_BORROWED,
+                .pf_release = wapi_send_buf_sent,
+                .release_arg = (void *)self
             };
-            at_trans_send(wapi_get_at_handler(self), file->file_payload + offset, send_len,
-                             &callback);  
+            at_trans_seg_t *seg = &segs[seg_num - 1];
+            while (done + win < num && win < WAPI_SEND_WINDOW)
+            {
+                const wapi_msg_t *msg = &msgs[done + win];
+                uint16_t len = wapi_dgram_pack((uint8_t *)seg->data + seg->len, SEND_BUF_SIZE - seg->len,
+                                               socket, msg->data, msg->len, is_binary);
+                if (!len)
+                    break;
+                seg->len += len;
+                win++;
+            }
+            if (done + win == num || win == WAPI_SEND_WINDOW || seg_num == WAPI_SEND_BUF_NUM ||
+                seg_num == AT_TRANS_SEG_MAX)
+                break;
+            idx = wapi_send_buf_try_acquire(self, socket);
         }
-        else   
+
+        uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+        sock->win_num = win;
+        sock->win_answered = 0;
+        sock->win_err_mask = 0;
+        sock->is_win_waiting = true;
+        UP_OS(self)->pf_os_exit_critical(primask);
+        AT_OS(self)->pf_sema_take(sock->win_sema_handle, 0);   /* Give of a window given up on */
+
+        at_trans_callback_t callback = {
+            .pf_at_recv_parse = {send_window_cb},
+            .arg = (void *)sock,
+            .holder = (void *)self,
+            .receive_count = 1,
+            .lane = sock->param.lane,
+            .trans_type = WAPI_TRANS_NSEND
+        };
+        if (AT_OK != at_trans_sendv(wapi_get_at_handler(self), segs, seg_num, &callback))
         {
-            multi_send_recv_timeout((void *)self);
+            for (uint8_t i = 0; i < seg_num; i++)
+                wapi_send_buf_release(segs[i].data, self);
+            sock->is_win_waiting = false;
+            status = WAPI_ERR_OTHERS;
             break;
         }
+        AT_OS(self)->pf_sema_take(sock->win_sema_handle, SEND_WINDOW_WAIT_TICK);
+
+        primask = UP_OS(self)->pf_os_enter_critical();
+        sock->is_win_waiting = false;
+        uint8_t answered = sock->win_answered;
+        uint8_t err_mask = sock->win_err_mask;
+        UP_OS(self)->pf_os_exit_critical(primask);
+
+        for (uint8_t i = 0; i < win; i++)
+        {
+            const wapi_msg_t *msg = &msgs[done + i];
+            wapi_status_t msg_status = (i >= answered) ? WAPI_ERR_OTHERS :
+                                       (err_mask & (1U << i)) ? WAPI_ERR_SEND_NOT_READY : WAPI_OK;
+            if (WAPI_OK != msg_status && WAPI_OK == status)
+                status = msg_status;
+            if (msg->pf_sent_cb)
+                msg->pf_sent_cb(self, socket, msg->arg, msg_status);
+        }
+        done += win;
+        if (answered < win)
+            WAPI_DEBUG_ERR("Socket %u: %u of %u messages not answered", socket, win - answered, win);
+    }
+    AT_OS(self)->pf_sema_give(sock->tx_sema_handle);
+
+    /* The rest of the messages report why they were not sent */
+    for (uint16_t i = done; i < num; i++)
+    {
+        if (msgs[i].pf_sent_cb)
+            msgs[i].pf_sent_cb(self, socket, msgs[i].arg, WAPI_ERR_SEND_NOT_READY);
+    }
+    return status;
+}
+
+#if WAPI_TX_COALESCE
+static uint16_t wapi_tx_chunk_max(const wapi_socket_t *sock)
+{
+    return (NSEND_BIN == sock->nsend_state) ? WAPI_NSEND_BIN_CHUNK_MAX : WAPI_NSEND_CHUNK_MAX;
+}
+
+/* Producer of wapi_send_stream over the queued bytes, offset counts from the queue tail */
+static uint16_t wapi_tx_produce(m0804c_handler_t *const self, uint32_t offset, uint8_t *dst, uint16_t len,
+                                void *arg)
+{
+    wapi_tx_queue_t *queue = (wapi_tx_queue_t *)arg;
+    uint16_t pos = (uint16_t)(queue->tail + offset) & (WAPI_TX_QUEUE_SIZE - 1);
+    uint16_t first = (len < WAPI_TX_QUEUE_SIZE - pos) ? len : WAPI_TX_QUEUE_SIZE - pos;
+    memcpy(dst, queue->buf + pos, first);
+    memcpy(dst + first, queue->buf, len - first);
+    return len;
+}
+
+/**
+ * Send the queued bytes of socket as one message: whole chunks only, or everything when
+ * is_due. The bytes are given back whatever the outcome, the ones a closed socket or a
+ * failed send loses are added to drop_len.
+ */
+static void wapi_tx_flush(m0804c_handler_t *self, uint8_t socket, bool is_due)
+{
+    wapi_socket_t *sock = &PRIV_DATA(self)->sockets[socket];
+    wapi_tx_queue_t *queue = &sock->tx_queue;
+    uint16_t tail = queue->tail;
+    uint16_t len = (uint16_t)(queue->head - tail);
+
+    if (!wapi_socket_ready(self, socket))
+    {
+        WAPI_DEBUG_ERR("Socket %u closed, %u queued bytes dropped", socket, len);
+        queue->drop_len += len;
+    }
+    else
+    {
+        if (!is_due)
+            len -= len % wapi_tx_chunk_max(sock);
+        if (!len)
+            return;
+        wapi_status_t status = wapi_send_stream(self, socket, len, NULL, wapi_tx_produce, queue, NULL, false);
+        if (WAPI_OK != status)
+        {
+            WAPI_DEBUG_ERR("Socket %u: %u queued bytes not sent (status=%d)", socket, len, status);
+            queue->drop_len += len;
+        }
+    }
+    queue->tail = tail + len;
+}
+
+/**
+ * Coalesces the TX queues. With nothing queued it sleeps until the first byte, a partial chunk
+ * then waits tx_delay_ms for more; the wait ends early once a chunk fills up or on a flush.
+ */
+static void wapi_tx_thread(void *arg)
+{
+    m0804c_handler_t *self = (m0804c_handler_t *)arg;
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+    {
+        WAPI_DEBUG_ERR("TX thread: invalid parameter or not initialized");
+        return;
+    }
+    while (1)
+    {
+        uint8_t pending_mask = 0, full_mask = 0;
+        uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+        for (uint8_t i = 0; i < WAPI_SOCKET_NUM; i++)
+        {
+            wapi_socket_t *sock = &PRIV_DATA(self)->sockets[i];
+            uint16_t pending = (uint16_t)(sock->tx_queue.head - sock->tx_queue.tail);
+            if (pending)
+                pending_mask |= (uint8_t)(1U << i);
+            if (pending >= wapi_tx_chunk_max(sock))
+                full_mask |= (uint8_t)(1U << i);
+        }
+        uint8_t due_mask = PRIV_DATA(self)->tx_flush_mask;
+        PRIV_DATA(self)->tx_flush_mask = 0;
+        PRIV_DATA(self)->is_tx_idle = !pending_mask;
+        UP_OS(self)->pf_os_exit_critical(primask);
+
+        if (!pending_mask)
+        {
+            AT_OS(self)->pf_sema_take(PRIV_DATA(self)->tx_kick_sema_handle, OS_DELAY_MAX);
+            continue;
+        }
+        if (!full_mask && !due_mask)
+        {
+            if (0 == AT_OS(self)->pf_sema_take(PRIV_DATA(self)->tx_kick_sema_handle, PRIV_DATA(self)->tx_delay_ms))
+                continue;   /* A chunk filled up or a flush came in, look again */
+            due_mask = pending_mask;
+        }
+        for (uint8_t i = 0; i < WAPI_SOCKET_NUM; i++)
+        {
+            if (pending_mask & (1U << i))
+                wapi_tx_flush(self, i, 0 != (due_mask & (1U << i)));
+        }
+    }
+}
+#endif
+
+/* Decimal field ended by sep, *p moves past sep; false if malformed */
+static bool parse_dec_field(const uint8_t **p, const uint8_t *end, char sep, uint32_t *value)
+{
+    const uint8_t *pos = *p;
+    uint32_t val = 0;
+    if (pos >= end || *pos < '0' || *pos > '9')
+        return false;
+    while (pos < end && *pos >= '0' && *pos <= '9')
+    {
+        val = val * 10 + (*pos - '0');
+        if (val > UINT16_MAX)
+            return false;
+        pos++;
     }
+    if (pos >= end || sep != *pos)
+        return false;
+    *p = pos + 1;
+    *value = val;
+    return true;
+}
+
+static void wapi_rx_notify_work(m0804c_handler_t *const self, uint8_t *buf, uint16_t len, uint16_t data_len,
+                                void *arg)
+{
+    uint8_t socket = (uint8_t)(uintptr_t)arg;
+    PRIV_DATA(self)->sockets[socket].rx_ring.is_notify_pending = false;
+    uint16_t available = m0804c_recv_available(self, socket);
+    if (available)
+        self->input_arg->callbacks->pf_rx_notify_cb(self, socket, available);
+}
+
+/* Post pf_rx_notify_cb once socket holds its watermark, at most one on its way */
+static void wapi_rx_notify(m0804c_handler_t *self, uint8_t socket)
+{
+    wapi_rx_ring_t *ring = &PRIV_DATA(self)->sockets[socket].rx_ring;
+    if (!self->input_arg->callbacks->pf_rx_notify_cb || ring->is_notify_pending)
+        return;
+    if ((uint16_t)(ring->head - ring->tail) < ring->watermark)
+        return;
+    ring->is_notify_pending = true;
+    if (WAPI_OK != wapi_work_post(self, wapi_rx_notify_work, (void *)(uintptr_t)socket, NULL, 0))
+        ring->is_notify_pending = false;
+}
+
+/**
+ * "+NRECV,<socket>,<len>,<hex>\r\n" on the parse thread: the hex is decoded from the receive
+ * buffer straight into the ring of socket, then published and notified.
+ */
+static void wapi_recv_urc(uint8_t *buf, uint16_t len, void *holder)
+{
+    m0804c_handler_t *self = (m0804c_handler_t *)holder;
+    if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return;
+
+    const uint8_t *p = buf + strlen(M0804C_URC_RECV_DATA);
+    const uint8_t *end = buf + len;
+    while (end > p && ('\r' == end[-1] || '\n' == end[-1]))
+        end--;
+    uint32_t socket, data_len;
+    if (!parse_dec_field(&p, end, ',', &socket) || !parse_dec_field(&p, end, ',', &data_len) ||
+        socket >= WAPI_SOCKET_NUM || 0 == data_len || (uint32_t)(end - p) != 2 * data_len)
+    {
+        WAPI_DEBUG_ERR("Malformed receive push dropped (len=%u)", len);
+        return;
+    }
+
+    wapi_rx_ring_t *ring = &PRIV_DATA(self)->sockets[socket].rx_ring;
+    uint16_t head = ring->head;
+    uint16_t free_len = WAPI_RX_RING_SIZE - (uint16_t)(head - ring->tail);
+    if (data_len > free_len)
+    {
+        WAPI_DEBUG_ERR("Socket %u RX ring full, %u bytes dropped", (unsigned)socket, (unsigned)data_len);
+        return;
+    }
+
+    /* Two runs when the push wraps around the end of the ring */
+    uint16_t pos = head & (WAPI_RX_RING_SIZE - 1);
+    uint16_t first = (data_len < (uint32_t)(WAPI_RX_RING_SIZE - pos)) ? (uint16_t)data_len : WAPI_RX_RING_SIZE - pos;
+    if (hex_decode(p, 2 * first, ring->buf + pos) < 0 ||
+        (data_len > first && hex_decode(p + 2 * first, 2 * (data_len - first), ring->buf) < 0))
+    {
+        WAPI_DEBUG_ERR("Receive push with invalid hex dropped");
+        return;
+    }
+    ring->head = head + (uint16_t)data_len;
+    wapi_rx_notify(self, (uint8_t)socket);
+}
+
+static void wapi_upload_as_cert(m0804c_handler_t *const self)
+{    
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_UPLOAD_CERT_START, "AS");
+}
+
+static void wapi_upload_asue_cert(m0804c_handler_t *const self)
+{
+    AT_CMD_SEND(wapi_get_at_handler(self), M0804C_AT_UPLOAD_CERT_START, "ASUE");
+}
+
+#define CERT_SEG_LEN                        64
+
+/**
+ * Send segment sm.cert_seg of the certificate file being uploaded. Its answer posts
+ * WAPI_EV_CERT_SEG for the next one, the answer of the last one ends the step.
+ */
+static void wapi_cert_seg_send(m0804c_handler_t *self)
+{
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    const file_att_t *file = sm->cert_file;
+    uint8_t cnt = (file->file_append.file_len + CERT_SEG_LEN - 1)/CERT_SEG_LEN;
+    uint32_t offset = CERT_SEG_LEN * sm->cert_seg;
+    uint8_t send_len = CERT_SEG_LEN;
+    pf_at_recv_parse_t pf_at_recv_parse = sync_multi_send;
+
+    if(cnt-1 == sm->cert_seg)
+    {
+        pf_at_recv_parse = multi_send_complete_cb;
+        send_len = file->file_append.file_len - offset;
+        sm->cert_file = NULL;
+    }
+    at_trans_callback_t callback = {
+        .pf_at_recv_parse = {pf_at_recv_parse},
+        .arg = NULL,
+        .holder = (void *)self,
+        .receive_count = 1,
+        .trans_type = WAPI_TRANS_CERT
+    };
+    /* Certificate storage is immutable, send it in place without copy */
+    at_trans_seg_t seg = {
+        .data = file->file_payload + offset,
+        .len = send_len,
+        .owner = AT_SEG_BORROWED,
+        .pf_release = NULL,
+        .release_arg = NULL
+    };
+    if(AT_OK != at_trans_sendv(wapi_get_at_handler(self), &seg, 1, &callback))
+    {
+        WAPI_DEBUG_ERR("Certificate segment %u not sent", sm->cert_seg);
+        sm->cert_file = NULL;
+        wapi_sm_post(self, WAPI_EV_STEP_ERR);
+    }
+}
+
+/* Common function for uploading certificate files in segments, one wapi_sm event per segment */
+static void wapi_upload_cert_file_common(m0804c_handler_t *self, const file_att_t *file)
+{
+    if(!file->file_payload || 0 == file->file_append.file_len)
+    {
+        wapi_sm_post(self, WAPI_EV_STEP_ERR);
+        return;
+    }
+    PRIV_DATA(self)->sm.cert_file = file;
+    PRIV_DATA(self)->sm.cert_seg = 0;
+    wapi_cert_seg_send(self);
+}
+
+/* A segment was answered: the next one goes out within a fresh step deadline */
+static void wapi_sm_cert_seg(m0804c_handler_t *const self)
+{
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    if(SM_PHASE_WAIT != sm->phase || !sm->cert_file)
+    {
+        WAPI_DEBUG_ERR("Late certificate segment answer ignored");
+        return;
+    }
+    sm->cert_seg++;
+    wheel_timer_start(WHEEL(self), &sm->deadline_timer.timer, sm->table[sm->step].recv_timeout_tick);
+    wapi_cert_seg_send(self);
 }
 
 static void wapi_upload_as_cert_file(m0804c_handler_t *const self)
@@ -923,247 +2151,537 @@ static void wapi_upload_asue_cert_file(m0804c_handler_t *const self)
 /* ============================================================================
  * Process Core Functions
  * ============================================================================ */
-static wapi_status_t table_process(m0804c_handler_t *const self, wapi_process_t *const wapi_process,\
-                                     uint8_t table_num, int8_t *const err_index)
+/* Device-unique seed: the static IP differs between devices where the boot tick may not */
+static uint32_t wapi_rand(m0804c_handler_t *const self)
 {
-    if(!self || !wapi_process || !table_num || !err_index)
-        return WAPI_ERR_PARAM_INVALID;
-    uint8_t i=0;
-    for(; i<table_num; i++)
+    uint32_t x = PRIV_DATA(self)->rand_state;
+    if(!x)
     {
-        int32_t ret = AT_OS(self)->pf_sema_take(PRIV_DATA(self)->process_syn_sema_handle, 0);
-        if(0 != ret)
-        {
-            WAPI_DEBUG_ERR("Failed to acquire sync semaphore (index=%u, ret=%d)", i, ret);
-            goto exit;
-        } 
-        bool is_success = false;
-        for(uint8_t j=0; j<AT_ERR_REPEAT_CNT; j++)
-        {
-            if(wapi_process[i].pf_wapi_process_fun)
-                wapi_process[i].pf_wapi_process_fun(self);
-            else
-            {
-                WAPI_DEBUG_ERR("Process function pointer is NULL at index %u", i);
-                goto exit;
-            }
-            /* release in response correct */
-            wapi_recv_state_t wapi_recv_state;            
-            ret = UP_OS(self)->pf_os_queue_get(PRIV_DATA(self)->recv_state_queue_handle,\
-                                                 &wapi_recv_state, wapi_process[i].recv_timeout_tick);
-            if(0 == ret)
-            {
-                if(wapi_recv_state.is_success)
-                {
-                    is_success = true;
-                    if(wapi_process[i].pf_process_cpl)
-                        wapi_process[i].pf_process_cpl(self, i, PROCESS_OK); 
-                    if(wapi_process[i].process_interval_tick)
-                        self->input_arg->os_interface->pf_os_delay_ms((int32_t)wapi_process[i].process_interval_tick);    
-                    ret = AT_OS(self)->pf_sema_give(PRIV_DATA(self)->process_syn_sema_handle);
-                    if(0 != ret)
-                    {
-                        WAPI_DEBUG_ERR("Failed to release sync semaphore (ret=%d)", ret);
-                        goto exit;
-                    }                      
-                    break;
-                }  
-                else if(wapi_process[i].process_interval_tick)
-                {
-                    WAPI_DEBUG_ERR("Process failed, retrying: process_idx=%u, retry=%u", i, j);
-                    self->input_arg->os_interface->pf_os_delay_ms((int32_t)wapi_process[i].process_interval_tick);
-                }
-                                  
-            }                
-            else
-            {
-                WAPI_DEBUG_ERR("Queue get failed: process_idx=%u, status=%d, retry=%u", i, ret, j);
-            }
-        }   
-        if(!is_success)
-        {
-            WAPI_DEBUG_ERR("WAPI process failed after %u retries at index %u", AT_ERR_REPEAT_CNT, i);
-            goto exit;                          
-        }          
-    }    
-    return WAPI_OK;
-    exit:
-        *err_index = i;
-        if(wapi_process[i].pf_process_cpl)
-            wapi_process[i].pf_process_cpl(self, i, PROCESS_ERR); 
-        AT_OS(self)->pf_sema_give(PRIV_DATA(self)->process_syn_sema_handle);    
-        return WAPI_ERR_OTHERS; 
+        wapi_info_t *wapi_info = self->input_arg->data_provider->pf_get_wapi_info(self);
+        x = wapi_now_ms(self) ^ (uint32_t)(uintptr_t)self;
+        if(wapi_info)
+            x ^= ((uint32_t)wapi_info->local_ip[0] << 24 | (uint32_t)wapi_info->local_ip[1] << 16 |
+                  (uint32_t)wapi_info->local_ip[2] << 8 | wapi_info->local_ip[3]) * 0x9E3779B1u;
+        if(!x)
+            x = 1;
+    }
+    /* xorshift32 */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    PRIV_DATA(self)->rand_state = x;
+    return x;
 }
 
-static wapi_status_t generic_process(m0804c_handler_t *const self, wapi_process_t *const process_table,
-                                      uint16_t table_size, const char *process_name)
+/* wait_ms less up to the jitter share of policy */
+static uint32_t wapi_jitter_ms(m0804c_handler_t *const self, const wapi_backoff_t *policy, uint32_t wait_ms)
 {
-    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
-        return WAPI_ERR_PARAM_INVALID;
-    
-    int8_t err_index = -1;
-    uint8_t table_num = table_size / sizeof(wapi_process_t);
-    wapi_status_t ret = WAPI_ERR_OTHERS;
-    
-    for(uint8_t i = 0; i < WAPI_PROCESS_RETRY_MAX; i++)
+    uint32_t spread = (uint32_t)((uint64_t)wait_ms * policy->jitter_pct / 100);
+    if(spread)
+        wait_ms -= wapi_rand(self) % (spread + 1);
+    return wait_ms;
+}
+
+/* n-th wait in a row of policy starting from base_ms, NULL policy: base_ms as it is */
+static uint32_t wapi_backoff_ms(m0804c_handler_t *const self, const wapi_backoff_t *policy,
+                                uint32_t base_ms, uint8_t n)
+{
+    if(!policy || !base_ms)
+        return base_ms;
+    uint32_t wait_ms = base_ms;
+    for(uint8_t i = 0; i < n && wait_ms < policy->cap_ms; i++)
+        wait_ms = (wait_ms > policy->cap_ms / policy->multiplier) ? policy->cap_ms : wait_ms * policy->multiplier;
+    if(wait_ms > policy->cap_ms)
+        wait_ms = policy->cap_ms;
+    return wapi_jitter_ms(self, policy, wait_ms);
+}
+
+#define TABLE_NUM(table)    (uint8_t)(sizeof(table) / sizeof(wapi_process_t))
+
+/* The table of a one-table process, NULL once it succeeded */
+static wapi_process_t *wapi_single_table(m0804c_handler_t *const self, wapi_process_t *table, uint8_t num,
+                                         uint8_t *table_num, uint8_t *run_max)
+{
+    if(PRIV_DATA(self)->sm.table)
+        return NULL;
+    *table_num = num;
+    *run_max = WAPI_PROCESS_RETRY_MAX;
+    return table;
+}
+
+/* Readiness probe once after power on, then the init table */
+static wapi_process_t *init_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max)
+{
+    wapi_process_t *prev = PRIV_DATA(self)->sm.table;
+    if(!prev)
     {
-        ret = table_process(self, process_table, table_num, &err_index);
-        if(WAPI_OK == ret)
+        *table_num = TABLE_NUM(wapi_process_ready);
+        *run_max = 1;   /* A module that never answers is power cycled by the init retry */
+        return wapi_process_ready;
+    }
+    if(wapi_process_ready != prev)
+        return NULL;
+    *table_num = TABLE_NUM(wapi_process_init);
+    *run_max = WAPI_PROCESS_RETRY_MAX;
+    return wapi_process_init;
+}
+
+#if IS_USE_CONN_BY_CERT
+static wapi_process_t *cert_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max)
+{
+    return wapi_single_table(self, wapi_process_use_cert, TABLE_NUM(wapi_process_use_cert), table_num, run_max);
+}
+#endif
+
+#if IS_USE_CONN_BY_PWD
+static wapi_process_t *pwd_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max)
+{
+    return wapi_single_table(self, wapi_process_use_pwd, TABLE_NUM(wapi_process_use_pwd), table_num, run_max);
+}
+#endif
+
+/* Sockets the connect process opens: the configured ones and the default socket */
+static bool wapi_socket_is_used(m0804c_handler_t *const self, uint8_t socket)
+{
+    return WAPI_DEFAULT_SOCKET == socket || PRIV_DATA(self)->sockets[socket].is_configured;
+}
+
+/* Link layer first, then one open table per socket, on proc_socket */
+static wapi_process_t *conn_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max)
+{
+    wapi_process_t *prev = PRIV_DATA(self)->sm.table;
+    if(!prev)
+    {
+        *run_max = WAPI_PROCESS_RETRY_MAX;
+        /* One look at the link, a link that is down goes to the next reconnect tier at once */
+        if(WAPI_RECONN_SOCKET == PRIV_DATA(self)->reconn_tier)
         {
-            WAPI_DEBUG_OUT("%s completed successfully on attempt %u", process_name, i + 1);
-            break;
+            *table_num = TABLE_NUM(wapi_process_check_link);
+            *run_max = 1;
+            return wapi_process_check_link;
         }
-        WAPI_DEBUG_ERR("%s failed: step %u, attempt %u/%u", process_name, err_index, i + 1, WAPI_PROCESS_RETRY_MAX);
+        *table_num = TABLE_NUM(wapi_process_conn_net);
+        return wapi_process_conn_net;
     }
-    
-    return ret;
+    if(wapi_process_open_socket == prev || wapi_process_open_udp_socket == prev)
+        PRIV_DATA(self)->sockets[PRIV_DATA(self)->proc_socket].is_open = true;
+
+    /* A retry keeps the sockets an earlier attempt opened */
+    for(uint8_t i = 0; i < WAPI_SOCKET_NUM; i++)
+    {
+        if(!wapi_socket_is_used(self, i) || PRIV_DATA(self)->sockets[i].is_open)
+            continue;
+        PRIV_DATA(self)->proc_socket = i;
+        *run_max = WAPI_PROCESS_RETRY_MAX;
+        if(WAPI_SOCKET_UDP == PRIV_DATA(self)->sockets[i].param.proto)
+        {
+            *table_num = TABLE_NUM(wapi_process_open_udp_socket);
+            return wapi_process_open_udp_socket;
+        }
+        *table_num = TABLE_NUM(wapi_process_open_socket);
+        return wapi_process_open_socket;
+    }
+    return NULL;
+}
+
+static wapi_process_t *upload_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max)
+{
+    return wapi_single_table(self, wapi_process_upload_certiface, TABLE_NUM(wapi_process_upload_certiface),
+                             table_num, run_max);
+}
+
+/* One close table per open socket, on proc_socket */
+static wapi_process_t *disconn_next_table(m0804c_handler_t *self, uint8_t *table_num, uint8_t *run_max)
+{
+    for(uint8_t i = 0; i < WAPI_SOCKET_NUM; i++)
+    {
+        if(!PRIV_DATA(self)->sockets[i].is_open)
+            continue;
+        /* No new message starts on the socket while it closes */
+        PRIV_DATA(self)->sockets[i].is_open = false;
+        PRIV_DATA(self)->proc_socket = i;
+        *table_num = TABLE_NUM(wapi_process_disconn);
+        *run_max = WAPI_PROCESS_RETRY_MAX;
+        return wapi_process_disconn;
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * Process State Machine
+ * ============================================================================ */
+/* Retry policy of the process, NULL for the ones an API call waits for */
+static const wapi_backoff_t *wapi_sm_policy(m0804c_handler_t *const self, const wapi_process_callbacks_t *cbs)
+{
+    return (cbs->process_type < PROCESS_TYPE_NUM) ? &PRIV_DATA(self)->backoff[cbs->process_type] : NULL;
+}
+
+/* Tick context: hand the expiry to the wapi_sm task, a full queue is tried again next tick */
+static void wapi_sm_timer_cb(void *arg)
+{
+    wapi_sm_timer_t *sm_timer = (wapi_sm_timer_t *)arg;
+    if(WAPI_OK != wapi_sm_post(sm_timer->self, (wapi_sm_event_t)sm_timer->event))
+        wheel_timer_start(WHEEL(sm_timer->self), &sm_timer->timer, TIMER_WHEEL_TICK_MS);
+}
+
+static void wapi_sm_timer_init(m0804c_handler_t *self, wapi_sm_timer_t *sm_timer, uint8_t event)
+{
+    sm_timer->self = self;
+    sm_timer->event = event;
+    wheel_timer_init(&sm_timer->timer, wapi_sm_timer_cb, sm_timer);
+}
+
+/* pf_process_success_cb / pf_process_err_cb on the wapi_work thread, arg: type << 1 | is_success */
+static void wapi_report_work(m0804c_handler_t *const self, uint8_t *buf, uint16_t len, uint16_t data_len,
+                             void *arg)
+{
+    wapi_callback_t *callbacks = self->input_arg->callbacks;
+    uintptr_t code = (uintptr_t)arg;
+    wapi_process_type_t process_type = (wapi_process_type_t)(code >> 1);
+    if(!callbacks)
+        return;
+    if((code & 1) && callbacks->pf_process_success_cb)
+        callbacks->pf_process_success_cb(self, process_type);
+    else if(!(code & 1) && callbacks->pf_process_err_cb)
+        callbacks->pf_process_err_cb(self, process_type);
 }
 
-static wapi_status_t wapi_init_process(m0804c_handler_t *const self)
+static void wapi_sm_report(m0804c_handler_t *const self, wapi_process_type_t process_type, bool is_success)
 {
-    return generic_process(self, wapi_process_init, 
-                          sizeof(wapi_process_init), "init process");
+    wapi_work_post(self, wapi_report_work, (void *)(uintptr_t)(((uintptr_t)process_type << 1) | is_success), NULL, 0);
+}
+
+static void wapi_sm_step_send(m0804c_handler_t *const self);
+static void wapi_sm_table_fail(m0804c_handler_t *const self);
+
+/**
+ * The process ended. A failed one is retried through pf_process_retry once its backoff ran
+ * out, or once per breaker_open_ms with the breaker open.
+ */
+static void wapi_sm_process_done(m0804c_handler_t *const self, wapi_status_t ret)
+{
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    const wapi_process_callbacks_t *cbs = wapi_sm_procs[sm->proc];
+    const wapi_backoff_t *policy = wapi_sm_policy(self, cbs);
+    sm->proc = SM_PROC_NUM;
+    sm->phase = SM_PHASE_IDLE;
+    sm->table = NULL;
+    wheel_timer_stop(WHEEL(self), &sm->deadline_timer.timer);
+    if(!policy)
+    {
+        sm->api_status = ret;
+        AT_OS(self)->pf_sema_give(PRIV_DATA(self)->api_done_sema_handle);
+        return;
+    }
+
+    uint8_t *fail_cnt = &sm->fail_cnt[cbs->process_type];
+    if(WAPI_OK == ret)
+    {
+        WAPI_DEBUG_OUT("%s completed", cbs->process_name);
+        if(policy->breaker_fail_max && *fail_cnt >= policy->breaker_fail_max)
+            WAPI_DEBUG_OUT("%s breaker closed", cbs->process_name);
+        *fail_cnt = 0;
+        wapi_sm_report(self, cbs->process_type, true);
+        if(cbs->pf_process_success)
+            cbs->pf_process_success(self);
+        return;
+    }
+
+    uint32_t wait_ms;
+    if(*fail_cnt < UINT8_MAX)
+        (*fail_cnt)++;
+    if(!policy->breaker_fail_max || *fail_cnt < policy->breaker_fail_max)
+    {
+        WAPI_DEBUG_ERR("%s failed, retry_count=%u/%u", cbs->process_name, *fail_cnt, policy->breaker_fail_max);
+        /* The table runs of this process waited up to n = WAPI_PROCESS_RETRY_MAX - 2 */
+        wait_ms = wapi_backoff_ms(self, policy, policy->base_ms, (uint8_t)(WAPI_PROCESS_RETRY_MAX - 2 + *fail_cnt));
+    }
+    else
+    {
+        WAPI_DEBUG_ERR("%s failed %u times in a row, breaker open", cbs->process_name, *fail_cnt);
+        wapi_sm_report(self, cbs->process_type, false);
+        if(!policy->breaker_open_ms)
+            return;     /* Until the application starts the process again */
+        /* Not bounded by cap_ms, the open time is usually the longer one */
+        wait_ms = wapi_jitter_ms(self, policy, policy->breaker_open_ms);
+    }
+    sm->retry_mask |= (uint8_t)(1u << cbs->process_type);
+    wheel_timer_start(WHEEL(self), &sm->retry_timer[cbs->process_type].timer, wait_ms);
+}
+
+/* Next table of the running process once the previous one succeeded, or the end of it */
+static void wapi_sm_next_table(m0804c_handler_t *const self)
+{
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    sm->table = wapi_sm_procs[sm->proc]->pf_next_table(self, &sm->table_num, &sm->run_max);
+    if(!sm->table)
+    {
+        wapi_sm_process_done(self, sm->status);
+        return;
+    }
+    sm->step = 0;
+    sm->attempt = 0;
+    sm->run = 0;
+    wapi_sm_step_send(self);
+}
+
+/* Go on with the step at sm->step, or with the next table behind the last step */
+static void wapi_sm_resume(m0804c_handler_t *const self)
+{
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    if(sm->step < sm->table_num)
+        wapi_sm_step_send(self);
+    else
+        wapi_sm_next_table(self);
+}
+
+static void wapi_sm_delay(m0804c_handler_t *const self, uint32_t delay_ms)
+{
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    if(!delay_ms)
+    {
+        wapi_sm_resume(self);
+        return;
+    }
+    sm->phase = SM_PHASE_DELAY;
+    wheel_timer_start(WHEEL(self), &sm->deadline_timer.timer, delay_ms);
+}
+
+/* Send the command of the step, its parser posts the answer as WAPI_EV_STEP_OK/ERR */
+static void wapi_sm_step_send(m0804c_handler_t *const self)
+{
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    wapi_process_t *step = &sm->table[sm->step];
+    if(!step->pf_wapi_process_fun)
+    {
+        WAPI_DEBUG_ERR("Process function pointer is NULL at index %u", sm->step);
+        wapi_sm_table_fail(self);
+        return;
+    }
+    sm->phase = SM_PHASE_WAIT;
+    wheel_timer_start(WHEEL(self), &sm->deadline_timer.timer, step->recv_timeout_tick);
+    step->pf_wapi_process_fun(self);
 }
 
-#if IS_USE_CONN_BY_CERT
-static wapi_status_t connect_by_cert_process(m0804c_handler_t *const self)
+/* The table failed at sm->step: run it again after the backoff, or fail the process */
+static void wapi_sm_table_fail(m0804c_handler_t *const self)
 {
-    return generic_process(self, wapi_process_use_cert,
-                          sizeof(wapi_process_use_cert), "use cert process");
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    const wapi_process_callbacks_t *cbs = wapi_sm_procs[sm->proc];
+    const wapi_backoff_t *policy = wapi_sm_policy(self, cbs);
+    if(sm->table[sm->step].pf_process_cpl)
+        sm->table[sm->step].pf_process_cpl(self, sm->step, PROCESS_ERR);
+    WAPI_DEBUG_ERR("%s failed: step %u, attempt %u/%u", cbs->process_name, sm->step, sm->run + 1, sm->run_max);
+    if(++sm->run < sm->run_max)
+    {
+        sm->step = 0;
+        sm->attempt = 0;
+        wapi_sm_delay(self, policy ? wapi_backoff_ms(self, policy, policy->base_ms, sm->run - 1) : 0);
+    }
+    else if(cbs->is_best_effort)
+    {
+        sm->status = WAPI_ERR_OTHERS;
+        wapi_sm_next_table(self);
+    }
+    else
+        wapi_sm_process_done(self, WAPI_ERR_OTHERS);
 }
-#endif
 
-#if IS_USE_CONN_BY_PWD
-static wapi_status_t connect_by_pwd_process(m0804c_handler_t *const self)
+/* Answer of the step, or no answer within its recv_timeout_tick */
+static void wapi_sm_step_done(m0804c_handler_t *const self, bool is_success, bool is_timeout)
 {
-    return generic_process(self, wapi_process_use_pwd,
-                          sizeof(wapi_process_use_pwd), "use pwd process");
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    wapi_process_t *step = &sm->table[sm->step];
+    if(is_success)
+    {
+        if(step->pf_process_cpl)
+            step->pf_process_cpl(self, sm->step, PROCESS_OK);
+        sm->step++;
+        sm->attempt = 0;
+        wapi_sm_delay(self, step->process_interval_tick);
+        return;
+    }
+    /* The readiness probe polls until the module booted */
+    uint8_t attempt_max = (wapi_process_ready == sm->table) ? WAPI_READY_POLL_MAX : AT_ERR_REPEAT_CNT;
+    if(is_timeout)
+        WAPI_DEBUG_ERR("No answer: process_idx=%u, retry=%u", sm->step, sm->attempt);
+    if(++sm->attempt >= attempt_max)
+    {
+        WAPI_DEBUG_ERR("WAPI process failed after %u retries at index %u", attempt_max, sm->step);
+        wapi_sm_table_fail(self);
+        return;
+    }
+    if(is_timeout || !step->process_interval_tick)
+    {
+        wapi_sm_step_send(self);
+        return;
+    }
+    WAPI_DEBUG_ERR("Process failed, retrying: process_idx=%u, retry=%u", sm->step, sm->attempt - 1);
+    wapi_sm_delay(self, wapi_backoff_ms(self, wapi_sm_policy(self, wapi_sm_procs[sm->proc]),
+                                        step->process_interval_tick, sm->attempt - 1));
 }
-#endif
 
-static wapi_status_t connect_net_process(m0804c_handler_t *const self)
+/* Deadline of the running step or delay, stale once the next phase armed the timer again */
+static void wapi_sm_deadline(m0804c_handler_t *const self)
 {
-    return generic_process(self, wapi_process_conn_net,
-                          sizeof(wapi_process_conn_net), "connect process");
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    if(SM_PHASE_IDLE == sm->phase || wheel_timer_is_armed(WHEEL(self), &sm->deadline_timer.timer))
+        return;
+    if(SM_PHASE_WAIT == sm->phase)
+        wapi_sm_step_done(self, false, true);
+    else
+        wapi_sm_resume(self);
 }
 
-static wapi_status_t cert_upload_process(m0804c_handler_t *const self)
+/* Retry of a failed process, stale once the process ran again or its timer was armed again */
+static void wapi_sm_retry(m0804c_handler_t *const self, uint8_t type)
 {
-    return generic_process(self, wapi_process_upload_certiface,
-                          sizeof(wapi_process_upload_certiface), "upload cert process");               
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    if(type >= PROCESS_TYPE_NUM || !(sm->retry_mask & (1u << type)) ||
+       wheel_timer_is_armed(WHEEL(self), &sm->retry_timer[type].timer))
+        return;
+    sm->retry_mask &= (uint8_t)~(1u << type);
+    if(wapi_sm_procs[type]->pf_process_retry)
+        wapi_sm_procs[type]->pf_process_retry(self);
 }
 
-static wapi_status_t disconn_process(m0804c_handler_t *const self)
+static void wapi_sm_event(m0804c_handler_t *const self, uint8_t event)
 {
-    return generic_process(self, wapi_process_disconn,
-                          sizeof(wapi_process_disconn), "close process");
+    if(event >= WAPI_EV_RETRY)
+    {
+        wapi_sm_retry(self, (uint8_t)(event - WAPI_EV_RETRY));
+        return;
+    }
+    switch(event)
+    {
+        case WAPI_EV_STEP_OK:
+        case WAPI_EV_STEP_ERR:
+            if(SM_PHASE_WAIT == PRIV_DATA(self)->sm.phase)
+                wapi_sm_step_done(self, WAPI_EV_STEP_OK == event, false);
+            else
+                WAPI_DEBUG_ERR("Late step answer ignored");
+            break;
+        case WAPI_EV_RECONNECT:
+            wapi_reconnect_work(self);
+            break;
+        case WAPI_EV_DEADLINE:
+            wapi_sm_deadline(self);
+            break;
+        case WAPI_EV_CERT_SEG:
+            wapi_sm_cert_seg(self);
+            break;
+        default:    /* WAPI_EV_KICK, the pending processes are looked at after every event */
+            break;
+    }
 }
 
-/* ============================================================================
- * Thread Functions
- * ============================================================================ */
-/* Generic thread function */
-static void generic_wapi_thread(m0804c_handler_t *self, 
-                                wapi_status_t (*process_fn)(m0804c_handler_t *),
-                                wapi_process_callbacks_t *cbs)
+static void wapi_sm_process_start(m0804c_handler_t *const self, wapi_sm_proc_t proc)
 {
-    uint8_t fail_cnt = 0;
-    while (1)
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    const wapi_process_callbacks_t *cbs = wapi_sm_procs[proc];
+    wapi_sm_cancel(self, proc);
+    if(cbs->process_type < PROCESS_TYPE_NUM)
     {
-        if(cbs && cbs->pf_process_start)
-            cbs->pf_process_start(self);
-
-        wapi_status_t ret = process_fn(self);
-        
-        if(WAPI_OK == ret)
-        {
-            fail_cnt = 0;
-            if(self->input_arg->callbacks && self->input_arg->callbacks->pf_process_success_cb)
-                self->input_arg->callbacks->pf_process_success_cb(self, cbs->process_type);
-            if(cbs && cbs->pf_process_success)
-                cbs->pf_process_success(self);
-        } 
-        else if(fail_cnt < WAPI_PROCESS_FAIL_MAX)
-        {
-            fail_cnt++;
-            WAPI_DEBUG_ERR("%s failed, retry_count=%u/%u", cbs->process_name, fail_cnt, WAPI_PROCESS_FAIL_MAX);
-            if(cbs && cbs->pf_process_retry)
-                cbs->pf_process_retry(self);
-            else if(cbs && cbs->pf_process_start)
-                cbs->pf_process_start(self);
-        }
-        else
-        {
-            WAPI_DEBUG_ERR("%s failed permanently after %u attempts", cbs->process_name, WAPI_PROCESS_FAIL_MAX);
-            if(self->input_arg->callbacks && self->input_arg->callbacks->pf_process_err_cb)
-                self->input_arg->callbacks->pf_process_err_cb(self, cbs->process_type);
-        }
+        sm->retry_mask &= (uint8_t)~(1u << cbs->process_type);  /* This run is the retry */
+        wheel_timer_stop(WHEEL(self), &sm->retry_timer[cbs->process_type].timer);
     }
+    sm->proc = proc;
+    sm->status = WAPI_OK;
+    sm->table = NULL;
+    if(cbs->pf_process_start)
+        cbs->pf_process_start(self);
+    wapi_sm_next_table(self);
 }
 
-static void wapi_init_thread(void *arg)
+/* Start the pending processes in wapi_sm_proc_t order, authentication on an initialized module */
+static void wapi_sm_schedule(m0804c_handler_t *const self)
 {
-    m0804c_handler_t *self = (m0804c_handler_t *)arg;    
-    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+    wapi_sm_t *sm = &PRIV_DATA(self)->sm;
+    while(SM_PROC_NUM == sm->proc)
     {
-        WAPI_DEBUG_ERR("Init thread: invalid parameter or not initialized");
-        return;
+        uint8_t proc = 0;
+        for(; proc < SM_PROC_NUM; proc++)
+        {
+            if(!(sm->pending & (1u << proc)) || !wapi_sm_procs[proc])
+                continue;
+            if((SM_PROC_CERT_AUTH == proc || SM_PROC_PWD_AUTH == proc) && !sm->is_module_ready)
+                continue;
+            break;
+        }
+        if(proc >= SM_PROC_NUM)
+            break;
+        wapi_sm_process_start(self, (wapi_sm_proc_t)proc);
     }
-    generic_wapi_thread(self, wapi_init_process,
-                       &init_callbacks);
 }
 
-#if IS_USE_CONN_BY_CERT
-static void wapi_use_cert_thread(void *arg)
+/* Run proc on the wapi_sm task and wait for its result, one such API call at a time */
+static wapi_status_t wapi_sm_call(m0804c_handler_t *const self, wapi_sm_proc_t proc)
 {
-    m0804c_handler_t *self = (m0804c_handler_t *)arg;    
-    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
-    {
-        WAPI_DEBUG_ERR("Cert thread: invalid parameter or not initialized");
-        return;
-    }   
-    generic_wapi_thread(self, connect_by_cert_process,
-                       &conn_cfg_by_cert_callbacks);
+    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->api_lock_sema_handle, OS_DELAY_MAX);
+    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->api_done_sema_handle, 0);
+    wapi_sm_request(self, proc);
+    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->api_done_sema_handle, OS_DELAY_MAX);
+    wapi_status_t ret = PRIV_DATA(self)->sm.api_status;
+    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->api_lock_sema_handle);
+    return ret;
 }
-#endif
 
-#if IS_USE_CONN_BY_PWD
-static void wapi_use_pwd_thread(void *arg)
+/* ============================================================================
+ * Thread Functions
+ * ============================================================================ */
+/**
+ * Runs every process: waits for a step answer, an API request or an expired wheel timer and
+ * moves the running process on, it never waits for an answer itself. A step command may
+ * still queue on the AT send channel, up to AT_CHAN_WAIT_TICK while another sender holds it.
+ */
+static void wapi_sm_thread(void *arg)
 {
     m0804c_handler_t *self = (m0804c_handler_t *)arg;    
     if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
     {
-        WAPI_DEBUG_ERR("Pwd thread: invalid parameter or not initialized");
+        WAPI_DEBUG_ERR("SM thread: invalid parameter or not initialized");
         return;
     }    
-    generic_wapi_thread(self, connect_by_pwd_process,
-                       &conn_cfg_by_pwd_callbacks);
+    uint8_t event;
+    while (1)
+    {
+        if (0 == UP_OS(self)->pf_os_queue_get(PRIV_DATA(self)->sm_queue_handle, &event, OS_DELAY_MAX))
+            wapi_sm_event(self, event);
+        wapi_sm_schedule(self);
+    }
 }
-#endif
 
-static void wapi_conn_thread(void *arg)
+/* Runs work posted from the UART parse thread */
+static void wapi_work_thread(void *arg)
 {
     m0804c_handler_t *self = (m0804c_handler_t *)arg;    
     if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
     {
-        WAPI_DEBUG_ERR("Conn thread: invalid parameter or not initialized");
+        WAPI_DEBUG_ERR("Work thread: invalid parameter or not initialized");
         return;
     }    
-    generic_wapi_thread(self, connect_net_process,
-                       &conn_callbacks);
+    wapi_work_t work;
+    while (1)
+    {
+        if (0 != UP_OS(self)->pf_os_queue_get(PRIV_DATA(self)->work_queue_handle, &work, OS_DELAY_MAX))
+            continue;
+        if (work.pf_work)
+            work.pf_work(self, work.data, work.len, work.data_len, work.arg);
+    }
 }
 
-static wapi_status_t m0804c_start_recv(m0804c_handler_t *const self)
+static wapi_status_t m0804c_start_recv(m0804c_handler_t *const self, uint8_t socket)
 {
     if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return WAPI_ERR_HANDLER_NOT_READY;
     char send_buf[32] = {0};
-    int total_len = sprintf(send_buf, "AT+NRECV,%d,1,1\r\n", CUR_SOCKET);
+    int total_len = sprintf(send_buf, "AT+NRECV,%d,1,1\r\n", socket);
     at_trans_callback_t callback = {
         .pf_at_recv_parse = {check_connect},
         .arg = NULL,
         .holder = (void *)self,
-        .receive_count = 1
+        .receive_count = 1,
+        .trans_type = WAPI_TRANS_NRECV
     };
     at_status_t status = at_trans_send(wapi_get_at_handler(self), (uint8_t *)send_buf,
                                          total_len, &callback);
@@ -1171,6 +2689,24 @@ static wapi_status_t m0804c_start_recv(m0804c_handler_t *const self)
 }
 
 
+/* Undo the allocations of m0804c_inst made before at_inst succeeded */
+static void m0804c_inst_rollback(m0804c_handler_t *const self, wapi_m0804c_input_arg_t *const p_input_args,
+                                 size_t arena_mark)
+{
+    if (p_input_args->at_input_arg->at_cmd_set_table == &PRIV_DATA(self)->at_cmd_set_table_copy)
+        p_input_args->at_input_arg->at_cmd_set_table = NULL;
+    if (PRIV_DATA(self)->at_handler)
+        INST_FREE(p_input_args, PRIV_DATA(self)->at_handler);
+    INST_FREE(p_input_args, PRIV_DATA(self));
+    PRIV_DATA(self) = NULL;
+#if (UART_PROTO_STATIC_ALLOC)
+    mem_arena_rewind(p_input_args->arena, arena_mark);
+#else
+    (void)p_input_args;
+    (void)arena_mark;
+#endif
+}
+
 wapi_status_t m0804c_inst(m0804c_handler_t *const self, wapi_m0804c_input_arg_t *const p_input_args)
 {
     /* Comprehensive input validation */
@@ -1178,6 +2714,9 @@ wapi_status_t m0804c_inst(m0804c_handler_t *const self, wapi_m0804c_input_arg_t
        !p_input_args->os_interface|| 
        !p_input_args->os_interface->pf_os_delay_ms||  
        !p_input_args->at_input_arg ||
+       !p_input_args->at_input_arg->timer_wheel ||
+       !p_input_args->at_input_arg->at_os_interface ||
+       !p_input_args->at_input_arg->at_os_interface->pf_sema_counting_create ||
        !p_input_args->pwr_ops ||
        !p_input_args->pwr_ops->pf_m0804c_open ||
        !p_input_args->pwr_ops->pf_m0804c_close ||
@@ -1189,20 +2728,32 @@ wapi_status_t m0804c_inst(m0804c_handler_t *const self, wapi_m0804c_input_arg_t
         return WAPI_ERR_PARAM_INVALID;
     }
     
+    size_t arena_mark = 0;
+#if (UART_PROTO_STATIC_ALLOC)
+    if (!p_input_args->arena)
+        return WAPI_ERR_PARAM_INVALID;
+    /* One arena for the whole stack, lower layers carve their storage from it too */
+    if (!p_input_args->at_input_arg->arena)
+        p_input_args->at_input_arg->arena = p_input_args->arena;
+    arena_mark = mem_arena_mark(p_input_args->arena);
+#endif
+
     /* Allocate private data and at_handler for this instance */
-    PRIV_DATA(self) = (m0804c_priv_data_t *)MALLOC(sizeof(m0804c_priv_data_t));
+    PRIV_DATA(self) = (m0804c_priv_data_t *)INST_ALLOC(p_input_args, sizeof(m0804c_priv_data_t));
     if (!PRIV_DATA(self))
         return WAPI_ERR_OTHERS;
 
     memset(PRIV_DATA(self), 0, sizeof(m0804c_priv_data_t));
 
     /* Allocate at_handler */
-    PRIV_DATA(self)->at_handler = (at_handler_t *)MALLOC(sizeof(at_handler_t));
+    PRIV_DATA(self)->at_handler = (at_handler_t *)INST_ALLOC(p_input_args, sizeof(at_handler_t));
     if (!PRIV_DATA(self)->at_handler)
     {
-        FREE(PRIV_DATA(self));
+        m0804c_inst_rollback(self, p_input_args, arena_mark);
         return WAPI_ERR_OTHERS;
     }   
+    /* at_inst checks the private pointer for re-init, must start NULL */
+    memset(PRIV_DATA(self)->at_handler, 0, sizeof(at_handler_t));
 
     if(p_input_args->at_input_arg->at_cmd_set_table)
     {
@@ -1219,132 +2770,128 @@ wapi_status_t m0804c_inst(m0804c_handler_t *const self, wapi_m0804c_input_arg_t
     at_status_t at_status = at_inst(PRIV_DATA(self)->at_handler, at_arg);   
     if(AT_OK != at_status)
     {
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        m0804c_inst_rollback(self, p_input_args, arena_mark);
         return WAPI_ERR_OTHERS;
     }
     self->input_arg = p_input_args;
 
-    int32_t ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->process_syn_sema_handle);
+    /**
+     * From here on the AT parse thread and the WAPI threads reference the instance,
+     * a failure leaves it allocated and not initialized (public APIs refuse it).
+     */
+
+    int32_t ret;
+    ret = AT_OS(self)->pf_sema_counting_create(&PRIV_DATA(self)->send_buf_free_sema_handle,
+                                               WAPI_SEND_BUF_NUM, WAPI_SEND_BUF_NUM);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("process_syn_sema creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("send_buf_free_sema creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->process_syn_sema_handle);
 
-    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->multi_send_syn_sema_handle);
+    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->probe_lock_sema_handle);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("multi_send_syn_sema creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("probe_lock_sema creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->multi_send_syn_sema_handle);
+    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->probe_lock_sema_handle);
 
-    ret = UP_OS(self)->pf_os_queue_create(1, sizeof(wapi_recv_state_t), &PRIV_DATA(self)->recv_state_queue_handle);
-    if(0 != ret)
+    for(uint8_t i = 0; i < WAPI_SOCKET_NUM; i++)
     {
-        WAPI_DEBUG_ERR("recv_state_queue creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
-        return WAPI_ERR_OTHERS;
+        ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->sockets[i].tx_sema_handle);
+        if(0 != ret)
+        {
+            WAPI_DEBUG_ERR("socket %u tx_sema creation failed (ret=%d)", i, ret);
+            return WAPI_ERR_OTHERS;
+        }
+        AT_OS(self)->pf_sema_give(PRIV_DATA(self)->sockets[i].tx_sema_handle);
+
+        ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->sockets[i].win_sema_handle);
+        if(0 != ret)
+        {
+            WAPI_DEBUG_ERR("socket %u win_sema creation failed (ret=%d)", i, ret);
+            return WAPI_ERR_OTHERS;
+        }
+        AT_OS(self)->pf_sema_take(PRIV_DATA(self)->sockets[i].win_sema_handle, 0);
+
+        ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->sockets[i].probe_done_sema_handle);
+        if(0 != ret)
+        {
+            WAPI_DEBUG_ERR("socket %u probe_done_sema creation failed (ret=%d)", i, ret);
+            return WAPI_ERR_OTHERS;
+        }
+        AT_OS(self)->pf_sema_take(PRIV_DATA(self)->sockets[i].probe_done_sema_handle, 0);
     }
 
-    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->init_start_sema_handle);
+    ret = UP_OS(self)->pf_os_queue_create(WAPI_WORK_QUEUE_LEN, sizeof(wapi_work_t), &PRIV_DATA(self)->work_queue_handle);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("init_start_sema creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("work_queue creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->init_start_sema_handle, 0);
-    
-    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->init_success_sema_handle);
+
+    ret = UP_OS(self)->pf_os_thread_create("wapi_work", wapi_work_thread, WAPI_THREAD_STACK_SIZE, \
+                WAPI_THREAD_PRIORITY, NULL, self);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("init_success_sema creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("wapi_work_thread creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->init_success_sema_handle, 0);
-    
-#if IS_USE_CONN_BY_CERT
-    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->use_cert_sema_handle);
+
+    memcpy(PRIV_DATA(self)->backoff, wapi_backoff_default, sizeof(wapi_backoff_default));
+
+#if WAPI_TX_COALESCE
+    PRIV_DATA(self)->tx_delay_ms = WAPI_TX_DELAY_MS;
+    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->tx_kick_sema_handle);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("use_cert_sema creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("tx_kick_sema creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->use_cert_sema_handle, 0);
-    
-    ret = UP_OS(self)->pf_os_thread_create("use_cert", wapi_use_cert_thread, WAPI_THREAD_STACK_SIZE, \
+    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->tx_kick_sema_handle, 0);
+
+    ret = UP_OS(self)->pf_os_thread_create("wapi_tx", wapi_tx_thread, WAPI_THREAD_STACK_SIZE, \
                 WAPI_THREAD_PRIORITY, NULL, self);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("wapi_use_cert_thread creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("wapi_tx_thread creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
 #endif
-    
-#if IS_USE_CONN_BY_PWD
-    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->use_pwd_sema_handle);
-    if(0 != ret)
-    {
-        WAPI_DEBUG_ERR("use_pwd_sema creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
-        return WAPI_ERR_OTHERS;
-    }
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->use_pwd_sema_handle, 0);
-    
-    ret = UP_OS(self)->pf_os_thread_create("use_pwd", wapi_use_pwd_thread, WAPI_THREAD_STACK_SIZE, \
-                WAPI_THREAD_PRIORITY, NULL, self);
+
+    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->api_lock_sema_handle);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("wapi_use_pwd_thread creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("api_lock_sema creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
-#endif
-    
-    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->connect_cfg_success_sema_handle);
+    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->api_lock_sema_handle);
+
+    ret = AT_OS(self)->pf_sema_binary_create(&PRIV_DATA(self)->api_done_sema_handle);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("connect_cfg_success_sema creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("api_done_sema creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
-    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->connect_cfg_success_sema_handle, 0);
+    AT_OS(self)->pf_sema_take(PRIV_DATA(self)->api_done_sema_handle, 0);
 
-    ret = UP_OS(self)->pf_os_thread_create("wapi_init", wapi_init_thread, WAPI_THREAD_STACK_SIZE, \
-                WAPI_THREAD_PRIORITY, NULL, self);
+    ret = UP_OS(self)->pf_os_queue_create(WAPI_SM_QUEUE_LEN, sizeof(uint8_t), &PRIV_DATA(self)->sm_queue_handle);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("wapi_init_thread creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("sm_queue creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
 
-    ret = UP_OS(self)->pf_os_thread_create("wapi_conn", wapi_conn_thread, WAPI_THREAD_STACK_SIZE, \
+    PRIV_DATA(self)->sm.proc = SM_PROC_NUM;
+    wapi_sm_timer_init(self, &PRIV_DATA(self)->sm.deadline_timer, WAPI_EV_DEADLINE);
+    for(uint8_t i = 0; i < PROCESS_TYPE_NUM; i++)
+        wapi_sm_timer_init(self, &PRIV_DATA(self)->sm.retry_timer[i], (uint8_t)(WAPI_EV_RETRY + i));
+    ret = UP_OS(self)->pf_os_thread_create("wapi_sm", wapi_sm_thread, WAPI_THREAD_STACK_SIZE, \
                 WAPI_THREAD_PRIORITY, NULL, self);
     if(0 != ret)
     {
-        WAPI_DEBUG_ERR("wapi_conn_thread creation failed (ret=%d)", ret);
-        FREE(PRIV_DATA(self)->at_handler);
-        FREE(PRIV_DATA(self));
+        WAPI_DEBUG_ERR("wapi_sm_thread creation failed (ret=%d)", ret);
         return WAPI_ERR_OTHERS;
     }
 
@@ -1368,11 +2915,45 @@ void m0804c_at_error_recv_isr_cb(m0804c_handler_t *const self)
     at_error_recv_isr_cb(wapi_get_at_handler(self));
 }
 
+#if AT_LATENCY_STATS
+static void wapi_lat_print(const char *kind, uint8_t id, const at_lat_stats_t *st)
+{
+    if (!st->send_cnt)
+        return;
+    const at_lat_hist_t *tx = &st->hist[AT_LAT_TX_DONE];
+    const at_lat_hist_t *rsp = &st->hist[AT_LAT_FIRST_RSP];
+    const at_lat_hist_t *done = &st->hist[AT_LAT_COMPLETE];
+    WAPI_DEBUG_OUT("LAT %s %u: send=%u done=%u timeout=%u retry=%u", kind, id,
+                   st->send_cnt, st->done_cnt, st->timeout_cnt, st->retry_cnt);
+    WAPI_DEBUG_OUT("    tx p50<=%u max=%u, rsp p50<=%u p90<=%u max=%u, done p50<=%u p90<=%u p99<=%u max=%u ms",
+                   at_lat_percentile(tx, 50), tx->max_ms,
+                   at_lat_percentile(rsp, 50), at_lat_percentile(rsp, 90), rsp->max_ms,
+                   at_lat_percentile(done, 50), at_lat_percentile(done, 90),
+                   at_lat_percentile(done, 99), done->max_ms);
+}
+
+void m0804c_lat_report(m0804c_handler_t *const self)
+{
+    at_handler_t *at = wapi_get_at_handler(self);
+    at_lat_stats_t st;
+    for (uint8_t i = 0; i < sizeof(m0804c_at_table) / sizeof(m0804c_at_table[0]); i++)
+    {
+        if (AT_OK == at_lat_snapshot(at, false, m0804c_at_table[i].at_func, &st))
+            wapi_lat_print("cmd", m0804c_at_table[i].at_func, &st);
+    }
+    for (uint8_t type = 0; type < WAPI_TRANS_TYPE_NUM; type++)
+    {
+        if (AT_OK == at_lat_snapshot(at, true, type, &st))
+            wapi_lat_print("trans", type, &st);
+    }
+}
+#endif
+
 wapi_status_t m0804c_init(m0804c_handler_t *const self)
 {
     if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return WAPI_ERR_HANDLER_NOT_READY;
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->init_start_sema_handle);    
+    wapi_sm_request(self, SM_PROC_INIT);
     return WAPI_OK;
 }
 #if IS_USE_CONN_BY_CERT
@@ -1381,7 +2962,7 @@ wapi_status_t m0804c_use_cert_conn(m0804c_handler_t *const self)
 
     if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return WAPI_ERR_HANDLER_NOT_READY;
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->use_cert_sema_handle);    
+    wapi_sm_request(self, SM_PROC_CERT_AUTH);
     return WAPI_OK;
 }
 #endif
@@ -1392,30 +2973,282 @@ wapi_status_t m0804c_use_pwd_conn(m0804c_handler_t *const self)
 
     if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return WAPI_ERR_HANDLER_NOT_READY;
-    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->use_pwd_sema_handle);    
+    wapi_sm_request(self, SM_PROC_PWD_AUTH);
     return WAPI_OK;
 }
 #endif
 
-wapi_status_t m0804c_send(m0804c_handler_t *const self, uint8_t *buf, uint16_t length,
+wapi_status_t m0804c_set_backoff(m0804c_handler_t *const self, wapi_process_type_t process_type,
+                                 const wapi_backoff_t *policy)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(process_type >= PROCESS_TYPE_NUM)
+        return WAPI_ERR_PARAM_INVALID;
+    if(!policy)
+        policy = &wapi_backoff_default[process_type];
+    else if(!policy->multiplier || policy->jitter_pct > 100 || policy->base_ms > policy->cap_ms)
+        return WAPI_ERR_PARAM_INVALID;
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    PRIV_DATA(self)->backoff[process_type] = *policy;
+    UP_OS(self)->pf_os_exit_critical(primask);
+    return WAPI_OK;
+}
+
+wapi_status_t m0804c_get_reconn_stats(m0804c_handler_t *const self, wapi_reconn_stats_t *stats)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(!stats)
+        return WAPI_ERR_PARAM_INVALID;
+    *stats = PRIV_DATA(self)->reconn_stats;
+    return WAPI_OK;
+}
+
+wapi_status_t m0804c_get_boot_ms(m0804c_handler_t *const self, uint32_t *boot_ms)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(!boot_ms)
+        return WAPI_ERR_PARAM_INVALID;
+    *boot_ms = PRIV_DATA(self)->boot_ms;
+    return WAPI_OK;
+}
+
+wapi_status_t m0804c_socket_config(m0804c_handler_t *const self, uint8_t socket, const wapi_socket_param_t *param)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || (param && param->lane >= AT_LANE_NUM))
+        return WAPI_ERR_PARAM_INVALID;
+
+    wapi_socket_t *sock = &PRIV_DATA(self)->sockets[socket];
+    if(param)
+        sock->param = *param;
+    else
+        memset(&sock->param, 0, sizeof(sock->param));
+    sock->is_configured = (NULL != param);
+    return WAPI_OK;
+}
+
+bool m0804c_socket_is_open(m0804c_handler_t *const self, uint8_t socket)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited || socket >= WAPI_SOCKET_NUM)
+        return false;
+    return wapi_socket_ready(self, socket);
+}
+
+wapi_status_t m0804c_send(m0804c_handler_t *const self, uint8_t socket, uint8_t *buf, uint16_t length,
                          pf_at_recv_parse_t recv_parse_cb)
 {
     if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || WAPI_SOCKET_UDP == PRIV_DATA(self)->sockets[socket].param.proto)
+        return WAPI_ERR_PARAM_INVALID;
+
+    if(wapi_socket_ready(self, socket))
+        return wapi_send_stream(self, socket, length, buf, NULL, NULL, recv_parse_cb, true);
+    else
+        return WAPI_ERR_SEND_NOT_READY;
+}
+
+wapi_status_t m0804c_send_stream(m0804c_handler_t *const self, uint8_t socket, uint32_t length,
+                                 pf_m0804c_produce_t producer, void *arg, pf_at_recv_parse_t recv_parse_cb)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(!producer || socket >= WAPI_SOCKET_NUM || WAPI_SOCKET_UDP == PRIV_DATA(self)->sockets[socket].param.proto)
+        return WAPI_ERR_PARAM_INVALID;
+
+    if(wapi_socket_ready(self, socket))
+        return wapi_send_stream(self, socket, length, NULL, producer, arg, recv_parse_cb, true);
+    else
+        return WAPI_ERR_SEND_NOT_READY;
+}
+
+wapi_status_t m0804c_sendto_batch(m0804c_handler_t *const self, uint8_t socket, const wapi_dgram_t *dgrams,
+                                  uint16_t num)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || WAPI_SOCKET_UDP != PRIV_DATA(self)->sockets[socket].param.proto ||
+       !dgrams || !num)
+        return WAPI_ERR_PARAM_INVALID;
+
+    if(wapi_socket_ready(self, socket))
+        return wapi_sendto_batch(self, socket, dgrams, num);
+    else
+        return WAPI_ERR_SEND_NOT_READY;
+}
+
+wapi_status_t m0804c_sendto(m0804c_handler_t *const self, uint8_t socket, const uint8_t *buf, uint16_t length)
+{
+    wapi_dgram_t dgram = {.data = buf, .len = length};
+    return m0804c_sendto_batch(self, socket, &dgram, 1);
+}
 
-    if(PRIV_DATA(self)->trans_send_flag)    
-        return wapi_send_data(self, buf, length, recv_parse_cb);
+wapi_status_t m0804c_send_window(m0804c_handler_t *const self, uint8_t socket, const wapi_msg_t *msgs,
+                                 uint16_t num)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || !msgs || !num)
+        return WAPI_ERR_PARAM_INVALID;
+
+    if(wapi_socket_ready(self, socket))
+        return wapi_send_window(self, socket, msgs, num);
     else
         return WAPI_ERR_SEND_NOT_READY;
 }
 
-wapi_status_t m0804c_send_without_response(m0804c_handler_t *const self, uint8_t *buf, uint16_t length)
+#if WAPI_TX_COALESCE
+wapi_status_t m0804c_send_async(m0804c_handler_t *const self, uint8_t socket, const uint8_t *buf,
+                                uint16_t length)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || !buf || !length || WAPI_SOCKET_UDP == PRIV_DATA(self)->sockets[socket].param.proto)
+        return WAPI_ERR_PARAM_INVALID;
+    if(!wapi_socket_ready(self, socket))
+        return WAPI_ERR_SEND_NOT_READY;
+
+    wapi_socket_t *sock = &PRIV_DATA(self)->sockets[socket];
+    wapi_tx_queue_t *queue = &sock->tx_queue;
+    uint16_t chunk_max = wapi_tx_chunk_max(sock);
+    bool is_kick = false;
+
+    /* Messages are small, copied under the lock so concurrent senders stay whole */
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    uint16_t head = queue->head;
+    uint16_t pending = (uint16_t)(head - queue->tail);
+    if(length > WAPI_TX_QUEUE_SIZE - pending)
+    {
+        UP_OS(self)->pf_os_exit_critical(primask);
+        return WAPI_ERR_QUEUE_FULL;
+    }
+    uint16_t pos = head & (WAPI_TX_QUEUE_SIZE - 1);
+    uint16_t first = (length < WAPI_TX_QUEUE_SIZE - pos) ? length : WAPI_TX_QUEUE_SIZE - pos;
+    memcpy(queue->buf + pos, buf, first);
+    memcpy(queue->buf, buf + first, length - first);
+    queue->head = head + length;
+    /* Woken for the first byte and for a chunk filling up, not for every message */
+    if(PRIV_DATA(self)->is_tx_idle || (pending < chunk_max && pending + length >= chunk_max))
+    {
+        PRIV_DATA(self)->is_tx_idle = false;
+        is_kick = true;
+    }
+    UP_OS(self)->pf_os_exit_critical(primask);
+
+    if(is_kick)
+        AT_OS(self)->pf_sema_give(PRIV_DATA(self)->tx_kick_sema_handle);
+    return WAPI_OK;
+}
+
+wapi_status_t m0804c_send_flush(m0804c_handler_t *const self, uint8_t socket)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM)
+        return WAPI_ERR_PARAM_INVALID;
+
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    PRIV_DATA(self)->tx_flush_mask |= (uint8_t)(1U << socket);
+    UP_OS(self)->pf_os_exit_critical(primask);
+    AT_OS(self)->pf_sema_give(PRIV_DATA(self)->tx_kick_sema_handle);
+    return WAPI_OK;
+}
+
+wapi_status_t m0804c_set_tx_delay(m0804c_handler_t *const self, uint32_t delay_ms)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    PRIV_DATA(self)->tx_delay_ms = delay_ms;    /* Applies from the next wait */
+    return WAPI_OK;
+}
+
+wapi_status_t m0804c_get_tx_dropped(m0804c_handler_t *const self, uint8_t socket, uint32_t *drop_len)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || !drop_len)
+        return WAPI_ERR_PARAM_INVALID;
+    *drop_len = PRIV_DATA(self)->sockets[socket].tx_queue.drop_len;
+    return WAPI_OK;
+}
+#endif
+
+wapi_status_t m0804c_set_send_mode(m0804c_handler_t *const self, uint8_t socket, wapi_send_mode_t mode)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || (WAPI_SEND_MODE_HEX != mode && WAPI_SEND_MODE_BINARY != mode))
+        return WAPI_ERR_PARAM_INVALID;
+
+    /* A module that has accepted binary is not asked again, a rejected one is */
+    uint32_t primask = UP_OS(self)->pf_os_enter_critical();
+    if(WAPI_SEND_MODE_HEX == mode)
+        PRIV_DATA(self)->sockets[socket].nsend_state = NSEND_HEX;
+    else if(NSEND_BIN != PRIV_DATA(self)->sockets[socket].nsend_state)
+        PRIV_DATA(self)->sockets[socket].nsend_state = NSEND_BIN_PROBE;
+    UP_OS(self)->pf_os_exit_critical(primask);
+    return WAPI_OK;
+}
+
+wapi_send_mode_t m0804c_get_send_mode(m0804c_handler_t *const self, uint8_t socket)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited || socket >= WAPI_SOCKET_NUM)
+        return WAPI_SEND_MODE_HEX;
+    return (NSEND_BIN == PRIV_DATA(self)->sockets[socket].nsend_state) ? WAPI_SEND_MODE_BINARY : WAPI_SEND_MODE_HEX;
+}
+
+wapi_status_t m0804c_recv(m0804c_handler_t *const self, uint8_t socket, uint8_t *buf, uint16_t len,
+                          uint16_t *recv_len)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || !buf || !recv_len)
+        return WAPI_ERR_PARAM_INVALID;
+
+    wapi_rx_ring_t *ring = &PRIV_DATA(self)->sockets[socket].rx_ring;
+    uint16_t tail = ring->tail;
+    uint16_t available = (uint16_t)(ring->head - tail);
+    uint16_t copy_len = (len < available) ? len : available;
+    uint16_t pos = tail & (WAPI_RX_RING_SIZE - 1);
+    uint16_t first = (copy_len < WAPI_RX_RING_SIZE - pos) ? copy_len : WAPI_RX_RING_SIZE - pos;
+    memcpy(buf, ring->buf + pos, first);
+    memcpy(buf + first, ring->buf, copy_len - first);
+    ring->tail = tail + copy_len;   /* Space goes back to the parse thread after the copy */
+    *recv_len = copy_len;
+    return WAPI_OK;
+}
+
+uint16_t m0804c_recv_available(m0804c_handler_t *const self, uint8_t socket)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited || socket >= WAPI_SOCKET_NUM)
+        return 0;
+    return (uint16_t)(PRIV_DATA(self)->sockets[socket].rx_ring.head - PRIV_DATA(self)->sockets[socket].rx_ring.tail);
+}
+
+wapi_status_t m0804c_set_rx_watermark(m0804c_handler_t *const self, uint8_t socket, uint16_t watermark)
 {
     if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || watermark > WAPI_RX_RING_SIZE)
+        return WAPI_ERR_PARAM_INVALID;
+    PRIV_DATA(self)->sockets[socket].rx_ring.watermark = watermark;
+    return WAPI_OK;
+}
+
+wapi_status_t m0804c_send_without_response(m0804c_handler_t *const self, uint8_t socket, uint8_t *buf,
+                                           uint16_t length)
+{
+    if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return WAPI_ERR_HANDLER_NOT_READY;
+    if(socket >= WAPI_SOCKET_NUM || WAPI_SOCKET_UDP == PRIV_DATA(self)->sockets[socket].param.proto)
+        return WAPI_ERR_PARAM_INVALID;
 
-    if(PRIV_DATA(self)->trans_send_flag)    
-        return wapi_send_data_without_response(self, buf, length);
+    if(wapi_socket_ready(self, socket))
+        return wapi_send_stream(self, socket, length, buf, NULL, NULL, NULL, false);
     else
         return WAPI_ERR_SEND_NOT_READY;
 }
@@ -1430,14 +3263,14 @@ wapi_status_t m0804c_cert_upload(m0804c_handler_t *const self)
     if(!wapi_info->is_exist_certicate)  
         return WAPI_ERR_MISS_CERT;
     reset_wapi_state(self);
-    return cert_upload_process(self);      
+    return wapi_sm_call(self, SM_PROC_CERT_UPLOAD);
 }
 
 wapi_status_t m0804c_disconn(m0804c_handler_t *const self)
 {
     if(!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
         return WAPI_ERR_HANDLER_NOT_READY;
-    return disconn_process(self);
+    return wapi_sm_call(self, SM_PROC_DISCONN);
 }
 
 /* return true when valid, others invalid */
@@ -0,0 +1,273 @@
+/**
+ * @file hex_bench.c
+ * @brief Host benchmark and self-check of the hex codec (hex_codec.h)
+ *
+ * Times hex_encode against the per-nibble encoders it replaced in WAPI_M0804C.c on the
+ * NSEND chunk size and a few larger blocks, then checks encode/decode round trips over
+ * every length up to 1 KiB and that decode rejects odd lengths and non-hex characters.
+ *
+ * Build (from repository root):
+ *   gcc -std=gnu11 -O2 -Iuart_proto/inc tools/hex_bench/hex_bench.c uart_proto/src/hex_codec.c -o hex_bench
+ *
+ * Add -mssse3 for the vector path of hex_encode, -DHEX_CODEC_SIMD=0 to force the word path.
+ *
+ * Usage:
+ *   hex_bench [-i iterations]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "hex_codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_LEN_MAX               4096
+#define BENCH_CHECK_LEN_MAX         1024
+
+typedef void (*pf_encode_t)(const uint8_t *src, size_t len, uint8_t *dest);
+
+/* -------------------------------------------------------------------------- */
+/*                        Reference encoders                                  */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t nibble_to_hex_char(uint8_t nibble)
+{
+    if(nibble < 10)
+    {
+        return nibble + '0';
+    }
+    else if(nibble < 16)
+    {
+        return nibble + 'A' - 10;
+    }
+    else
+    {
+        return 'H';
+    }
+}
+
+/* Original backward encoder, byte_idx is 8 bits so it is only exact up to 256 bytes */
+static void byte_array_to_hex_string(uint8_t *source, uint16_t source_len, uint8_t *dest, uint16_t *dest_len)
+{
+    uint16_t pos = source_len * 2 - 1;
+    uint8_t byte_idx = source_len - 1;
+    uint8_t nibble = 0;
+
+    while(1)
+    {
+        if(pos % 2 != 0)
+        {
+            nibble = source[byte_idx] & 0x0F;
+        }
+        else
+        {
+            nibble = (source[byte_idx] >> 4) & 0x0F;
+            if(byte_idx)
+            {
+                byte_idx--;
+            }
+        }
+
+        dest[pos] = nibble_to_hex_char(nibble);
+        if(0 == pos)
+        {
+            break;
+        }
+        pos--;
+    }
+    *dest_len = source_len * 2;
+}
+
+static void encode_backward(const uint8_t *src, size_t len, uint8_t *dest)
+{
+    uint16_t dest_len;
+    byte_array_to_hex_string((uint8_t *)src, (uint16_t)len, dest, &dest_len);
+}
+
+/* Forward per-nibble encoder used for in-place chunk expansion before hex_codec */
+static void encode_nibble(const uint8_t *src, size_t len, uint8_t *dest)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t byte = src[i];
+        dest[2 * i] = nibble_to_hex_char(byte >> 4);
+        dest[2 * i + 1] = nibble_to_hex_char(byte & 0x0F);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Benchmark                                    */
+/* -------------------------------------------------------------------------- */
+
+static const struct
+{
+    const char *name;
+    pf_encode_t pf_encode;
+    size_t len_max;
+} g_encoder[] = {
+    {"backward",    encode_backward,    256},
+    {"nibble",      encode_nibble,      BENCH_LEN_MAX},
+    {"hex_encode",  hex_encode,         BENCH_LEN_MAX},
+};
+
+static const size_t g_bench_len[] = {55, 256, 1024, BENCH_LEN_MAX};
+
+static uint8_t g_src[BENCH_LEN_MAX];
+static uint8_t g_dest[2 * BENCH_LEN_MAX];
+static volatile uint8_t g_sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double bench(pf_encode_t pf_encode, size_t len, long iterations)
+{
+    double start = now_ns();
+    for (long i = 0; i < iterations; i++)
+    {
+        pf_encode(g_src, len, g_dest);
+        g_sink ^= g_dest[i % (2 * len)];
+    }
+    return (now_ns() - start) / iterations;
+}
+
+static void bench_report(long iterations)
+{
+    printf("%-12s", "bytes");
+    for (size_t e = 0; e < sizeof(g_encoder) / sizeof(g_encoder[0]); e++)
+        printf("%14s", g_encoder[e].name);
+    printf("%10s\n", "speedup");
+
+    for (size_t l = 0; l < sizeof(g_bench_len) / sizeof(g_bench_len[0]); l++)
+    {
+        size_t len = g_bench_len[l];
+        long iter = iterations * 64 / (long)len;
+        double nibble_ns = 0, codec_ns = 0;
+        printf("%-12zu", len);
+        for (size_t e = 0; e < sizeof(g_encoder) / sizeof(g_encoder[0]); e++)
+        {
+            if (len > g_encoder[e].len_max)
+            {
+                printf("%14s", "-");
+                continue;
+            }
+            double ns = bench(g_encoder[e].pf_encode, len, iter);
+            printf("%11.1f ns", ns);
+            if (encode_nibble == g_encoder[e].pf_encode)
+                nibble_ns = ns;
+            else if (hex_encode == g_encoder[e].pf_encode)
+                codec_ns = ns;
+        }
+        printf("%9.1fx\n", nibble_ns / codec_ns);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Self-check                                    */
+/* -------------------------------------------------------------------------- */
+
+static int check(void)
+{
+    static uint8_t hex[2 * BENCH_CHECK_LEN_MAX];
+    static uint8_t ref[2 * BENCH_CHECK_LEN_MAX];
+    static uint8_t raw[BENCH_CHECK_LEN_MAX];
+    static uint8_t buf[3 * BENCH_CHECK_LEN_MAX];
+
+    for (size_t len = 1; len <= BENCH_CHECK_LEN_MAX; len++)
+    {
+        hex_encode(g_src, len, hex);
+        encode_nibble(g_src, len, ref);
+        if (memcmp(hex, ref, 2 * len))
+        {
+            printf("FAIL encode len %zu\n", len);
+            return -1;
+        }
+        if (len <= 256)
+        {
+            encode_backward(g_src, len, ref);
+            if (memcmp(hex, ref, 2 * len))
+            {
+                printf("FAIL backward len %zu\n", len);
+                return -1;
+            }
+        }
+
+        /* In place as the NSEND producer path: raw bytes right behind the output */
+        memcpy(buf + len, g_src, len);
+        hex_encode(buf + len, len, buf);
+        if (memcmp(buf, hex, 2 * len))
+        {
+            printf("FAIL in-place encode len %zu\n", len);
+            return -1;
+        }
+
+        if ((int32_t)len != hex_decode(hex, 2 * len, raw) || memcmp(raw, g_src, len))
+        {
+            printf("FAIL decode len %zu\n", len);
+            return -1;
+        }
+        /* Lower case and in place */
+        for (size_t i = 0; i < 2 * len; i++)
+            buf[i] = (hex[i] >= 'A') ? (uint8_t)(hex[i] + 'a' - 'A') : hex[i];
+        if ((int32_t)len != hex_decode(buf, 2 * len, buf) || memcmp(buf, g_src, len))
+        {
+            printf("FAIL in-place decode len %zu\n", len);
+            return -1;
+        }
+    }
+
+    memcpy(buf, "0123456789abcdefABCDEF", 22);
+    if (11 != hex_decode(buf, 22, raw) || hex_decode(buf, 21, raw) >= 0)
+    {
+        printf("FAIL decode length\n");
+        return -1;
+    }
+    for (int c = 0; c < 256; c++)
+    {
+        int is_hex = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+        if (is_hex)
+            continue;
+        memcpy(buf, "A5C3", 4);
+        buf[c % 4] = (uint8_t)c;
+        if (hex_decode(buf, 4, raw) >= 0)
+        {
+            printf("FAIL decode accepts 0x%02X\n", c);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = 200000;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:")) != -1)
+    {
+        if ('i' == opt)
+            iterations = atol(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-i iterations]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iterations <= 0)
+        iterations = 1;
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(g_src); i++)
+        g_src[i] = (uint8_t)rand();
+
+    if (check())
+        return 1;
+    printf("self-check ok\n");
+    bench_report(iterations);
+    return 0;
+}
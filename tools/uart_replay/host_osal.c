@@ -0,0 +1,438 @@
+/**
+ * @file host_osal.c
+ * @brief POSIX OSAL for running the WAPI stack on a host (replay tool)
+ */
+
+#include "host_osal.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+/* -------------------------------------------------------------------------- */
+/*                                 Clock                                      */
+/* -------------------------------------------------------------------------- */
+
+static double g_time_scale = 1.0;
+static struct timespec g_epoch;
+
+static pthread_mutex_t g_crit_mutex;
+static pthread_mutex_t g_sched_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_sched_cond = PTHREAD_COND_INITIALIZER;
+static bool g_is_sched_started;
+
+static double wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - g_epoch.tv_sec) * 1000.0 + (ts.tv_nsec - g_epoch.tv_nsec) / 1e6;
+}
+
+uint32_t host_os_now_ms(void)
+{
+    return (uint32_t)(wall_ms() / g_time_scale);
+}
+
+/* Absolute CLOCK_MONOTONIC deadline `ticks` virtual ms from now */
+static struct timespec deadline_after(uint32_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = (uint64_t)(ticks * g_time_scale * 1e6);
+    ts.tv_sec += (time_t)(ns / 1000000000ULL);
+    ts.tv_nsec += (long)(ns % 1000000000ULL);
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* Wait on cond until pred is true or timeout, returns pred */
+#define WAIT_UNTIL(cond, mutex, pred, timeout) \
+    ({ \
+        struct timespec _ts = deadline_after(timeout); \
+        while (!(pred)) \
+        { \
+            if (OS_DELAY_MAX == (timeout)) \
+                pthread_cond_wait(cond, mutex); \
+            else if (ETIMEDOUT == pthread_cond_timedwait(cond, mutex, &_ts)) \
+                break; \
+        } \
+        (pred); \
+    })
+
+void host_os_init(double time_scale)
+{
+    pthread_mutexattr_t attr;
+    g_time_scale = (time_scale > 0) ? time_scale : 1.0;
+    clock_gettime(CLOCK_MONOTONIC, &g_epoch);
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&g_crit_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    cond_init(&g_sched_cond);
+}
+
+void host_os_start(void)
+{
+    pthread_mutex_lock(&g_sched_mutex);
+    g_is_sched_started = true;
+    pthread_cond_broadcast(&g_sched_cond);
+    pthread_mutex_unlock(&g_sched_mutex);
+}
+
+void host_os_delay_ms(uint32_t ms)
+{
+    struct timespec ts = deadline_after(ms);
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+        ;
+}
+
+uint32_t host_os_enter_critical(void)
+{
+    pthread_mutex_lock(&g_crit_mutex);
+    return 0;
+}
+
+void host_os_exit_critical(uint32_t primask)
+{
+    (void)primask;
+    pthread_mutex_unlock(&g_crit_mutex);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Threads                                     */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    void (*task)(void *);
+    void *arg;
+} thread_start_t;
+
+static void *thread_entry(void *p)
+{
+    thread_start_t start = *(thread_start_t *)p;
+    free(p);
+
+    pthread_mutex_lock(&g_sched_mutex);
+    while (!g_is_sched_started)
+        pthread_cond_wait(&g_sched_cond, &g_sched_mutex);
+    pthread_mutex_unlock(&g_sched_mutex);
+
+    start.task(start.arg);
+    return NULL;
+}
+
+static int32_t thread_create(const char *name, void (*task)(void *), size_t stack_size,
+                             uint32_t priority, void **handle, void *arg)
+{
+    (void)name;
+    (void)stack_size;
+    (void)priority;
+    pthread_t tid;
+    thread_start_t *start = malloc(sizeof(thread_start_t));
+    if (!start)
+        return -1;
+    start->task = task;
+    start->arg = arg;
+    if (pthread_create(&tid, NULL, thread_entry, start))
+    {
+        free(start);
+        return -1;
+    }
+    pthread_detach(tid);
+    if (handle)
+        *handle = (void *)tid;
+    return 0;
+}
+
+static void thread_delete(void *const handle)
+{
+    (void)handle;   /* Stack threads never exit, the process ends with the replay */
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Queues                                      */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    size_t num;
+    size_t size;
+    size_t head;
+    size_t cnt;
+    uint8_t buf[];
+} host_queue_t;
+
+static int32_t queue_create(size_t num, size_t size, void **handle)
+{
+    host_queue_t *q = calloc(1, sizeof(host_queue_t) + num * size);
+    if (!q)
+        return -1;
+    pthread_mutex_init(&q->mutex, NULL);
+    cond_init(&q->cond);
+    q->num = num;
+    q->size = size;
+    *handle = q;
+    return 0;
+}
+
+static int32_t queue_put(void *queue, const void *item, uint32_t timeout)
+{
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->mutex);
+    if (!WAIT_UNTIL(&q->cond, &q->mutex, q->cnt < q->num, timeout))
+    {
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    memcpy(q->buf + ((q->head + q->cnt) % q->num) * q->size, item, q->size);
+    q->cnt++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+static int32_t queue_get(void *queue, const void *item, uint32_t timeout)
+{
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->mutex);
+    if (!WAIT_UNTIL(&q->cond, &q->mutex, q->cnt > 0, timeout))
+    {
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    memcpy((void *)item, q->buf + q->head * q->size, q->size);
+    q->head = (q->head + 1) % q->num;
+    q->cnt--;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                      Binary and counting semaphores                        */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t count;
+    uint32_t max_count;
+} host_sema_t;
+
+static int32_t sema_counting_create(void **p_sema_handle, uint32_t max_count, uint32_t init_count)
+{
+    host_sema_t *s = calloc(1, sizeof(host_sema_t));
+    if (!s)
+        return -1;
+    pthread_mutex_init(&s->mutex, NULL);
+    cond_init(&s->cond);
+    s->count = init_count;
+    s->max_count = max_count;
+    *p_sema_handle = s;
+    return 0;
+}
+
+static int32_t sema_binary_create(void **p_sema_handle)
+{
+    return sema_counting_create(p_sema_handle, 1, 0);
+}
+
+static void sema_delete(void *sema_handle)
+{
+    free(sema_handle);
+}
+
+static int32_t sema_give(void *sema_handle)
+{
+    host_sema_t *s = sema_handle;
+    pthread_mutex_lock(&s->mutex);
+    bool ok = s->count < s->max_count;
+    if (ok)
+        s->count++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    return ok ? 0 : -1;
+}
+
+static int32_t sema_take(void *sema_handle, uint32_t timeout)
+{
+    host_sema_t *s = sema_handle;
+    pthread_mutex_lock(&s->mutex);
+    bool ok = WAIT_UNTIL(&s->cond, &s->mutex, s->count > 0, timeout);
+    if (ok)
+        s->count--;
+    pthread_mutex_unlock(&s->mutex);
+    return ok ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                      Software timers (one daemon thread)                   */
+/* -------------------------------------------------------------------------- */
+
+typedef struct host_timer
+{
+    struct host_timer *next;
+    void (*cb)(void *timer_handle, void *arg);
+    void *arg;
+    uint32_t period;
+    bool is_auto_reload;
+    bool is_running;
+    uint32_t expiry;        /* Virtual ms */
+} host_timer_t;
+
+static pthread_mutex_t g_timer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_timer_cond;
+static host_timer_t *g_timer_list;
+static bool g_is_timer_daemon_started;
+
+static void *timer_daemon(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&g_timer_mutex);
+    while (1)
+    {
+        host_timer_t *due = NULL;
+        for (host_timer_t *t = g_timer_list; t; t = t->next)
+            if (t->is_running && (!due || (int32_t)(t->expiry - due->expiry) < 0))
+                due = t;
+
+        if (!due)
+        {
+            pthread_cond_wait(&g_timer_cond, &g_timer_mutex);
+            continue;
+        }
+
+        uint32_t now = host_os_now_ms();
+        if ((int32_t)(due->expiry - now) > 0)
+        {
+            struct timespec ts = deadline_after(due->expiry - now);
+            pthread_cond_timedwait(&g_timer_cond, &g_timer_mutex, &ts);
+            continue;
+        }
+
+        /* Callback runs unlocked, it may restart or stop timers */
+        if (due->is_auto_reload)
+            due->expiry += due->period;
+        else
+            due->is_running = false;
+        pthread_mutex_unlock(&g_timer_mutex);
+        due->cb(due, due->arg);
+        pthread_mutex_lock(&g_timer_mutex);
+    }
+    return NULL;
+}
+
+static int32_t host_timer_create(void **p_timer_handle, const char *timer_name, uint32_t timer_period,
+                            uint8_t auto_reload, void (*timer_cb)(void *timer_handle, void *arg), void *arg)
+{
+    (void)timer_name;
+    host_timer_t *t = calloc(1, sizeof(host_timer_t));
+    if (!t)
+        return -1;
+    t->cb = timer_cb;
+    t->arg = arg;
+    t->period = timer_period;
+    t->is_auto_reload = auto_reload;
+
+    pthread_mutex_lock(&g_timer_mutex);
+    if (!g_is_timer_daemon_started)
+    {
+        pthread_t tid;
+        cond_init(&g_timer_cond);
+        pthread_create(&tid, NULL, timer_daemon, NULL);
+        pthread_detach(tid);
+        g_is_timer_daemon_started = true;
+    }
+    t->next = g_timer_list;
+    g_timer_list = t;
+    pthread_mutex_unlock(&g_timer_mutex);
+    *p_timer_handle = t;
+    return 0;
+}
+
+static int32_t host_timer_start(void *timer_handle, uint32_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    host_timer_t *t = timer_handle;
+    pthread_mutex_lock(&g_timer_mutex);
+    t->expiry = host_os_now_ms() + t->period;
+    t->is_running = true;
+    pthread_cond_signal(&g_timer_cond);
+    pthread_mutex_unlock(&g_timer_mutex);
+    return 0;
+}
+
+static int32_t host_timer_stop(void *timer_handle, uint32_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    host_timer_t *t = timer_handle;
+    pthread_mutex_lock(&g_timer_mutex);
+    t->is_running = false;
+    pthread_mutex_unlock(&g_timer_mutex);
+    return 0;
+}
+
+static int32_t host_timer_delete(void *timer_handle, uint32_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    pthread_mutex_lock(&g_timer_mutex);
+    for (host_timer_t **pp = &g_timer_list; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == timer_handle)
+        {
+            *pp = (*pp)->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_timer_mutex);
+    free(timer_handle);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              OSAL tables                                   */
+/* -------------------------------------------------------------------------- */
+
+uart_rx_os_interface_t g_host_uart_os_interface =
+{
+    .pf_os_thread_create  = thread_create,
+    .pf_os_thread_delete  = thread_delete,
+    .pf_os_queue_create   = queue_create,
+    .pf_os_queue_put      = queue_put,
+    .pf_os_queue_get      = queue_get,
+    .pf_os_enter_critical = host_os_enter_critical,
+    .pf_os_exit_critical  = host_os_exit_critical,
+};
+
+at_os_interface_t g_host_at_os_interface =
+{
+    .pf_sema_binary_create    = sema_binary_create,
+    .pf_sema_counting_create  = sema_counting_create,
+    .pf_sema_delete           = sema_delete,
+    .pf_sema_give             = sema_give,
+    .pf_sema_take             = sema_take,
+    .pf_timer_create          = host_timer_create,
+    .pf_timer_start           = host_timer_start,
+    .pf_timer_stop            = host_timer_stop,
+    .pf_timer_delete          = host_timer_delete,
+    .pf_get_tick_ms           = host_os_now_ms,
+};
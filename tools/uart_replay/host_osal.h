@@ -0,0 +1,36 @@
+/**
+ * @file host_osal.h
+ * @brief POSIX OSAL for running the WAPI stack on a host (replay tool)
+ *
+ * Implements uart_rx_os_interface_t and at_os_interface_t with pthreads.
+ * One tick is one virtual millisecond. The virtual clock runs `time_scale`
+ * times slower than the wall clock (0.1 = ten times faster), and every delay,
+ * timeout and timer of the stack follows it, so scaled runs keep the
+ * original timing relations.
+ *
+ * The critical section is one global recursive mutex. Simulated ISRs run
+ * with it held (host_os_enter_critical) so they are atomic against thread
+ * code, like on target.
+ */
+
+#ifndef __HOST_OSAL_H__
+#define __HOST_OSAL_H__
+
+#include <stdint.h>
+#include "uart_proto.h"
+#include "AT_handler.h"
+
+extern uart_rx_os_interface_t g_host_uart_os_interface;
+extern at_os_interface_t g_host_at_os_interface;
+
+void host_os_init(double time_scale);
+/* Threads created before this call wait here, like tasks created before the scheduler runs */
+void host_os_start(void);
+
+uint32_t host_os_now_ms(void);
+void host_os_delay_ms(uint32_t ms);
+
+uint32_t host_os_enter_critical(void);
+void host_os_exit_critical(uint32_t primask);
+
+#endif /* __HOST_OSAL_H__ */
@@ -0,0 +1,21 @@
+/**
+ * @file SEGGER_RTT.h
+ * @brief Host port of the RTT calls used by the stack (replay tool)
+ *
+ * Output goes to stderr when verbose logging is enabled in uart_replay.
+ */
+
+#ifndef __SEGGER_RTT_HOST_H__
+#define __SEGGER_RTT_HOST_H__
+
+#define RTT_CTRL_RESET                  ""
+#define RTT_CTRL_TEXT_BRIGHT_RED        ""
+#define RTT_CTRL_TEXT_BRIGHT_YELLOW     ""
+#define RTT_CTRL_TEXT_BRIGHT_CYAN       ""
+#define RTT_CTRL_TEXT_BRIGHT_GREEN      ""
+
+int SEGGER_RTT_printf(unsigned BufferIndex, const char *sFormat, ...);
+unsigned SEGGER_RTT_WriteString(unsigned BufferIndex, const char *s);
+unsigned SEGGER_RTT_Write(unsigned BufferIndex, const void *pBuffer, unsigned NumBytes);
+
+#endif /* __SEGGER_RTT_HOST_H__ */
@@ -0,0 +1,22 @@
+/**
+ * @file algo_data_integrity.h
+ * @brief Host port of the integrity algorithms used by the stack (replay tool)
+ *
+ * Only has to be self-consistent on host: digests are produced and checked
+ * by the same build.
+ */
+
+#ifndef __ALGO_DATA_INTEGRITY_HOST_H__
+#define __ALGO_DATA_INTEGRITY_HOST_H__
+
+#include <stdint.h>
+
+static inline uint16_t checksum_16bit(uint8_t *buf, uint16_t len)
+{
+    uint16_t sum = 0;
+    for (uint16_t i = 0; i < len; i++)
+        sum += buf[i];
+    return sum;
+}
+
+#endif /* __ALGO_DATA_INTEGRITY_HOST_H__ */
@@ -0,0 +1,113 @@
+#!/bin/sh
+# Replays every trace of traces/ with the heap and the static arena build of uart_replay
+# and checks the TX match and response counts of the summary.
+#
+# Usage (from anywhere): tools/uart_replay/run_traces.sh [build_dir]
+# build_dir keeps the two binaries, a temporary directory by default.
+# Exit status: number of failed runs, 0 when all passed.
+
+TOOL_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT_DIR=$(cd "$TOOL_DIR/../.." && pwd)
+TRACE_DIR=$TOOL_DIR/traces
+BUILD_DIR=${1:-$(mktemp -d)}
+CC=${CC:-gcc}
+
+# Same virtual clock and stall limit for every run, the case options come after
+REPLAY_OPT="-s 0.05 -a cert -n 3 -p 1000 -t 8000"
+
+FAIL_NUM=0
+
+build()
+{
+    "$CC" -std=gnu11 -O2 -DUART_PROTO_CAPTURE=1 "$@" \
+        -I"$TOOL_DIR/port" -I"$TOOL_DIR" -I"$ROOT_DIR/uart_proto/inc" -I"$ROOT_DIR/handler/inc" \
+        "$TOOL_DIR/uart_replay.c" "$TOOL_DIR/host_osal.c" \
+        "$ROOT_DIR/uart_proto/src/uart_proto.c" "$ROOT_DIR/uart_proto/src/uart_capture.c" \
+        "$ROOT_DIR/uart_proto/src/t_list.c" "$ROOT_DIR/uart_proto/src/mem_arena.c" \
+        "$ROOT_DIR/uart_proto/src/timer_wheel.c" "$ROOT_DIR/uart_proto/src/hex_codec.c" \
+        "$ROOT_DIR/handler/src/AT_handler.c" "$ROOT_DIR/handler/src/WAPI_M0804C.c" \
+        -lpthread
+}
+
+# run_case <trace> "<options>" "<expected line>"...
+# Each expected line must appear as a substring of one output line.
+run_case()
+{
+    trace=$1
+    opt=$2
+    shift 2
+    for mode in heap static; do
+        # shellcheck disable=SC2086
+        out=$(timeout 300 "$BUILD_DIR/uart_replay_$mode" $REPLAY_OPT $opt "$TRACE_DIR/$trace" 2>&1)
+        for expect in "$@"; do
+            if ! printf '%s\n' "$out" | grep -qF -- "$expect"; then
+                echo "FAIL $mode $trace $opt: missing \"$expect\""
+                printf '%s\n' "$out" | grep -E '^(tx|app)' | sed 's/^/    /'
+                FAIL_NUM=$((FAIL_NUM + 1))
+                continue 2
+            fi
+        done
+        echo "ok   $mode $trace $opt"
+    done
+}
+
+mkdir -p "$BUILD_DIR"
+build -o "$BUILD_DIR/uart_replay_heap" || exit 1
+build -DUART_PROTO_STATIC_ALLOC=1 -o "$BUILD_DIR/uart_replay_static" || exit 1
+
+# Init, certificate auth and connect, the three sends get no answer
+run_case cert_connect.ucap "" \
+    "tx                : 14 matched, 0 mismatched, 0 missing, 0 extra" \
+    "app responses     : 0/3 sends"
+# Same session through m0804c_send_async, four pieces merged back into each send
+run_case cert_connect.ucap "-q 4" \
+    "tx                : 14 matched, 0 mismatched, 0 missing, 0 extra" \
+    "app queued        : 96/96 bytes, 0 dropped"
+# Third NSEND answered "[ERR] Socket not in use!", the stack reconnects on its own path
+run_case nsend_socket_err.ucap "" \
+    "tx                : 17 matched, 8 mismatched, 0 missing, 0 extra" \
+    "app responses     : 2/3 sends"
+# Module debug output after "+OK" completes the send
+run_case nsend_dbg_output.ucap "" \
+    "tx                : 14 matched, 0 mismatched, 0 missing, 0 extra" \
+    "app responses     : 1/3 sends"
+# Five UDP datagrams per batch, pipelined NSEND answers split across chunks
+run_case udp_batch.ucap "-z 8 -u 5" \
+    "tx                : 17 matched, 0 mismatched, 0 missing, 0 extra" \
+    "app datagrams     : 15/15 sent"
+run_case udp_batch.ucap "-z 8 -u 5 -w" \
+    "tx                : 17 matched, 0 mismatched, 0 missing, 0 extra" \
+    "app messages      : 14 answered +OK, 15/15 completed"
+# Socket error with the link still up: reopen only the socket
+run_case reconnect_link_up.ucap "-n 4" \
+    "tx                : 18 matched, 0 mismatched, 0 missing, 0 extra" \
+    "app responses     : 3/4 sends"
+# Socket error with the link down: reconnect from the link up
+run_case reconnect_link_down.ucap "" \
+    "tx                : 23 matched, 0 mismatched, 0 missing, 0 extra" \
+    "app responses     : 2/3 sends"
+# +NRECV pushes interleaved with NSEND answers, in binary send mode
+run_case nrecv_push.ucap "-m bin" \
+    "tx                : 14 matched, 11 mismatched, 0 missing, 0 extra" \
+    "app rx data       : 9 bytes"
+# +NRECV pushes of 200, 300 and 100 bytes in 180 byte chunks, the 300 byte one overflows
+run_case nrecv_long_push.ucap "-v" \
+    "URC line longer than 544 bytes dropped" \
+    "tx                : 14 matched, 0 mismatched, 0 missing, 0 extra" \
+    "app rx data       : 300 bytes"
+# Module output ahead of an answer beyond AT_RSP_SKIP_MAX
+run_case skip_cap.ucap "-v" \
+    "Answer lost among module output" \
+    "tx                : 5 matched, 9 mismatched, 0 missing, 1 extra" \
+    "app responses     : 1/3 sends"
+# Both certificates uploaded in 64 byte segments
+run_case cert_upload.ucap "-a upload" \
+    "CERT UPLOAD SUCCESS" \
+    "tx                : 42 matched, 0 mismatched, 0 missing, 0 extra"
+# No module answering: init retries until the breaker opens
+run_case no_module.ucap "-a init -v -t 30000" \
+    "WAPI Init failed 3 times in a row, breaker open" \
+    "tx                : 0 matched, 0 mismatched, 0 missing, 60 extra"
+
+[ "$FAIL_NUM" -eq 0 ] && echo "all traces passed" || echo "$FAIL_NUM runs failed"
+exit "$FAIL_NUM"
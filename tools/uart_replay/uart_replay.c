@@ -0,0 +1,941 @@
+/**
+ * @file uart_replay.c
+ * @brief Host replay driver for captured UART sessions
+ *
+ * Runs the real uart_proto + AT handler + m0804c stack on a host against a
+ * trace recorded with UART_PROTO_CAPTURE (uart_capture.h). This file plays
+ * the board: a fake DMA ring receives the captured RX chunks and raises the
+ * IDLE notification, writes of the stack are compared with the captured TX
+ * stream and completed with the TX complete notification.
+ *
+ * Timing: RX chunks are causal. Each one is delivered only after the stack
+ * has emitted every TX that preceded it in the trace, then after the original
+ * gap (measured from the last TX or RX event) multiplied by the time scale.
+ * The stack's own delays and timeouts follow the same virtual clock
+ * (host_osal.h), so `-s 0.1` replays ten times faster with the original
+ * timing relations.
+ *
+ * Report: milestones of the WAPI processes, TX match statistics and the
+ * stack reaction time (RX delivered -> next TX written) against the same
+ * gap in the trace, the figure parser and state-machine changes move.
+ *
+ * Build (from repository root):
+ *   gcc -std=gnu11 -O2 -DUART_PROTO_CAPTURE=1 -Itools/uart_replay/port -Itools/uart_replay \
+ *       -Iuart_proto/inc -Ihandler/inc \
+ *       tools/uart_replay/uart_replay.c tools/uart_replay/host_osal.c \
+ *       uart_proto/src/uart_proto.c uart_proto/src/uart_capture.c uart_proto/src/t_list.c \
+ *       uart_proto/src/mem_arena.c uart_proto/src/timer_wheel.c uart_proto/src/hex_codec.c \
+ *       handler/src/AT_handler.c handler/src/WAPI_M0804C.c \
+ *       -lpthread -o uart_replay
+ *
+ * Add -DUART_PROTO_STATIC_ALLOC=1 to run the stack on a static arena like the target.
+ *
+ * Regression: tools/uart_replay/run_traces.sh builds both variants and replays every trace of
+ * tools/uart_replay/traces with the options it was recorded for, checking the TX match and
+ * response counts of the summary. Add a run_case there with each new trace.
+ *
+ * Usage:
+ *   uart_replay [-s scale] [-a init|cert|pwd|upload] [-n sends] [-p period_ms] [-b baud]
+ *               [-t stall_ms] [-z send_len] [-m hex|bin] [-u dgrams] [-q pieces] [-w]
+ *               [-o out.ucap] [-l] [-v] trace.ucap
+ *
+ * -z sets the payload of each m0804c_send (default 32, up to REPLAY_SEND_LEN_MAX), longer
+ * payloads go out as several NSEND chunks.
+ * -m bin requests binary NSEND on the data socket before the first send. The trace answers
+ * the probe like any other command, so TX only matches a trace recorded in binary mode.
+ * -u opens the data socket as UDP, each send is then one m0804c_sendto_batch of dgrams
+ * datagrams of send_len bytes.
+ * -w sends through m0804c_send_window instead, one message per send or the dgrams of -u,
+ * and counts the per-message completions.
+ * -q queues each send as pieces m0804c_send_async calls, the TX queue merges them back into
+ * the NSEND chunks of one m0804c_send (no response callback), so TX matches the same trace.
+ * -a upload runs m0804c_cert_upload after init: both fixture certificates of 1024 bytes go out
+ * in 64 byte segments, and the result is reported as CERT UPLOAD.
+ * -l prints the AT handler latency statistics (m0804c_lat_report) after the summary.
+ */
+
+#include "host_osal.h"
+#include "WAPI_M0804C.h"
+#include "uart_capture.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPLAY_RX_BUF_SIZE          256         /* Same DMA ring as Core/usart.c */
+#define REPLAY_PWR_OFF_MS           100         /* Same power cycle as APP/wapi_commu.c, boot comes from the trace */
+#define REPLAY_OUT_CAPTURE_SIZE     (1024 * 1024)
+#define REPLAY_SEND_LEN             32
+#define REPLAY_SEND_LEN_MAX         4096
+#define REPLAY_DGRAM_NUM_MAX        16
+
+/* -------------------------------------------------------------------------- */
+/*                                 Options                                    */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    AUTH_INIT_ONLY = 0,
+    AUTH_CERT,
+    AUTH_PWD,
+    AUTH_UPLOAD                 /* Init, then m0804c_cert_upload of the fixture certificates */
+} replay_auth_t;
+
+static struct
+{
+    double scale;
+    replay_auth_t auth;
+    uint32_t send_num;
+    uint32_t send_period_ms;
+    uint32_t baud;
+    uint32_t stall_ms;
+    uint32_t send_len;
+    wapi_send_mode_t send_mode;
+    uint32_t dgram_num;
+    uint32_t piece_num;
+    bool is_window;
+    const char *out_path;
+    const char *trace_path;
+    bool is_verbose;
+    bool is_lat_report;
+} g_opt = {1.0, AUTH_CERT, 0, 5000, 115200, 5000, REPLAY_SEND_LEN, WAPI_SEND_MODE_HEX, 0, 0, false, NULL, NULL, false, false};
+
+/* -------------------------------------------------------------------------- */
+/*                                RTT port                                    */
+/* -------------------------------------------------------------------------- */
+
+static pthread_mutex_t g_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int SEGGER_RTT_printf(unsigned BufferIndex, const char *sFormat, ...)
+{
+    (void)BufferIndex;
+    if (!g_opt.is_verbose)
+        return 0;
+    va_list ap;
+    va_start(ap, sFormat);
+    pthread_mutex_lock(&g_log_mutex);
+    fprintf(stderr, "[%7u] ", host_os_now_ms());
+    int ret = vfprintf(stderr, sFormat, ap);
+    pthread_mutex_unlock(&g_log_mutex);
+    va_end(ap);
+    return ret;
+}
+
+unsigned SEGGER_RTT_WriteString(unsigned BufferIndex, const char *s)
+{
+    (void)BufferIndex;
+    if (g_opt.is_verbose)
+        fputs(s, stderr);
+    return (unsigned)strlen(s);
+}
+
+unsigned SEGGER_RTT_Write(unsigned BufferIndex, const void *pBuffer, unsigned NumBytes)
+{
+    (void)BufferIndex;
+    if (g_opt.is_verbose)
+        fwrite(pBuffer, 1, NumBytes, stderr);
+    return NumBytes;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Trace                                     */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t ms;            /* Relative to the first record */
+    uint8_t dir;
+    uint16_t len;
+    const uint8_t *data;
+} trace_rec_t;
+
+static uint8_t *g_trace_buf;
+static trace_rec_t *g_rec;
+static size_t g_rec_num;
+
+static int load_trace(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    g_trace_buf = malloc(size > 0 ? (size_t)size : 1);
+    if (!g_trace_buf || fread(g_trace_buf, 1, (size_t)size, f) != (size_t)size)
+    {
+        fclose(f);
+        fprintf(stderr, "%s: read failed\n", path);
+        return -1;
+    }
+    fclose(f);
+
+    uint32_t tick_hz = 0;
+    if (uart_capture_parse_header(g_trace_buf, (uint32_t)size, &tick_hz) || !tick_hz)
+    {
+        fprintf(stderr, "%s: not a UART capture\n", path);
+        return -1;
+    }
+
+    /* Two passes: count, then decode */
+    uart_capture_rec_t rec;
+    uint32_t offset = UART_CAPTURE_FILE_HDR_LEN;
+    int32_t ret;
+    while (0 == (ret = uart_capture_next(g_trace_buf, (uint32_t)size, &offset, &rec)))
+        g_rec_num++;
+    if (ret < 0)
+        fprintf(stderr, "%s: truncated after %zu records, replaying the complete ones\n", path, g_rec_num);
+
+    g_rec = calloc(g_rec_num ? g_rec_num : 1, sizeof(trace_rec_t));
+    if (!g_rec)
+        return -1;
+    offset = UART_CAPTURE_FILE_HDR_LEN;
+    uint32_t first_tick = 0;
+    for (size_t i = 0; i < g_rec_num; i++)
+    {
+        uart_capture_next(g_trace_buf, (uint32_t)size, &offset, &rec);
+        if (0 == i)
+            first_tick = rec.tick;
+        g_rec[i].ms = (uint32_t)((uint64_t)(uint32_t)(rec.tick - first_tick) * 1000 / tick_hz);
+        g_rec[i].dir = rec.dir;
+        g_rec[i].len = rec.len;
+        g_rec[i].data = rec.data;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Fake board                                   */
+/* -------------------------------------------------------------------------- */
+
+static m0804c_handler_t g_wapi_handler_inst;
+
+static uint8_t wapi_recv_buffer[REPLAY_RX_BUF_SIZE];
+static volatile uint16_t g_dma_pos;     /* Next byte DMA writes into the ring */
+
+typedef struct tx_event
+{
+    struct tx_event *next;
+    uint32_t time;
+    uint16_t len;
+    uint8_t data[];
+} tx_event_t;
+
+static pthread_mutex_t g_hw_mutex = PTHREAD_MUTEX_INITIALIZER;
+static tx_event_t *g_tx_head;
+static tx_event_t **g_tx_tail = &g_tx_head;
+
+static void board_uart_init(void)
+{
+    g_dma_pos = 0;
+}
+
+static void board_uart_deinit(void)
+{
+}
+
+/* Thread or "ISR" context, hands the write to the replay loop */
+static void board_uart_write(uint8_t *const data, uint16_t len)
+{
+    tx_event_t *ev = malloc(sizeof(tx_event_t) + len);
+    if (!ev)
+        return;
+    ev->next = NULL;
+    ev->time = host_os_now_ms();
+    ev->len = len;
+    memcpy(ev->data, data, len);
+
+    pthread_mutex_lock(&g_hw_mutex);
+    *g_tx_tail = ev;
+    g_tx_tail = &ev->next;
+    pthread_mutex_unlock(&g_hw_mutex);
+}
+
+static uint16_t board_get_counter(void)
+{
+    return (uint16_t)(REPLAY_RX_BUF_SIZE - g_dma_pos);
+}
+
+static void board_set_counter(uint16_t counter)
+{
+    g_dma_pos = (uint16_t)((REPLAY_RX_BUF_SIZE - counter) % REPLAY_RX_BUF_SIZE);
+}
+
+uart_ops_t g_wapi_uart_ops =
+{
+    .pf_uart_init = board_uart_init,
+    .pf_uart_deinit = board_uart_deinit,
+    .pf_uart_write = board_uart_write,
+    .pf_get_counter = board_get_counter,
+    .pf_set_counter = board_set_counter,
+};
+
+recv_buf_att_t g_wapi_uart_rx_buf =
+{
+    .recv_buf = wapi_recv_buffer,
+    .buffer_size = sizeof(wapi_recv_buffer),
+};
+
+/* DMA writes the chunk into the ring, then the IDLE interrupt fires */
+static void board_rx(const uint8_t *data, uint16_t len)
+{
+    /* A chunk bigger than the ring could not arrive in one IDLE period on target either */
+    const uint16_t max_chunk = REPLAY_RX_BUF_SIZE / 2;
+    while (len)
+    {
+        uint16_t n = len > max_chunk ? max_chunk : len;
+        for (uint16_t i = 0; i < n; i++)
+        {
+            wapi_recv_buffer[g_dma_pos] = data[i];
+            g_dma_pos = (uint16_t)((g_dma_pos + 1) % REPLAY_RX_BUF_SIZE);
+        }
+        uint32_t primask = host_os_enter_critical();
+        m0804c_at_notify_recv_isr_cb(&g_wapi_handler_inst);
+        host_os_exit_critical(primask);
+        data += n;
+        len -= n;
+    }
+}
+
+static void board_tx_complete(void)
+{
+    uint32_t primask = host_os_enter_critical();
+    m0804c_at_send_complete_isr_cb(&g_wapi_handler_inst);
+    host_os_exit_critical(primask);
+}
+
+/* Wait for a stack write until virtual time `until`, returns the write or NULL */
+static tx_event_t *board_wait_tx(uint32_t until)
+{
+    pthread_mutex_lock(&g_hw_mutex);
+    while (!g_tx_head)
+    {
+        int32_t remain = (int32_t)(until - host_os_now_ms());
+        if (remain <= 0)
+            break;
+        pthread_mutex_unlock(&g_hw_mutex);
+        /* Coarse poll keeps the clock handling in one place (host_osal) */
+        host_os_delay_ms(remain > 1 ? 1 : (uint32_t)remain);
+        pthread_mutex_lock(&g_hw_mutex);
+    }
+    tx_event_t *ev = g_tx_head;
+    if (ev)
+    {
+        g_tx_head = ev->next;
+        if (!g_tx_head)
+            g_tx_tail = &g_tx_head;
+    }
+    pthread_mutex_unlock(&g_hw_mutex);
+    return ev;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Stack wiring                                  */
+/* -------------------------------------------------------------------------- */
+
+static wapi_info_t g_wapi_info;
+static uint8_t g_cert_payload[2][1024];
+static cert_file_t g_cert_file;
+static volatile bool g_is_inited;
+static volatile bool g_is_connected;
+
+static const char *process_name(wapi_process_type_t type)
+{
+    static const char *const names[] = {"INIT", "CERT AUTH", "PWD AUTH", "CONNECT"};
+    return (type <= PROCESS_CONNECT) ? names[type] : "?";
+}
+
+static void replay_pwr_open(struct m0804c_handler *const self)
+{
+    (void)self;
+}
+
+static void replay_pwr_close(struct m0804c_handler *const self)
+{
+    (void)self;
+    host_os_delay_ms(REPLAY_PWR_OFF_MS);
+}
+
+static wapi_info_t *replay_get_wapi_info(struct m0804c_handler *const self)
+{
+    (void)self;
+    return &g_wapi_info;
+}
+
+static cert_file_t *replay_get_cert_file(struct m0804c_handler *const self)
+{
+    (void)self;
+    return &g_cert_file;
+}
+
+static void replay_process_success_cb(struct m0804c_handler *const self, wapi_process_type_t type)
+{
+    (void)self;
+    printf("[%7u ms] PROCESS %s SUCCESS\n", host_os_now_ms(), process_name(type));
+    if (PROCESS_INIT == type)
+        g_is_inited = true;
+    if (PROCESS_CONNECT == type)
+        g_is_connected = true;
+}
+
+static void replay_process_err_cb(struct m0804c_handler *const self, wapi_process_type_t type)
+{
+    (void)self;
+    printf("[%7u ms] PROCESS %s ERROR\n", host_os_now_ms(), process_name(type));
+}
+
+static volatile uint32_t g_app_rx_len;    /* Socket data drained by the application */
+
+/* Runs on the wapi_work thread, drains the socket like an application would */
+static void replay_rx_notify_cb(struct m0804c_handler *const self, uint8_t socket, uint16_t available)
+{
+    uint8_t buf[WAPI_RX_RING_SIZE];
+    uint16_t len = 0;
+    if (WAPI_OK == m0804c_recv(self, socket, buf, sizeof(buf), &len))
+        g_app_rx_len += len;
+    printf("[%7u ms] RX socket %u: %u bytes\n", host_os_now_ms(), socket, len);
+}
+
+static frame_parse_att_t replay_frame_parse_att =
+{
+    .recv_buf_att = &g_wapi_uart_rx_buf,
+    .parse_algo = NULL,
+};
+
+#if (UART_PROTO_CAPTURE)
+static uart_capture_t g_out_capture;
+#endif
+
+#if (UART_PROTO_STATIC_ALLOC)
+/* Same storage the target links in, an undersized macro shows up as init failure */
+static uint8_t g_stack_storage[M0804C_STORAGE_SIZE(REPLAY_RX_BUF_SIZE)];
+static mem_arena_t g_stack_arena;
+#endif
+
+static uart_proto_input_arg_t replay_uart_proto_input_arg =
+{
+    .frame_parse_att = &replay_frame_parse_att,
+    .uart_ops = &g_wapi_uart_ops,
+    .os_interface = &g_host_uart_os_interface,
+    .thread_att = NULL,
+#if (UART_PROTO_CAPTURE)
+    .capture = NULL,
+#endif
+};
+
+/* Response timeouts on a wheel ticked by one host timer, like APP/wapi_commu.c */
+static timer_wheel_t g_timer_wheel;
+static void *g_wheel_tick_timer;
+static uint32_t g_wheel_tick_num;
+
+static void wheel_tick_cb(void *timer_handle, void *arg)
+{
+    (void)timer_handle;
+    g_wheel_tick_num++;
+    timer_wheel_tick((timer_wheel_t *)arg);
+}
+
+static void wheel_tick_ctrl(bool is_run, void *arg)
+{
+    if (is_run)
+        g_host_at_os_interface.pf_timer_start(arg, 0);
+    else
+        g_host_at_os_interface.pf_timer_stop(arg, 0);
+}
+
+static at_input_arg_t replay_at_input_arg =
+{
+    .uart_proto_input_arg = &replay_uart_proto_input_arg,
+    .at_cmd_set_table = NULL,
+    .at_os_interface = &g_host_at_os_interface,
+    .timer_wheel = &g_timer_wheel,
+};
+
+static m0804c_os_interface_t replay_wapi_os_interface = {.pf_os_delay_ms = host_os_delay_ms};
+static m0804c_pwr_ops_t replay_pwr_ops = {replay_pwr_open, replay_pwr_close};
+static wapi_data_provider_t replay_data_provider = {replay_get_wapi_info, replay_get_cert_file};
+static wapi_callback_t replay_callbacks = {replay_process_success_cb, replay_process_err_cb, replay_rx_notify_cb};
+
+static wapi_m0804c_input_arg_t replay_input_arg =
+{
+    .at_input_arg = &replay_at_input_arg,
+    .os_interface = &replay_wapi_os_interface,
+    .pwr_ops = &replay_pwr_ops,
+    .data_provider = &replay_data_provider,
+    .callbacks = &replay_callbacks,
+#if (UART_PROTO_STATIC_ALLOC)
+    .arena = &g_stack_arena,
+#endif
+};
+
+static void build_fixtures(void)
+{
+    reset_wapi_info(&g_wapi_info);
+    g_wapi_info.is_exist_certicate = (AUTH_CERT == g_opt.auth || AUTH_UPLOAD == g_opt.auth);
+    validate_wapi_info(&g_wapi_info);
+
+    file_att_t *files[2] = {&g_cert_file.as_file, &g_cert_file.asue_file};
+    for (int i = 0; i < 2; i++)
+    {
+        memset(g_cert_payload[i], 'A' + i, sizeof(g_cert_payload[i]));
+        files[i]->file_payload = g_cert_payload[i];
+        files[i]->file_append.file_len = sizeof(g_cert_payload[i]);
+        files[i]->file_append.digest = M0804C_DATA_INTEGRITY_ALGO(g_cert_payload[i], sizeof(g_cert_payload[i]));
+    }
+}
+
+static volatile uint32_t g_app_rsp_num;   /* Responses delivered to the application */
+static volatile uint32_t g_app_dgram_num; /* Datagrams handed over by m0804c_sendto_batch */
+static volatile uint32_t g_app_queued_len; /* Bytes taken by m0804c_send_async */
+static volatile uint32_t g_app_msg_ok;     /* m0804c_send_window messages answered "+OK" */
+static volatile uint32_t g_app_msg_done;   /* m0804c_send_window completions */
+
+/* Runs on the wapi_work thread */
+static at_status_t app_recv_parse(uint8_t *buf, uint16_t len, void *arg, void *holder)
+{
+    (void)buf;
+    (void)len;
+    (void)arg;
+    (void)holder;
+    g_app_rsp_num++;
+    return AT_OK;
+}
+
+static void app_sent_cb(m0804c_handler_t *const self, uint8_t socket, void *arg, wapi_status_t status)
+{
+    (void)self;
+    (void)socket;
+    (void)arg;
+    g_app_msg_done++;
+    if (WAPI_OK == status)
+        g_app_msg_ok++;
+}
+
+/* One send as piece_num queued messages, the last piece takes the remainder */
+static void app_send_async(const uint8_t *buf, uint32_t send_idx)
+{
+    uint32_t piece_len = g_opt.send_len / g_opt.piece_num;
+    for (uint32_t offset = 0; offset < g_opt.send_len; offset += piece_len)
+    {
+        uint32_t len = (g_opt.send_len - offset < 2 * piece_len) ? g_opt.send_len - offset : piece_len;
+        wapi_status_t ret = m0804c_send_async(&g_wapi_handler_inst, WAPI_DEFAULT_SOCKET, buf + offset, (uint16_t)len);
+        if (WAPI_OK != ret)
+        {
+            printf("[%7u ms] m0804c_send_async #%u failed: %d\n", host_os_now_ms(), send_idx, ret);
+            return;
+        }
+        g_app_queued_len += len;
+        if (len != piece_len)
+            break;
+    }
+}
+
+/* Application side, same traffic as wapi_commu_task */
+static void *app_thread(void *arg)
+{
+    (void)arg;
+    static uint8_t buf[REPLAY_SEND_LEN_MAX] = {0xDE, 0xAD, 0xBE, 0xEF};
+    for (uint32_t i = 4; i < g_opt.send_len; i++)
+        buf[i] = (uint8_t)i;
+
+    if (AUTH_UPLOAD == g_opt.auth)
+    {
+        /* The upload resets the module state, start it once init is through */
+        while (!g_is_inited)
+            host_os_delay_ms(10);
+        wapi_status_t ret = m0804c_cert_upload(&g_wapi_handler_inst);
+        printf("[%7u ms] CERT UPLOAD %s (%d)\n", host_os_now_ms(), (WAPI_OK == ret) ? "SUCCESS" : "ERROR", ret);
+        return NULL;
+    }
+    while (!g_is_connected)
+        host_os_delay_ms(10);
+    if (WAPI_SEND_MODE_HEX != g_opt.send_mode)
+        m0804c_set_send_mode(&g_wapi_handler_inst, WAPI_DEFAULT_SOCKET, g_opt.send_mode);
+    static wapi_dgram_t dgrams[REPLAY_DGRAM_NUM_MAX];
+    for (uint32_t i = 0; i < g_opt.dgram_num; i++)
+        dgrams[i] = (wapi_dgram_t){.data = buf, .len = (uint16_t)g_opt.send_len};
+    static wapi_msg_t msgs[REPLAY_DGRAM_NUM_MAX];
+    uint32_t msg_num = g_opt.dgram_num ? g_opt.dgram_num : 1;
+    for (uint32_t i = 0; i < msg_num; i++)
+        msgs[i] = (wapi_msg_t){.data = buf, .len = (uint16_t)g_opt.send_len, .pf_sent_cb = app_sent_cb};
+    for (uint32_t i = 0; i < g_opt.send_num; i++)
+    {
+        if (g_opt.piece_num)
+        {
+            app_send_async(buf, i);
+            host_os_delay_ms(g_opt.send_period_ms);
+            continue;
+        }
+        if (g_opt.is_window)
+        {
+            wapi_status_t ret = m0804c_send_window(&g_wapi_handler_inst, WAPI_DEFAULT_SOCKET, msgs, (uint16_t)msg_num);
+            if (WAPI_OK != ret)
+                printf("[%7u ms] m0804c_send_window #%u failed: %d\n", host_os_now_ms(), i, ret);
+            host_os_delay_ms(g_opt.send_period_ms);
+            continue;
+        }
+        wapi_status_t ret = g_opt.dgram_num ?
+            m0804c_sendto_batch(&g_wapi_handler_inst, WAPI_DEFAULT_SOCKET, dgrams, (uint16_t)g_opt.dgram_num) :
+            m0804c_send(&g_wapi_handler_inst, WAPI_DEFAULT_SOCKET, buf, (uint16_t)g_opt.send_len, app_recv_parse);
+        if (WAPI_OK == ret)
+            g_app_dgram_num += g_opt.dgram_num;
+        else
+            printf("[%7u ms] %s #%u failed: %d\n", host_os_now_ms(),
+                   g_opt.dgram_num ? "m0804c_sendto_batch" : "m0804c_send", i, ret);
+        host_os_delay_ms(g_opt.send_period_ms);
+    }
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Replay loop                                  */
+/* -------------------------------------------------------------------------- */
+
+static struct
+{
+    uint32_t tx_matched;
+    uint32_t tx_mismatched;
+    uint32_t tx_missing;        /* Captured TX the stack never produced */
+    uint32_t tx_extra;          /* Stack TX beyond the end of the trace */
+    uint32_t rx_delivered;
+    uint32_t reaction_num;
+    uint64_t reaction_sum;      /* RX delivered -> next stack TX, virtual ms */
+    uint32_t reaction_max;
+    uint64_t reaction_orig_sum; /* Same gaps in the trace */
+    uint32_t reaction_orig_max;
+} g_stat;
+
+static size_t next_tx_index(size_t from)
+{
+    while (from < g_rec_num && UART_CAPTURE_DIR_TX != g_rec[from].dir)
+        from++;
+    return from;
+}
+
+static void print_hex_mismatch(const tx_event_t *ev, const trace_rec_t *rec)
+{
+    printf("[%7u ms] TX mismatch: got %u bytes \"", ev->time, ev->len);
+    fwrite(ev->data, 1, ev->len, stdout);
+    printf("\" expected %u bytes \"", rec->len);
+    fwrite(rec->data, 1, rec->len, stdout);
+    printf("\"\n");
+}
+
+static int replay_run(void)
+{
+    size_t i = 0;                       /* Next trace record to play */
+    size_t tx_next = next_tx_index(0);  /* Next captured TX the stack has to produce */
+    uint32_t anchor_orig = 0;           /* Trace time of the last played event */
+    uint32_t anchor_virt = host_os_now_ms();
+    bool is_rx_pending_reaction = false;
+    uint32_t last_rx_virt = 0, last_rx_orig = 0;
+    uint32_t last_activity = anchor_virt;
+    uint32_t stall_start = anchor_virt;
+
+    while (1)
+    {
+        uint32_t now = host_os_now_ms();
+        uint32_t until;
+
+        if (i < g_rec_num && UART_CAPTURE_DIR_TX == g_rec[i].dir)
+        {
+            if (tx_next > i)
+            {
+                i++;            /* Already produced by the stack */
+                stall_start = now;
+                continue;
+            }
+            if ((int32_t)(now - stall_start) >= (int32_t)g_opt.stall_ms)
+            {
+                printf("[%7u ms] TX stall: record %zu (%u bytes) not produced, skipped\n", now, i, g_rec[i].len);
+                g_stat.tx_missing++;
+                tx_next = next_tx_index(i + 1);
+                anchor_orig = g_rec[i].ms;
+                anchor_virt = now;
+                i++;
+                stall_start = now;
+                continue;
+            }
+            until = stall_start + g_opt.stall_ms;
+        }
+        else if (i < g_rec_num)
+        {
+            uint32_t due = anchor_virt + (g_rec[i].ms - anchor_orig);
+            if ((int32_t)(now - due) >= 0)
+            {
+                board_rx(g_rec[i].data, g_rec[i].len);
+                g_stat.rx_delivered++;
+                anchor_orig = last_rx_orig = g_rec[i].ms;
+                anchor_virt = last_rx_virt = last_activity = now;
+                is_rx_pending_reaction = true;
+                i++;
+                stall_start = now;
+                continue;
+            }
+            until = due;
+        }
+        else
+        {
+            /* Trace exhausted, report once the stack has been quiet for a stall period */
+            if ((int32_t)(now - last_activity) >= (int32_t)g_opt.stall_ms)
+                break;
+            until = last_activity + g_opt.stall_ms;
+        }
+
+        tx_event_t *ev = board_wait_tx(until);
+        if (!ev)
+            continue;
+
+        if (tx_next < g_rec_num)
+        {
+            const trace_rec_t *rec = &g_rec[tx_next];
+            if (rec->len == ev->len && !memcmp(rec->data, ev->data, ev->len))
+            {
+                g_stat.tx_matched++;
+            }
+            else
+            {
+                g_stat.tx_mismatched++;
+                print_hex_mismatch(ev, rec);
+            }
+            if (is_rx_pending_reaction)
+            {
+                uint32_t reaction = ev->time - last_rx_virt;
+                /* Synthetic traces may stamp a TX before the answer to the previous one */
+                uint32_t reaction_orig = (rec->ms > last_rx_orig) ? rec->ms - last_rx_orig : 0;
+                g_stat.reaction_num++;
+                g_stat.reaction_sum += reaction;
+                g_stat.reaction_orig_sum += reaction_orig;
+                if (reaction > g_stat.reaction_max)
+                    g_stat.reaction_max = reaction;
+                if (reaction_orig > g_stat.reaction_orig_max)
+                    g_stat.reaction_orig_max = reaction_orig;
+                is_rx_pending_reaction = false;
+            }
+            anchor_orig = rec->ms;
+            anchor_virt = ev->time;
+            tx_next = next_tx_index(tx_next + 1);
+        }
+        else
+        {
+            g_stat.tx_extra++;
+        }
+        last_activity = host_os_now_ms();
+
+        /* Bytes on the wire, then TX complete interrupt */
+        if (g_opt.baud)
+            host_os_delay_ms((uint32_t)((uint64_t)ev->len * 10 * 1000 / g_opt.baud));
+        free(ev);
+        board_tx_complete();
+    }
+    return 0;
+}
+
+static void write_out(const uint8_t *data, uint32_t len, void *arg)
+{
+    fwrite(data, 1, len, (FILE *)arg);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-s scale] [-a init|cert|pwd|upload] [-n sends] [-p period_ms] [-b baud]\n"
+            "          [-t stall_ms] [-z send_len] [-m hex|bin] [-u dgrams] [-q pieces] [-w]\n"
+            "          [-o out.ucap] [-l] [-v] trace.ucap\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "s:a:n:p:b:t:z:m:u:q:wo:lv")) != -1)
+    {
+        switch (c)
+        {
+        case 's': g_opt.scale = atof(optarg); break;
+        case 'a':
+            if (!strcmp(optarg, "init"))
+                g_opt.auth = AUTH_INIT_ONLY;
+            else if (!strcmp(optarg, "cert"))
+                g_opt.auth = AUTH_CERT;
+            else if (!strcmp(optarg, "pwd"))
+                g_opt.auth = AUTH_PWD;
+            else if (!strcmp(optarg, "upload"))
+                g_opt.auth = AUTH_UPLOAD;
+            else
+                usage(argv[0]);
+            break;
+        case 'n': g_opt.send_num = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'p': g_opt.send_period_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'b': g_opt.baud = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 't': g_opt.stall_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'z': g_opt.send_len = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'm':
+            if (!strcmp(optarg, "hex"))
+                g_opt.send_mode = WAPI_SEND_MODE_HEX;
+            else if (!strcmp(optarg, "bin"))
+                g_opt.send_mode = WAPI_SEND_MODE_BINARY;
+            else
+                usage(argv[0]);
+            break;
+        case 'u': g_opt.dgram_num = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'q': g_opt.piece_num = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'w': g_opt.is_window = true; break;
+        case 'o': g_opt.out_path = optarg; break;
+        case 'l': g_opt.is_lat_report = true; break;
+        case 'v': g_opt.is_verbose = true; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || g_opt.scale <= 0 || !g_opt.send_len || g_opt.send_len > REPLAY_SEND_LEN_MAX ||
+        g_opt.dgram_num > REPLAY_DGRAM_NUM_MAX || g_opt.piece_num > g_opt.send_len ||
+        (g_opt.piece_num && (g_opt.dgram_num || g_opt.is_window)))
+        usage(argv[0]);
+    g_opt.trace_path = argv[optind];
+
+    if (load_trace(g_opt.trace_path))
+        return 2;
+    printf("trace: %zu records, %u ms\n", g_rec_num, g_rec_num ? g_rec[g_rec_num - 1].ms : 0);
+
+    host_os_init(g_opt.scale);
+    build_fixtures();
+
+#if (UART_PROTO_CAPTURE)
+    static uint8_t out_buf[REPLAY_OUT_CAPTURE_SIZE];
+    if (g_opt.out_path)
+    {
+        uart_capture_init(&g_out_capture, out_buf, sizeof(out_buf), host_os_now_ms, 1000);
+        uart_capture_start(&g_out_capture);
+        replay_uart_proto_input_arg.capture = &g_out_capture;
+    }
+#else
+    if (g_opt.out_path)
+    {
+        fprintf(stderr, "-o needs a build with -DUART_PROTO_CAPTURE=1\n");
+        return 2;
+    }
+#endif
+
+    timer_wheel_init(&g_timer_wheel, TIMER_WHEEL_TICK_MS, host_os_enter_critical, host_os_exit_critical);
+    g_host_at_os_interface.pf_timer_create(&g_wheel_tick_timer, "wheel_tick", TIMER_WHEEL_TICK_MS, 1,
+                                           wheel_tick_cb, &g_timer_wheel);
+    timer_wheel_set_tick_ctrl(&g_timer_wheel, wheel_tick_ctrl, g_wheel_tick_timer);
+
+#if (UART_PROTO_STATIC_ALLOC)
+    mem_arena_init(&g_stack_arena, g_stack_storage, sizeof(g_stack_storage));
+#endif
+    if (WAPI_OK != m0804c_inst(&g_wapi_handler_inst, &replay_input_arg))
+    {
+        fprintf(stderr, "m0804c_inst failed\n");
+        return 2;
+    }
+    if (g_opt.dgram_num)
+    {
+        wapi_socket_param_t param = {.proto = WAPI_SOCKET_UDP, .remote_port = g_wapi_info.server_port,
+                                     .local_port = g_wapi_info.local_port, .lane = AT_LANE_DATA};
+        memcpy(param.remote_ip, g_wapi_info.server_ip, sizeof(param.remote_ip));
+        m0804c_socket_config(&g_wapi_handler_inst, WAPI_DEFAULT_SOCKET, &param);
+    }
+    host_os_start();
+
+    struct timespec wall_start, wall_end, cpu_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    m0804c_init(&g_wapi_handler_inst);
+    if (AUTH_CERT == g_opt.auth)
+        m0804c_use_cert_conn(&g_wapi_handler_inst);
+    else if (AUTH_PWD == g_opt.auth)
+        m0804c_use_pwd_conn(&g_wapi_handler_inst);
+    pthread_t app_tid;
+    pthread_create(&app_tid, NULL, app_thread, NULL);
+    pthread_detach(app_tid);
+
+    replay_run();
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+
+#if (UART_PROTO_CAPTURE)
+    if (g_opt.out_path)
+    {
+        FILE *f = fopen(g_opt.out_path, "wb");
+        uint32_t primask = host_os_enter_critical();
+        if (f)
+            uart_capture_flush(&g_out_capture, write_out, f);
+        host_os_exit_critical(primask);
+        if (f)
+            fclose(f);
+        else
+            perror(g_opt.out_path);
+    }
+#else
+    (void)write_out;
+#endif
+
+    double wall_ms = (wall_end.tv_sec - wall_start.tv_sec) * 1000.0 +
+                     (wall_end.tv_nsec - wall_start.tv_nsec) / 1e6;
+    double cpu_ms = cpu_end.tv_sec * 1000.0 + cpu_end.tv_nsec / 1e6;
+    printf("---- replay summary ----\n");
+    printf("virtual time      : %u ms (scale %.3f, wall %.1f ms, cpu %.1f ms)\n",
+           host_os_now_ms(), g_opt.scale, wall_ms, cpu_ms);
+    printf("rx chunks         : %u/%zu records\n", g_stat.rx_delivered, g_rec_num);
+#if (UART_PROTO_STATIC_ALLOC)
+    printf("stack arena       : %zu/%zu bytes used\n", g_stack_arena.used, g_stack_arena.size);
+#endif
+    printf("tx                : %u matched, %u mismatched, %u missing, %u extra\n",
+           g_stat.tx_matched, g_stat.tx_mismatched, g_stat.tx_missing, g_stat.tx_extra);
+    printf("app responses     : %u/%u sends\n", g_app_rsp_num, g_opt.send_num);
+    printf("app rx data       : %u bytes\n", g_app_rx_len);
+    if (g_opt.is_window)
+        printf("app messages      : %u answered +OK, %u/%u completed\n", g_app_msg_ok, g_app_msg_done,
+               g_opt.send_num * (g_opt.dgram_num ? g_opt.dgram_num : 1));
+    else if (g_opt.dgram_num)
+        printf("app datagrams     : %u/%u sent\n", g_app_dgram_num, g_opt.send_num * g_opt.dgram_num);
+    uint32_t drop_len = 0;
+    if (g_opt.piece_num)
+    {
+        m0804c_get_tx_dropped(&g_wapi_handler_inst, WAPI_DEFAULT_SOCKET, &drop_len);
+        printf("app queued        : %u/%u bytes, %u dropped\n", g_app_queued_len,
+               g_opt.send_num * g_opt.send_len, drop_len);
+    }
+    wapi_reconn_stats_t reconn;
+    if (WAPI_OK == m0804c_get_reconn_stats(&g_wapi_handler_inst, &reconn) &&
+        (reconn.recover_num[WAPI_RECONN_SOCKET] || reconn.recover_num[WAPI_RECONN_AUTH] ||
+         reconn.recover_num[WAPI_RECONN_INIT]))
+        printf("reconnects        : socket %u, auth %u, init %u (last %u ms at tier %d, max %u ms)\n",
+               reconn.recover_num[WAPI_RECONN_SOCKET], reconn.recover_num[WAPI_RECONN_AUTH],
+               reconn.recover_num[WAPI_RECONN_INIT], reconn.last_recover_ms, reconn.last_tier,
+               reconn.max_recover_ms);
+    uint32_t boot_ms;
+    if (WAPI_OK == m0804c_get_boot_ms(&g_wapi_handler_inst, &boot_ms))
+        printf("module boot       : %u ms\n", boot_ms);
+    printf("wheel ticks       : %u in %u ms\n", g_wheel_tick_num, host_os_now_ms());
+    printf("send mode         : %s\n",
+           (WAPI_SEND_MODE_BINARY == m0804c_get_send_mode(&g_wapi_handler_inst, WAPI_DEFAULT_SOCKET)) ?
+           "binary" : "hex");
+    if (g_stat.reaction_num)
+        printf("reaction rx->tx   : avg %.1f ms max %u ms (trace avg %.1f ms max %u ms, n=%u)\n",
+               (double)g_stat.reaction_sum / g_stat.reaction_num, g_stat.reaction_max,
+               (double)g_stat.reaction_orig_sum / g_stat.reaction_num, g_stat.reaction_orig_max,
+               g_stat.reaction_num);
+#if AT_LATENCY_STATS
+    if (g_opt.is_lat_report)
+    {
+        /* The report goes through the RTT port */
+        fflush(stdout);
+        g_opt.is_verbose = true;
+        m0804c_lat_report(&g_wapi_handler_inst);
+    }
+#endif
+
+    fflush(stdout);
+    /* Stack threads run forever, end the process here */
+    _exit((g_stat.tx_mismatched || g_stat.tx_missing) ? 1 : 0);
+}
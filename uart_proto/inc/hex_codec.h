@@ -0,0 +1,32 @@
+/**
+ * @file hex_codec.h
+ * @brief Table-driven hex encode/decode of AT payloads (NSEND/NRECV)
+ *
+ * Encode looks up one 16-bit character pair per byte in a 512-byte table and stores
+ * two pairs per 32-bit word. With HEX_CODEC_SIMD on an SSSE3 host 16 bytes are encoded
+ * per step. Decode validates every character, case-insensitive.
+ */
+
+#ifndef __HEX_CODEC_H__
+#define __HEX_CODEC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef HEX_CODEC_SIMD
+#define HEX_CODEC_SIMD              1   /* Vector path where the compiler targets SSSE3, no effect otherwise */
+#endif
+
+/**
+ * Write 2 * len upper-case characters to dest, no terminator. Works front to back and
+ * reads a block before writing it, so the raw bytes may sit behind the output in the
+ * same buffer (src >= dest + len).
+ */
+void hex_encode(const uint8_t *src, size_t len, uint8_t *dest);
+/**
+ * Decode src_len characters into src_len / 2 bytes, dest may equal src.
+ * @return bytes written, -1 on odd length or a non-hex character (dest content undefined)
+ */
+int32_t hex_decode(const uint8_t *src, size_t src_len, uint8_t *dest);
+
+#endif /* __HEX_CODEC_H__ */
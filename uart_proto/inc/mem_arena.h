@@ -0,0 +1,37 @@
+/**
+ * @file mem_arena.h
+ * @brief Bump allocator over caller-provided storage (static allocation mode)
+ *
+ * With UART_PROTO_STATIC_ALLOC the stack takes every instance buffer out of one
+ * arena instead of the heap. Blocks are never freed one by one, an instance that
+ * fails to initialize rewinds the arena to the mark taken before it started.
+ * Not thread safe, instances are created from one init context.
+ */
+
+#ifndef __MEM_ARENA_H__
+#define __MEM_ARENA_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MEM_ARENA_ALIGN             8
+#define MEM_ARENA_ALIGN_UP(size)    (((size_t)(size) + MEM_ARENA_ALIGN - 1) & ~((size_t)MEM_ARENA_ALIGN - 1))
+
+/* compile-time check of a storage size macro against the private type it covers */
+#define MEM_ARENA_SIZE_CHECK(cond, name)    typedef char mem_arena_size_check_##name[(cond) ? 1 : -1]
+
+typedef struct
+{
+    uint8_t *base;      /* Storage, MEM_ARENA_ALIGN aligned */
+    size_t size;        /* Storage size in bytes */
+    size_t used;        /* Bytes handed out */
+} mem_arena_t;
+
+void mem_arena_init(mem_arena_t *const arena, void *base, size_t size);
+/* zeroed block of size bytes, NULL when the arena is exhausted */
+void *mem_arena_alloc(mem_arena_t *const arena, size_t size);
+size_t mem_arena_mark(const mem_arena_t *const arena);
+/* give back everything allocated after mark */
+void mem_arena_rewind(mem_arena_t *const arena, size_t mark);
+
+#endif /* __MEM_ARENA_H__ */
@@ -27,8 +27,8 @@ typedef struct t_list
 }t_list_t;
 
 void t_list_init(t_list_t *node);
-void t_list_insert_after(t_list_t *node, t_list_t *new);
-void t_list_insert_before(t_list_t *node, t_list_t *new);
+void t_list_insert_after(t_list_t *node, t_list_t *new_node);
+void t_list_insert_before(t_list_t *node, t_list_t *new_node);
 void t_list_remove(t_list_t *node);
 bool t_list_is_empty(t_list_t *node);
 
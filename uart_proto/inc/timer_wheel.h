@@ -0,0 +1,69 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timer wheel driven by one periodic tick
+ *
+ * Timers of all handlers share one wheel, arming and stopping is an O(1) list operation
+ * in the OSAL critical section instead of a command to the RTOS timer task. The owner
+ * calls timer_wheel_tick() every TIMER_WHEEL_TICK_MS (e.g. from one auto-reload OS timer),
+ * expired callbacks run in that context without the critical section held.
+ *
+ * With timer_wheel_set_tick_ctrl the tick only runs while a timer is armed: the first timer
+ * armed on an idle wheel starts it, the first tick that finds the wheel empty stops it.
+ * The wheel time (now) stands still meanwhile, which no armed timer can notice.
+ * pf_tick_ctrl is called from the arming task or the tick context, so it must not block.
+ *
+ * TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots, level n slot covers SLOTS^n ticks.
+ * Timers of a higher level are cascaded down when the lower level wraps, longer timeouts
+ * than the wheel span are clamped to it.
+ */
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "t_list.h"
+
+#define TIMER_WHEEL_TICK_MS         10
+#define TIMER_WHEEL_SLOT_BITS       6
+#define TIMER_WHEEL_SLOTS           (1U << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_LEVELS          3   /* Span: 2^18 ticks, about 43 minutes at 10 ms */
+#define TIMER_WHEEL_MAX_TICKS       ((1UL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+typedef struct
+{
+    t_list_t list;                  /* Slot or expired list, empty when not armed */
+    uint32_t expire;                /* Tick count at expiry */
+    void (*pf_timeout)(void *arg);  /* Runs in timer_wheel_tick() context */
+    void *arg;
+} wheel_timer_t;
+
+typedef struct
+{
+    t_list_t slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    volatile uint32_t now;          /* Ticks elapsed */
+    uint32_t tick_ms;
+    uint32_t (*pf_enter_critical)(void);
+    void (*pf_exit_critical)(uint32_t primask);
+    uint32_t armed_num;             /* Timers on the wheel or its expired list */
+    bool is_ticking;                /* Tick started by pf_tick_ctrl and not stopped since */
+    void (*pf_tick_ctrl)(bool is_run, void *arg); /* Optional, starts/stops the tick source */
+    void *tick_ctrl_arg;
+} timer_wheel_t;
+
+void timer_wheel_init(timer_wheel_t *const wheel, uint32_t tick_ms,
+                      uint32_t (*pf_enter_critical)(void), void (*pf_exit_critical)(uint32_t primask));
+/* tick only while a timer is armed, pf_tick_ctrl runs outside the critical section */
+void timer_wheel_set_tick_ctrl(timer_wheel_t *const wheel, void (*pf_tick_ctrl)(bool is_run, void *arg),
+                               void *arg);
+/* advance one tick and run the expired callbacks */
+void timer_wheel_tick(timer_wheel_t *const wheel);
+
+void wheel_timer_init(wheel_timer_t *const timer, void (*pf_timeout)(void *arg), void *arg);
+/* (re)arm, expires after timeout_ms rounded up to whole ticks, at least one tick */
+void wheel_timer_start(timer_wheel_t *const wheel, wheel_timer_t *const timer, uint32_t timeout_ms);
+/* disarm, a callback already taken off the wheel by the tick still runs */
+void wheel_timer_stop(timer_wheel_t *const wheel, wheel_timer_t *const timer);
+bool wheel_timer_is_armed(timer_wheel_t *const wheel, wheel_timer_t *const timer);
+
+#endif /* __TIMER_WHEEL_H__ */
@@ -0,0 +1,105 @@
+/**
+ * @file uart_capture.h
+ * @brief Raw UART session capture (record side of record-and-replay)
+ *
+ * Logs timestamped TX and RX byte streams of a uart_proto instance into a
+ * linear RAM buffer. The buffer content is the capture file itself, so a
+ * trace is obtained on target by dumping the first `fill` bytes of the buffer
+ * (e.g. J-Link `savebin`), and on host by uart_capture_flush() to a file.
+ * Traces are replayed by tools/uart_replay.
+ *
+ * Format (all fields little-endian, no padding):
+ *   - File header (12 bytes): "UCAP", u8 version, u8 reserved, u16 reserved, u32 tick_hz
+ *   - Record (7 bytes + payload): u32 tick, u8 dir (0 = TX, 1 = RX), u16 len, payload[len]
+ *
+ * RX records are the bytes seen by one IDLE/DMA notification, so the original
+ * chunking is preserved. When the buffer is full new records are dropped (the
+ * trace stays a consistent prefix) and counted in `dropped`.
+ */
+
+#ifndef __UART_CAPTURE_H__
+#define __UART_CAPTURE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UART_CAPTURE_VERSION            1
+#define UART_CAPTURE_FILE_HDR_LEN       12
+#define UART_CAPTURE_REC_HDR_LEN        7
+
+/**
+ * @brief Direction of a captured record
+ */
+typedef enum
+{
+    UART_CAPTURE_DIR_TX = 0,    /**< Host -> module, captured at write */
+    UART_CAPTURE_DIR_RX = 1     /**< Module -> host, captured at IDLE notify */
+} uart_capture_dir_t;
+
+/**
+ * @brief Capture instance (RAM sink)
+ */
+typedef struct
+{
+    uint8_t *buf;                   /**< Capture storage, starts with the file header */
+    uint32_t size;                  /**< Storage size in bytes */
+    volatile uint32_t fill;         /**< Valid bytes in buf (header included) */
+    volatile uint32_t dropped;      /**< Records lost because storage was full */
+    volatile bool is_running;       /**< Recording enabled */
+    bool is_header_out;             /**< File header already handed out by a flush */
+    uint32_t (*pf_get_tick)(void);  /**< Timestamp source, must be ISR safe */
+    uint32_t tick_hz;               /**< Resolution of pf_get_tick */
+} uart_capture_t;
+
+/**
+ * @brief One decoded record (reader side)
+ */
+typedef struct
+{
+    uint32_t tick;
+    uint8_t dir;
+    uint16_t len;
+    const uint8_t *data;
+} uart_capture_rec_t;
+
+/**
+ * @brief Bind storage and timestamp source, write the file header
+ * @return 0 on success, -1 on invalid parameters
+ */
+int32_t uart_capture_init(uart_capture_t *const cap, uint8_t *buf, uint32_t size,
+                          uint32_t (*pf_get_tick)(void), uint32_t tick_hz);
+void uart_capture_start(uart_capture_t *const cap);
+void uart_capture_stop(uart_capture_t *const cap);
+
+/**
+ * @brief Append one record made of up to two pieces (ring wrap)
+ *
+ * Not reentrant, the caller serializes (uart_proto calls it inside its critical section).
+ */
+void uart_capture_record(uart_capture_t *const cap, uart_capture_dir_t dir,
+                         const uint8_t *data1, uint16_t len1,
+                         const uint8_t *data2, uint16_t len2);
+
+/**
+ * @brief Hand the captured bytes to pf_out and empty the storage
+ *
+ * Allows long host sessions to stream to a file. Caller serializes with recording.
+ * @return Number of bytes handed out
+ */
+uint32_t uart_capture_flush(uart_capture_t *const cap,
+                            void (*pf_out)(const uint8_t *data, uint32_t len, void *arg), void *arg);
+
+/**
+ * @brief Validate a capture file header
+ * @return 0 on success (tick_hz filled), -1 not a capture
+ */
+int32_t uart_capture_parse_header(const uint8_t *buf, uint32_t len, uint32_t *tick_hz);
+
+/**
+ * @brief Decode the record at *offset and advance it
+ * @return 0 on success, 1 end of trace, -1 truncated record
+ */
+int32_t uart_capture_next(const uint8_t *buf, uint32_t len, uint32_t *offset,
+                          uart_capture_rec_t *rec);
+
+#endif /* __UART_CAPTURE_H__ */
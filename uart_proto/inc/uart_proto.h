@@ -57,6 +57,20 @@
 /* Optional feature controls */
 #define CUSTOM_RX_THREAD_ATT            1  /**< Enable custom thread attributes */
 #define CUSTOM_UART_PROTO_CONFIG        0  /**< Enable custom UART protocol config */
+#ifndef UART_PROTO_CAPTURE
+#define UART_PROTO_CAPTURE              0  /**< Enable raw TX/RX session capture (uart_capture.h) */
+#endif
+
+#ifndef UART_PROTO_STATIC_ALLOC
+#define UART_PROTO_STATIC_ALLOC         0  /**< No heap: every layer of the stack takes its storage from a caller arena */
+#endif
+
+#if (UART_PROTO_CAPTURE)
+#include "uart_capture.h"
+#endif
+#if (UART_PROTO_STATIC_ALLOC)
+#include "mem_arena.h"
+#endif
 
 /* -------------------------------------------------------------------------- */
 /*                           Core Configuration                               */
@@ -306,6 +320,12 @@ typedef struct
 #if (CUSTOM_UART_PROTO_CONFIG)
     uart_proto_config_t *uart_proto_config; /**< Optional protocol config (NULL -> use default) */
 #endif
+#if (UART_PROTO_CAPTURE)
+    uart_capture_t *capture;             /**< Optional session capture (NULL -> not recorded) */
+#endif
+#if (UART_PROTO_STATIC_ALLOC)
+    mem_arena_t *arena;                  /**< Instance storage, at least UART_PROTO_STORAGE_SIZE() free */
+#endif
 } uart_proto_input_arg_t;
 
 #if (UART_PROTO_MODE_DEFAULT == UART_PROTO_MODE_FUNCTION_CODE || \
@@ -329,6 +349,21 @@ typedef struct
 /** Private forward declaration */
 typedef struct uart_proto_priv_data uart_proto_priv_data_t;
 
+#if (UART_PROTO_STATIC_ALLOC)
+/**
+ * @brief Arena bytes needed by one instance
+ *
+ * Private data, parse buffer (same size as the DMA ring) and the nodes of
+ * funcode_num function-code subscriptions. The private sizes are upper bounds
+ * checked against the real types when uart_proto.c is compiled.
+ */
+#define UART_PROTO_PRIV_SIZE            (8 * sizeof(void *) + 16)
+#define UART_PROTO_FUNCODE_NODE_SIZE    (5 * sizeof(void *))
+#define UART_PROTO_STORAGE_SIZE(rx_buf_size, funcode_num) \
+    (MEM_ARENA_ALIGN_UP(UART_PROTO_PRIV_SIZE) + MEM_ARENA_ALIGN_UP(rx_buf_size) + \
+     (funcode_num) * MEM_ARENA_ALIGN_UP(UART_PROTO_FUNCODE_NODE_SIZE))
+#endif
+
 /* -------------------------------------------------------------------------- */
 /*                             Main UART handle                               */
 /* -------------------------------------------------------------------------- */
@@ -382,4 +417,12 @@ void notify_isr_cb(uart_proto_t *const self);
  */
 void reset_rx_state(uart_proto_t *const self);
 
+/**
+ * @brief Transmit through uart_ops.pf_uart_write
+ *
+ * Upper layers send through this instead of calling pf_uart_write directly,
+ * so the TX stream can be captured. Thread and ISR safe.
+ */
+void uart_proto_write(uart_proto_t *const self, uint8_t *const data, uint16_t len);
+
 #endif /* __UART_PROTO_H__ */
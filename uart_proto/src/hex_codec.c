@@ -0,0 +1,100 @@
+/**
+ * @file hex_codec.c
+ * @brief Table-driven hex encode/decode of AT payloads
+ */
+
+#include "hex_codec.h"
+#include <string.h>
+
+#if HEX_CODEC_SIMD && defined(__SSSE3__)
+#include <tmmintrin.h>
+#define HEX_CODEC_USE_SSSE3         1
+#else
+#define HEX_CODEC_USE_SSSE3         0
+#endif
+
+#define HEX_CHAR(n)                 ((n) < 10 ? '0' + (n) : 'A' - 10 + (n))
+
+/* Character pair of a byte as it lies in memory, so one 16-bit store writes both */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define HEX_PAIR(b)                 (uint16_t)((HEX_CHAR((b) >> 4) << 8) | HEX_CHAR((b) & 0x0F))
+#define HEX_WORD(p0, p1)            (((uint32_t)(p0) << 16) | (uint32_t)(p1))
+#else
+#define HEX_PAIR(b)                 (uint16_t)(HEX_CHAR((b) >> 4) | (HEX_CHAR((b) & 0x0F) << 8))
+#define HEX_WORD(p0, p1)            ((uint32_t)(p0) | ((uint32_t)(p1) << 16))
+#endif
+
+#define HEX_ROW(r) \
+    HEX_PAIR((r) + 0x0), HEX_PAIR((r) + 0x1), HEX_PAIR((r) + 0x2), HEX_PAIR((r) + 0x3), \
+    HEX_PAIR((r) + 0x4), HEX_PAIR((r) + 0x5), HEX_PAIR((r) + 0x6), HEX_PAIR((r) + 0x7), \
+    HEX_PAIR((r) + 0x8), HEX_PAIR((r) + 0x9), HEX_PAIR((r) + 0xA), HEX_PAIR((r) + 0xB), \
+    HEX_PAIR((r) + 0xC), HEX_PAIR((r) + 0xD), HEX_PAIR((r) + 0xE), HEX_PAIR((r) + 0xF)
+
+static const uint16_t g_hex_pair[256] =
+{
+    HEX_ROW(0x00), HEX_ROW(0x10), HEX_ROW(0x20), HEX_ROW(0x30),
+    HEX_ROW(0x40), HEX_ROW(0x50), HEX_ROW(0x60), HEX_ROW(0x70),
+    HEX_ROW(0x80), HEX_ROW(0x90), HEX_ROW(0xA0), HEX_ROW(0xB0),
+    HEX_ROW(0xC0), HEX_ROW(0xD0), HEX_ROW(0xE0), HEX_ROW(0xF0),
+};
+
+/* Nibble value + 1 of a character, 0: not a hex digit */
+static const uint8_t g_hex_val[256] =
+{
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,
+    ['5'] = 6,  ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+void hex_encode(const uint8_t *src, size_t len, uint8_t *dest)
+{
+    size_t i = 0;
+    if (!src || !dest)
+        return;
+
+#if HEX_CODEC_USE_SSSE3
+    const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                         '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+        _mm_storeu_si128((__m128i *)(dest + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(dest + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+    /* Both words are built before the first store, see the in-place note in hex_codec.h */
+    for (; i + 4 <= len; i += 4)
+    {
+        uint32_t word0 = HEX_WORD(g_hex_pair[src[i]], g_hex_pair[src[i + 1]]);
+        uint32_t word1 = HEX_WORD(g_hex_pair[src[i + 2]], g_hex_pair[src[i + 3]]);
+        memcpy(dest + 2 * i, &word0, sizeof(word0));
+        memcpy(dest + 2 * i + 4, &word1, sizeof(word1));
+    }
+    for (; i < len; i++)
+    {
+        uint16_t pair = g_hex_pair[src[i]];
+        memcpy(dest + 2 * i, &pair, sizeof(pair));
+    }
+}
+
+int32_t hex_decode(const uint8_t *src, size_t src_len, uint8_t *dest)
+{
+    if (!src || !dest || (src_len & 1) || src_len / 2 > INT32_MAX)
+        return -1;
+
+    /* Invalid characters are collected and checked once, no branch per byte */
+    uint8_t is_invalid = 0;
+    size_t len = src_len / 2;
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t hi = g_hex_val[src[2 * i]];
+        uint8_t lo = g_hex_val[src[2 * i + 1]];
+        is_invalid |= (uint8_t)(!hi | !lo);
+        dest[i] = (uint8_t)(((hi - 1) << 4) | ((lo - 1) & 0x0F));
+    }
+    return is_invalid ? -1 : (int32_t)len;
+}
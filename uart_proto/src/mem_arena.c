@@ -0,0 +1,51 @@
+/**
+ * @file mem_arena.c
+ * @brief Bump allocator over caller-provided storage
+ */
+
+#include "mem_arena.h"
+#include <string.h>
+
+void mem_arena_init(mem_arena_t *const arena, void *base, size_t size)
+{
+    if (!arena)
+        return;
+
+    /* Skip a misaligned head so every block is MEM_ARENA_ALIGN aligned */
+    size_t skip = MEM_ARENA_ALIGN_UP((uintptr_t)base) - (uintptr_t)base;
+    if (!base || size < skip)
+    {
+        arena->base = NULL;
+        arena->size = arena->used = 0;
+        return;
+    }
+    arena->base = (uint8_t *)base + skip;
+    arena->size = size - skip;
+    arena->used = 0;
+}
+
+void *mem_arena_alloc(mem_arena_t *const arena, size_t size)
+{
+    if (!arena || !arena->base || !size)
+        return NULL;
+
+    size = MEM_ARENA_ALIGN_UP(size);
+    if (size > arena->size - arena->used)
+        return NULL;
+
+    void *block = arena->base + arena->used;
+    arena->used += size;
+    memset(block, 0, size);
+    return block;
+}
+
+size_t mem_arena_mark(const mem_arena_t *const arena)
+{
+    return arena ? arena->used : 0;
+}
+
+void mem_arena_rewind(mem_arena_t *const arena, size_t mark)
+{
+    if (arena && mark <= arena->used)
+        arena->used = mark;
+}
@@ -0,0 +1,180 @@
+/**
+ * @file timer_wheel.c
+ * @brief Hierarchical timer wheel driven by one periodic tick
+ */
+
+#include "timer_wheel.h"
+#include <stddef.h>
+
+#define SLOT_MASK                   (TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_INDEX(tick, level)    (((tick) >> (TIMER_WHEEL_SLOT_BITS * (level))) & SLOT_MASK)
+
+/* Called in the critical section */
+static void wheel_place(timer_wheel_t *const wheel, wheel_timer_t *const timer)
+{
+    uint32_t delta = timer->expire - wheel->now;
+    uint8_t level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           delta >= (1UL << (TIMER_WHEEL_SLOT_BITS * (level + 1))))
+        level++;
+    t_list_insert_before(&wheel->slot[level][LEVEL_INDEX(timer->expire, level)], &timer->list);
+}
+
+/* Called in the critical section, re-places the timers of one slot on lower levels */
+static void wheel_cascade(timer_wheel_t *const wheel, uint8_t level)
+{
+    t_list_t *head = &wheel->slot[level][LEVEL_INDEX(wheel->now, level)];
+    while (!t_list_is_empty(head))
+    {
+        wheel_timer_t *timer = T_LIST_ENTRY(head->next, wheel_timer_t, list);
+        t_list_remove(&timer->list);
+        wheel_place(wheel, timer);
+    }
+}
+
+void timer_wheel_init(timer_wheel_t *const wheel, uint32_t tick_ms,
+                      uint32_t (*pf_enter_critical)(void), void (*pf_exit_critical)(uint32_t primask))
+{
+    if (!wheel || !tick_ms || !pf_enter_critical || !pf_exit_critical)
+        return;
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+        for (uint16_t i = 0; i < TIMER_WHEEL_SLOTS; i++)
+            t_list_init(&wheel->slot[level][i]);
+    wheel->now = 0;
+    wheel->tick_ms = tick_ms;
+    wheel->pf_enter_critical = pf_enter_critical;
+    wheel->pf_exit_critical = pf_exit_critical;
+    wheel->armed_num = 0;
+    wheel->is_ticking = false;
+    wheel->pf_tick_ctrl = NULL;
+    wheel->tick_ctrl_arg = NULL;
+}
+
+void timer_wheel_set_tick_ctrl(timer_wheel_t *const wheel, void (*pf_tick_ctrl)(bool is_run, void *arg),
+                               void *arg)
+{
+    uint32_t primask = wheel->pf_enter_critical();
+    wheel->pf_tick_ctrl = pf_tick_ctrl;
+    wheel->tick_ctrl_arg = arg;
+    bool is_start = pf_tick_ctrl && wheel->armed_num && !wheel->is_ticking;
+    if (is_start)
+        wheel->is_ticking = true;
+    wheel->pf_exit_critical(primask);
+    if (is_start)
+        pf_tick_ctrl(true, arg);
+}
+
+/**
+ * Stop the tick of an empty wheel. A timer armed meanwhile may have started the tick before
+ * this stop took effect, so the wheel is looked at again and the tick restarted if needed.
+ */
+static void wheel_tick_idle(timer_wheel_t *const wheel)
+{
+    uint32_t primask = wheel->pf_enter_critical();
+    bool is_stop = wheel->pf_tick_ctrl && wheel->is_ticking && !wheel->armed_num;
+    if (is_stop)
+        wheel->is_ticking = false;
+    wheel->pf_exit_critical(primask);
+    if (!is_stop)
+        return;
+    wheel->pf_tick_ctrl(false, wheel->tick_ctrl_arg);
+
+    primask = wheel->pf_enter_critical();
+    bool is_restart = wheel->armed_num && !wheel->is_ticking;
+    if (is_restart)
+        wheel->is_ticking = true;
+    wheel->pf_exit_critical(primask);
+    if (is_restart)
+        wheel->pf_tick_ctrl(true, wheel->tick_ctrl_arg);
+}
+
+void timer_wheel_tick(timer_wheel_t *const wheel)
+{
+    t_list_t expired;
+    t_list_init(&expired);
+
+    uint32_t primask = wheel->pf_enter_critical();
+    wheel->now++;
+    /* A wrapped level pulls the next slot of the level above down, highest first */
+    uint8_t wrapped = 0;
+    while (wrapped < TIMER_WHEEL_LEVELS - 1 && 0 == LEVEL_INDEX(wheel->now, wrapped))
+        wrapped++;
+    for (uint8_t level = wrapped; level > 0; level--)
+        wheel_cascade(wheel, level);
+
+    t_list_t *head = &wheel->slot[0][LEVEL_INDEX(wheel->now, 0)];
+    if (!t_list_is_empty(head))
+    {
+        /* Move the whole slot, stop() of a timer on the expired list still unlinks it */
+        t_list_insert_after(head, &expired);
+        t_list_remove(head);
+    }
+    wheel->pf_exit_critical(primask);
+
+    while (1)
+    {
+        primask = wheel->pf_enter_critical();
+        if (t_list_is_empty(&expired))
+        {
+            wheel->pf_exit_critical(primask);
+            break;
+        }
+        wheel_timer_t *timer = T_LIST_ENTRY(expired.next, wheel_timer_t, list);
+        t_list_remove(&timer->list);
+        wheel->armed_num--;
+        wheel->pf_exit_critical(primask);
+        /* Unlocked, the callback may re-arm its own or any other timer */
+        timer->pf_timeout(timer->arg);
+    }
+    wheel_tick_idle(wheel);
+}
+
+void wheel_timer_init(wheel_timer_t *const timer, void (*pf_timeout)(void *arg), void *arg)
+{
+    t_list_init(&timer->list);
+    timer->expire = 0;
+    timer->pf_timeout = pf_timeout;
+    timer->arg = arg;
+}
+
+void wheel_timer_start(timer_wheel_t *const wheel, wheel_timer_t *const timer, uint32_t timeout_ms)
+{
+    uint32_t ticks = (timeout_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    if (!ticks)
+        ticks = 1;
+    if (ticks > TIMER_WHEEL_MAX_TICKS)
+        ticks = TIMER_WHEEL_MAX_TICKS;
+
+    uint32_t primask = wheel->pf_enter_critical();
+    bool is_start = false;
+    if (t_list_is_empty(&timer->list))
+    {
+        wheel->armed_num++;
+        is_start = wheel->pf_tick_ctrl && !wheel->is_ticking;
+        if (is_start)
+            wheel->is_ticking = true;
+    }
+    t_list_remove(&timer->list);
+    timer->expire = wheel->now + ticks;
+    wheel_place(wheel, timer);
+    wheel->pf_exit_critical(primask);
+    if (is_start)
+        wheel->pf_tick_ctrl(true, wheel->tick_ctrl_arg);
+}
+
+void wheel_timer_stop(timer_wheel_t *const wheel, wheel_timer_t *const timer)
+{
+    uint32_t primask = wheel->pf_enter_critical();
+    if (!t_list_is_empty(&timer->list))
+        wheel->armed_num--;
+    t_list_remove(&timer->list);
+    wheel->pf_exit_critical(primask);
+}
+
+bool wheel_timer_is_armed(timer_wheel_t *const wheel, wheel_timer_t *const timer)
+{
+    uint32_t primask = wheel->pf_enter_critical();
+    bool is_armed = !t_list_is_empty(&timer->list);
+    wheel->pf_exit_critical(primask);
+    return is_armed;
+}
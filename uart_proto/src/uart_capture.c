@@ -0,0 +1,146 @@
+/**
+ * @file uart_capture.c
+ * @brief Raw UART session capture implementation
+ *
+ * Writer (RAM sink) and reader helpers of the capture format described in
+ * uart_capture.h. The reader is shared by the host replay tool.
+ */
+
+#include "uart_capture.h"
+#include <string.h>
+
+static const uint8_t capture_magic[4] = {'U', 'C', 'A', 'P'};
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void write_file_header(uart_capture_t *const cap)
+{
+    memcpy(cap->buf, capture_magic, sizeof(capture_magic));
+    cap->buf[4] = UART_CAPTURE_VERSION;
+    cap->buf[5] = 0;
+    put_u16(cap->buf + 6, 0);
+    put_u32(cap->buf + 8, cap->tick_hz);
+    cap->fill = UART_CAPTURE_FILE_HDR_LEN;
+}
+
+int32_t uart_capture_init(uart_capture_t *const cap, uint8_t *buf, uint32_t size,
+                          uint32_t (*pf_get_tick)(void), uint32_t tick_hz)
+{
+    if (!cap || !buf || size < UART_CAPTURE_FILE_HDR_LEN || !pf_get_tick || !tick_hz)
+        return -1;
+
+    cap->buf = buf;
+    cap->size = size;
+    cap->dropped = 0;
+    cap->is_running = false;
+    cap->is_header_out = false;
+    cap->pf_get_tick = pf_get_tick;
+    cap->tick_hz = tick_hz;
+    write_file_header(cap);
+    return 0;
+}
+
+void uart_capture_start(uart_capture_t *const cap)
+{
+    if (cap && cap->buf)
+        cap->is_running = true;
+}
+
+void uart_capture_stop(uart_capture_t *const cap)
+{
+    if (cap)
+        cap->is_running = false;
+}
+
+void uart_capture_record(uart_capture_t *const cap, uart_capture_dir_t dir,
+                         const uint8_t *data1, uint16_t len1,
+                         const uint8_t *data2, uint16_t len2)
+{
+    if (!cap || !cap->is_running)
+        return;
+
+    uint32_t len = (uint32_t)len1 + len2;
+    if (len > 0xFFFF || cap->fill + UART_CAPTURE_REC_HDR_LEN + len > cap->size)
+    {
+        cap->dropped++;
+        return;
+    }
+
+    uint8_t *p = cap->buf + cap->fill;
+    put_u32(p, cap->pf_get_tick());
+    p[4] = (uint8_t)dir;
+    put_u16(p + 5, (uint16_t)len);
+    p += UART_CAPTURE_REC_HDR_LEN;
+    if (len1)
+        memcpy(p, data1, len1);
+    if (len2)
+        memcpy(p + len1, data2, len2);
+    cap->fill += UART_CAPTURE_REC_HDR_LEN + len;
+}
+
+uint32_t uart_capture_flush(uart_capture_t *const cap,
+                            void (*pf_out)(const uint8_t *data, uint32_t len, void *arg), void *arg)
+{
+    if (!cap || !cap->buf || !pf_out)
+        return 0;
+
+    /* The header goes out once, following flushes continue the same file */
+    uint32_t start = cap->is_header_out ? UART_CAPTURE_FILE_HDR_LEN : 0;
+    uint32_t len = cap->fill - start;
+    if (len)
+        pf_out(cap->buf + start, len, arg);
+    cap->is_header_out = true;
+    cap->fill = UART_CAPTURE_FILE_HDR_LEN;
+    return len;
+}
+
+int32_t uart_capture_parse_header(const uint8_t *buf, uint32_t len, uint32_t *tick_hz)
+{
+    if (!buf || len < UART_CAPTURE_FILE_HDR_LEN ||
+        memcmp(buf, capture_magic, sizeof(capture_magic)) || buf[4] != UART_CAPTURE_VERSION)
+        return -1;
+    if (tick_hz)
+        *tick_hz = get_u32(buf + 8);
+    return 0;
+}
+
+int32_t uart_capture_next(const uint8_t *buf, uint32_t len, uint32_t *offset,
+                          uart_capture_rec_t *rec)
+{
+    uint32_t pos = *offset;
+    if (pos >= len)
+        return 1;
+    if (len - pos < UART_CAPTURE_REC_HDR_LEN)
+        return -1;
+
+    rec->tick = get_u32(buf + pos);
+    rec->dir = buf[pos + 4];
+    rec->len = get_u16(buf + pos + 5);
+    if (len - pos - UART_CAPTURE_REC_HDR_LEN < rec->len)
+        return -1;
+    rec->data = buf + pos + UART_CAPTURE_REC_HDR_LEN;
+    *offset = pos + UART_CAPTURE_REC_HDR_LEN + rec->len;
+    return 0;
+}
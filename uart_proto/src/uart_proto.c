@@ -29,6 +29,15 @@
 #define MALLOC(size)            malloc(size) /* FreeRTOS memory allocation */
 #define FREE(ptr)               free(ptr)       
 
+/* Instance storage: caller arena in static mode, heap otherwise */
+#if (UART_PROTO_STATIC_ALLOC)
+#define INST_ALLOC(self, size)  mem_arena_alloc((self)->uart_proto_input_arg->arena, size)
+#define INST_FREE(self, ptr)    ((void)(ptr))   /* Rewound as a whole on init failure */
+#else
+#define INST_ALLOC(self, size)  MALLOC(size)
+#define INST_FREE(self, ptr)    FREE(ptr)
+#endif
+
 #define OS_INTERFACE(p)         (p)->uart_proto_input_arg->os_interface
 #define UART_INTERFACE(p)       (p)->uart_proto_input_arg->uart_ops
 #define PARSE_INTERFACE(p)      (p)->uart_proto_input_arg->frame_parse_att
@@ -59,6 +68,10 @@
 #define RECV_BUF(p)         PARSE_INTERFACE(p)->recv_buf_att->recv_buf
 #define RECV_BUF_SIZE(p)    PARSE_INTERFACE(p)->recv_buf_att->buffer_size
 
+#if (UART_PROTO_CAPTURE)
+#define CAPTURE(p)          (p)->uart_proto_input_arg->capture
+#endif
+
 #define NON_COPY_WHEN_NON_WRAP
 
 /* -------------------------------------------------------------------------- */
@@ -81,9 +94,16 @@ typedef struct uart_proto_priv_data
 #if (UART_PROTO_MODE_DEFAULT == UART_PROTO_MODE_FUNCTION_CODE || \
      UART_PROTO_MODE_DEFAULT == UART_PROTO_MODE_DUAL_STRATEGY)
     t_list_t funcode_sentinel;
+#if (UART_PROTO_STATIC_ALLOC)
+    t_list_t funcode_free;      /* Unsubscribed nodes, reused before taking arena space */
+#endif
 #endif
 } uart_proto_priv_data_t;
 
+#if (UART_PROTO_STATIC_ALLOC)
+MEM_ARENA_SIZE_CHECK(sizeof(uart_proto_priv_data_t) <= UART_PROTO_PRIV_SIZE, uart_proto_priv);
+#endif
+
 /**
  * @brief Frame information passed between ISR and parsing task
  */
@@ -111,6 +131,10 @@ typedef struct
     pf_fun_code_cb_t cb;
 } funcode_node_t;
 
+#if (UART_PROTO_STATIC_ALLOC)
+MEM_ARENA_SIZE_CHECK(sizeof(funcode_node_t) <= UART_PROTO_FUNCODE_NODE_SIZE, funcode_node);
+#endif
+
 /* -------------------------------------------------------------------------- */
 /*                         Function Code Helper APIs                          */
 /* -------------------------------------------------------------------------- */
@@ -124,7 +148,20 @@ static funcode_node_t *funcode_node_init(uart_proto_t *const self,
     if (!self || !para)
         return NULL;
 
-    funcode_node_t *node = MALLOC(sizeof(funcode_node_t));
+    funcode_node_t *node = NULL;
+#if (UART_PROTO_STATIC_ALLOC)
+    OS_INTERFACE(self)->pf_os_enter_critical();
+    if (!t_list_is_empty(&PRIV_DATA(self)->funcode_free))
+    {
+        node = T_LIST_ENTRY(PRIV_DATA(self)->funcode_free.next, funcode_node_t, list);
+        t_list_remove(&node->list);
+    }
+    OS_INTERFACE(self)->pf_os_exit_critical(0);
+    if (!node)
+        node = INST_ALLOC(self, sizeof(funcode_node_t));
+#else
+    node = MALLOC(sizeof(funcode_node_t));
+#endif
     if (!node)
         return NULL;
 
@@ -196,9 +233,13 @@ static uart_proto_status_t unsubscribe_funcode(uart_proto_t *const self,
     OS_INTERFACE(self)->pf_os_enter_critical();
     funcode_node_t *node = (funcode_node_t *)handle;
     t_list_remove(&node->list);
+#if (UART_PROTO_STATIC_ALLOC)
+    t_list_insert_after(&PRIV_DATA(self)->funcode_free, &node->list);
+    OS_INTERFACE(self)->pf_os_exit_critical(0);
+#else
     OS_INTERFACE(self)->pf_os_exit_critical(0);
-
     FREE(handle);
+#endif
     return UART_PROTO_OK;
 }
 
@@ -316,6 +357,32 @@ static void handle_transparent_parse(uart_proto_t *const self,
 }
 #endif
 
+#if (UART_PROTO_CAPTURE)
+/* -------------------------------------------------------------------------- */
+/*                              Session Capture                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Record the bytes DMA wrote into the ring since the last notification
+ *
+ * Called with the critical section held. Uses the DMA position rather than the
+ * parse window, so bytes kept for a later parse are not recorded twice.
+ */
+static void capture_rx(uart_proto_t *const self, uint16_t from, uint16_t to)
+{
+    if (!CAPTURE(self) || from == to)
+        return;
+
+    if (from < to)
+        uart_capture_record(CAPTURE(self), UART_CAPTURE_DIR_RX,
+                            RECV_BUF(self) + from, to - from, NULL, 0);
+    else
+        uart_capture_record(CAPTURE(self), UART_CAPTURE_DIR_RX,
+                            RECV_BUF(self) + from, RECV_BUF_SIZE(self) - from,
+                            RECV_BUF(self), to);
+}
+#endif
+
 /* -------------------------------------------------------------------------- */
 /*                            Parsing Thread Task                             */
 /* -------------------------------------------------------------------------- */
@@ -390,8 +457,13 @@ uart_proto_status_t uart_proto_inst(uart_proto_t *const self,
         !OS_INTERFACE(self)->pf_os_exit_critical)
         return UART_PROTO_ERR_PARAM_INVALID;     
 
+#if (UART_PROTO_STATIC_ALLOC)
+    if (!self->uart_proto_input_arg->arena)
+        return UART_PROTO_ERR_PARAM_INVALID;
+#endif
+
     /* --- Resource allocation --- */
-    self->uart_proto_priv_data = MALLOC(sizeof(uart_proto_priv_data_t));
+    self->uart_proto_priv_data = INST_ALLOC(self, sizeof(uart_proto_priv_data_t));
     if (!PRIV_DATA(self))
         return UART_PROTO_ERR_OTHERS;
 
@@ -399,9 +471,13 @@ uart_proto_status_t uart_proto_inst(uart_proto_t *const self,
     PRIV_DATA(self)->parse_fail_count = 0;
     PRIV_DATA(self)->header = PRIV_DATA(self)->tail = PRIV_DATA(self)->data_counter = 0;
 
-    PRIV_DATA(self)->parse_buf = MALLOC(RECV_BUF_SIZE(self));
+    PRIV_DATA(self)->parse_buf = INST_ALLOC(self, RECV_BUF_SIZE(self));
     if (!PRIV_DATA(self)->parse_buf)
+    {
+        INST_FREE(self, PRIV_DATA(self));
+        self->uart_proto_priv_data = NULL;
         return UART_PROTO_ERR_OTHERS;
+    }
 
     /* --- Initialize hardware --- */
     UART_INTERFACE(self)->pf_uart_init();
@@ -439,6 +515,9 @@ uart_proto_status_t uart_proto_inst(uart_proto_t *const self,
 #if (UART_PROTO_MODE_DEFAULT == UART_PROTO_MODE_FUNCTION_CODE || \
      UART_PROTO_MODE_DEFAULT == UART_PROTO_MODE_DUAL_STRATEGY)
     t_list_init(&PRIV_DATA(self)->funcode_sentinel);
+#if (UART_PROTO_STATIC_ALLOC)
+    t_list_init(&PRIV_DATA(self)->funcode_free);
+#endif
     self->pf_subscribe = subscribe_funcode;
     self->pf_unsubscribe = unsubscribe_funcode;
 #endif
@@ -464,6 +543,25 @@ void reset_rx_state(uart_proto_t *const self)
     UART_INTERFACE(self)->pf_set_counter(RECV_BUF_SIZE(self));
 }
 
+/**
+ * @brief Transmit data, recording it first when capture is enabled
+ */
+void uart_proto_write(uart_proto_t *const self, uint8_t *const data, uint16_t len)
+{
+    if (!self || !PRIV_DATA(self) || !PRIV_DATA(self)->is_inited)
+        return;
+
+#if (UART_PROTO_CAPTURE)
+    if (CAPTURE(self))
+    {
+        uint32_t primask = OS_INTERFACE(self)->pf_os_enter_critical();
+        uart_capture_record(CAPTURE(self), UART_CAPTURE_DIR_TX, data, len, NULL, 0);
+        OS_INTERFACE(self)->pf_os_exit_critical(primask);
+    }
+#endif
+    UART_INTERFACE(self)->pf_uart_write(data, len);
+}
+
 /**
  * @brief UART receive ISR callback
  *
@@ -492,6 +590,10 @@ void notify_isr_cb(uart_proto_t *const self)
     PRIV_DATA(self)->header += (current_index - PRIV_DATA(self)->data_counter + RECV_BUF_SIZE(self)) %
                           RECV_BUF_SIZE(self);
 
+#if (UART_PROTO_CAPTURE)
+    capture_rx(self, PRIV_DATA(self)->data_counter, current_index);
+#endif
+
     /* Exit if no new data */
     if (PRIV_DATA(self)->header == PRIV_DATA(self)->tail)
     {